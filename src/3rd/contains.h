@@ -1,8 +1,13 @@
 #pragma once
 
+#include "filtered_predicates.h"
 #include "predicates.h"
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
+#include <cmath>
 #include <span>
 #include <type_traits>
 
@@ -11,15 +16,15 @@ namespace convex_hull_membership {
 namespace details {
 
 template <typename T>
-bool is_separating_plane(std::span<T> pts, std::span<T> query_point, size_t i,
+bool is_separating_plane(std::span<const T> pts, std::span<const T> query_point, size_t i,
                          size_t j, size_t k) {
     constexpr size_t DIM = 3;
     assert(query_point.size() == DIM);
-    T* pa = pts.data() + DIM * i;
-    T* pb = pts.data() + DIM * j;
-    T* pc = pts.data() + DIM * k;
-    T* pd = query_point.data();
-    const auto ori_query = orient3d(pa, pb, pc, pd);
+    const T* pa = pts.data() + DIM * i;
+    const T* pb = pts.data() + DIM * j;
+    const T* pc = pts.data() + DIM * k;
+    const T* pd = query_point.data();
+    const auto ori_query = filtered_predicates::exact_orient3d(pa, pb, pc, pd);
     if (ori_query == 0) {
         // Query point is coplanar with the triangle formed by i, j, k.
         // It is contained in the convex hull by definition.
@@ -31,8 +36,8 @@ bool is_separating_plane(std::span<T> pts, std::span<T> query_point, size_t i,
         if (l == i || l == j || l == k) {
             continue;
         }
-        T* pe = pts.data() + DIM * l;
-        const auto ori = orient3d(pa, pb, pc, pe);
+        const T* pe = pts.data() + DIM * l;
+        const auto ori = filtered_predicates::exact_orient3d(pa, pb, pc, pe);
         if (ori * ori_query > 0) {
             return false;
         }
@@ -41,14 +46,14 @@ bool is_separating_plane(std::span<T> pts, std::span<T> query_point, size_t i,
 }
 
 template <typename T>
-bool is_separating_plane(std::span<T> pts, std::span<T> query_point, size_t i,
+bool is_separating_plane(std::span<const T> pts, std::span<const T> query_point, size_t i,
                          size_t j) {
     constexpr size_t DIM = 2;
     assert(query_point.size() == DIM);
-    T* pa = pts.data() + DIM * i;
-    T* pb = pts.data() + DIM * j;
-    T* pc = query_point.data();
-    const auto ori_query = orient2d(pa, pb, pc);
+    const T* pa = pts.data() + DIM * i;
+    const T* pb = pts.data() + DIM * j;
+    const T* pc = query_point.data();
+    const auto ori_query = filtered_predicates::exact_orient2d(pa, pb, pc);
     if (ori_query == 0) {
         // Query point is coplanar with the triangle formed by i, j, k.
         // It is contained in the convex hull by definition.
@@ -60,8 +65,8 @@ bool is_separating_plane(std::span<T> pts, std::span<T> query_point, size_t i,
         if (l == i || l == j) {
             continue;
         }
-        T* pd = pts.data() + DIM * l;
-        const auto ori = orient2d(pa, pb, pd);
+        const T* pd = pts.data() + DIM * l;
+        const auto ori = filtered_predicates::exact_orient2d(pa, pb, pd);
         if (ori * ori_query > 0) {
             return false;
         }
@@ -69,27 +74,29 @@ bool is_separating_plane(std::span<T> pts, std::span<T> query_point, size_t i,
     return true;
 }
 
-}  // namespace details
-
-template <int DIM, typename T>
-bool contains(std::span<T> pts, std::span<T> query_point) {
-    static_assert(std::is_same_v<T, IGL_PREDICATES_REAL>);
-    exactinit();
-    const size_t num_pts = pts.size() / DIM;
-
+/// The test of every plane (line in 2D) through DIM of the points, in the
+/// order of `order`. The query point is outside of the hull iff one of them
+/// separates it from the other points, so the order only changes how soon a
+/// separating plane is found. `separates(i, j, k)` (`separates(i, j)` in 2D)
+/// tests the plane through the points `i`, `j` and `k`.
+template <int DIM, typename Order, typename Test>
+bool no_separating_plane(const Order& order, size_t num_pts,
+                         const Test& separates) {
+    // Planes are enumerated by the last of their points in `order`, so the
+    // planes through the first points of `order` are tested first.
     if constexpr (DIM == 3) {
-        for (size_t i = 0; i < num_pts; i++) {
-            for (size_t j = i + 1; j < num_pts; j++) {
-                for (size_t k = j + 1; k < num_pts; k++) {
-                    if (details::is_separating_plane(pts, query_point, i, j, k))
+        for (size_t k = 2; k < num_pts; k++) {
+            for (size_t j = 1; j < k; j++) {
+                for (size_t i = 0; i < j; i++) {
+                    if (separates(order[i], order[j], order[k]))
                         return false;
                 }
             }
         }
     } else if constexpr (DIM == 2) {
-        for (size_t i = 0; i < num_pts; i++) {
-            for (size_t j = i + 1; j < num_pts; j++) {
-                if (details::is_separating_plane(pts, query_point, i, j))
+        for (size_t j = 1; j < num_pts; j++) {
+            for (size_t i = 0; i < j; i++) {
+                if (separates(order[i], order[j]))
                     return false;
             }
         }
@@ -97,4 +104,341 @@ bool contains(std::span<T> pts, std::span<T> query_point) {
     return true;
 }
 
+/// The points with their coordinates also in structure-of-arrays layout, for
+/// the batched predicates.
+template <int DIM, typename T>
+struct point_set {
+    std::span<const T> pts;
+    size_t size;
+    std::array<std::array<double, filtered_predicates::max_batch_size>, DIM> coords;
+
+    point_set(std::span<const T> pts) : pts(pts), size(pts.size() / DIM) {
+        assert(size <= filtered_predicates::max_batch_size);
+        for (size_t l = 0; l < size; l++) {
+            for (int d = 0; d < DIM; d++) coords[d][l] = pts[DIM * l + d];
+        }
+    }
+
+    const T* operator[](size_t l) const { return pts.data() + DIM * l; }
+};
+
+/// The number of points per batched predicate in `is_separating_plane`. Most
+/// planes are ruled out by one of the first points, so the batches are small.
+constexpr size_t separating_chunk = 8;
+
+/// `is_separating_plane` by one batched predicate on all the points. Only the
+/// points whose orientation the filter can't certify go to the exact
+/// predicate, and only if no certain point rules out the plane.
+template <typename T>
+bool is_separating_plane(const point_set<3, T>& pts, const T* query_point, size_t i,
+                         size_t j, size_t k) {
+    const int ori_query =
+        filtered_predicates::orient3d(pts[i], pts[j], pts[k], query_point);
+    if (ori_query == 0) {
+        return false;
+    }
+    std::array<int8_t, filtered_predicates::max_batch_size> ori;
+    uint32_t uncertain = 0;
+    for (size_t base = 0; base < pts.size; base += separating_chunk) {
+        const size_t num = std::min(separating_chunk, pts.size - base);
+        uncertain |= filtered_predicates::orient3d_batch(
+            pts[i], pts[j], pts[k], pts.coords[0].data() + base,
+            pts.coords[1].data() + base, pts.coords[2].data() + base, num,
+            ori.data() + base) << base;
+        bool same_side = false;
+        for (size_t l = base; l < base + num; l++) {
+            same_side |= ori[l] == ori_query;
+        }
+        if (same_side) {
+            return false;
+        }
+    }
+    // the points of the plane are on it
+    uncertain &= ~((uint32_t(1) << i) | (uint32_t(1) << j) | (uint32_t(1) << k));
+    for (; uncertain; uncertain &= uncertain - 1) {
+        const size_t l = size_t(std::countr_zero(uncertain));
+        if (filtered_predicates::orient3d(pts[i], pts[j], pts[k], pts[l]) == ori_query) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// The largest number of points whose planes are ordered by `search_order`.
+constexpr size_t max_ordered_points = filtered_predicates::max_batch_size;
+
+template <int DIM>
+using point = std::array<double, DIM>;
+
+template <int DIM>
+double dot(const point<DIM>& a, const point<DIM>& b) {
+    double result = 0;
+    for (int d = 0; d < DIM; d++) result += a[d] * b[d];
+    return result;
+}
+
+/// Finds the closest point to the origin on the simplex of `x[simplex[0]]`,
+/// ..., `x[simplex[size - 1]]` by solving the affine minimizer of each of its
+/// faces (Johnson's distance sub-algorithm). The simplex is reduced to the
+/// face containing the closest point.
+template <int DIM>
+point<DIM> closest_on_simplex(const point<DIM>* x,
+                              std::array<size_t, DIM + 1>& simplex,
+                              size_t& size) {
+    point<DIM> best = x[simplex[0]];
+    double best_norm = dot<DIM>(best, best);
+    unsigned best_face = 1;
+    for (unsigned face = 2; face < (1u << size); face++) {
+        std::array<size_t, DIM + 1> v{};
+        size_t m = 0;
+        for (size_t a = 0; a < size; a++) {
+            if ((face >> a) & 1) v[m++] = simplex[a];
+        }
+        const point<DIM>& x0 = x[v[0]];
+        // minimize |x0 + sum_a mu_a (x_a - x0)| by the normal equations
+        std::array<point<DIM>, DIM> e;
+        double G[DIM][DIM + 1];
+        double scale = 0;
+        for (size_t a = 1; a < m; a++) {
+            for (int d = 0; d < DIM; d++) e[a - 1][d] = x[v[a]][d] - x0[d];
+        }
+        for (size_t a = 0; a + 1 < m; a++) {
+            for (size_t b = 0; b + 1 < m; b++) G[a][b] = dot<DIM>(e[a], e[b]);
+            G[a][m - 1] = -dot<DIM>(x0, e[a]);
+            scale += G[a][a];
+        }
+        // Gaussian elimination with partial pivoting; degenerate faces are
+        // covered by their own faces
+        const size_t n = m - 1;
+        bool singular = false;
+        for (size_t c = 0; c < n && !singular; c++) {
+            size_t pivot = c;
+            for (size_t r = c + 1; r < n; r++) {
+                if (std::abs(G[r][c]) > std::abs(G[pivot][c])) pivot = r;
+            }
+            if (!(std::abs(G[pivot][c]) > 1e-12 * scale)) {
+                singular = true;
+                break;
+            }
+            for (size_t b = 0; b <= n; b++) std::swap(G[c][b], G[pivot][b]);
+            for (size_t r = c + 1; r < n; r++) {
+                const double f = G[r][c] / G[c][c];
+                for (size_t b = c; b <= n; b++) G[r][b] -= f * G[c][b];
+            }
+        }
+        if (singular) continue;
+        std::array<double, DIM> mu;
+        double lambda0 = 1;
+        for (size_t r = n; r-- > 0;) {
+            double s = G[r][n];
+            for (size_t b = r + 1; b < n; b++) s -= G[r][b] * mu[b];
+            mu[r] = s / G[r][r];
+            lambda0 -= mu[r];
+        }
+        bool interior = lambda0 > 0;
+        for (size_t a = 0; a < n; a++) interior = interior && mu[a] > 0;
+        if (!interior) continue;
+        point<DIM> y = x0;
+        for (size_t a = 0; a < n; a++) {
+            for (int d = 0; d < DIM; d++) y[d] += mu[a] * e[a][d];
+        }
+        const double norm = dot<DIM>(y, y);
+        if (norm < best_norm) {
+            best = y;
+            best_norm = norm;
+            best_face = face;
+        }
+    }
+    size_t m = 0;
+    for (size_t a = 0; a < size; a++) {
+        if ((best_face >> a) & 1) simplex[m++] = simplex[a];
+    }
+    size = m;
+    return best;
+}
+
+/// Whether the query point lies in the closed simplex of DIM + 1 points,
+/// evaluated by the exact predicates.
+template <int DIM, typename T>
+bool in_simplex(std::span<const T> pts, std::span<const T> query_point,
+                const std::array<size_t, DIM + 1>& simplex) {
+    std::array<const T*, DIM + 1> p;
+    for (int a = 0; a <= DIM; a++) p[a] = pts.data() + DIM * simplex[a];
+    auto orient = [](const std::array<const T*, DIM + 1>& q) {
+        if constexpr (DIM == 3) {
+            return filtered_predicates::orient3d(q[0], q[1], q[2], q[3]);
+        } else {
+            return filtered_predicates::orient2d(q[0], q[1], q[2]);
+        }
+    };
+    const auto ori = orient(p);
+    if (ori == 0) {
+        return false;
+    }
+    for (int a = 0; a <= DIM; a++) {
+        std::array<const T*, DIM + 1> q = p;
+        q[a] = query_point.data();
+        if (orient(q) * ori < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Runs GJK on the points relative to the query point. If it ends in a simplex
+/// that contains the query point, which is certified by the exact predicates,
+/// returns true. Otherwise orders the points by their distance to the plane
+/// that supports the hull at the point closest to the query point, so the
+/// facets of the hull that face the query point come first in
+/// `no_separating_plane`.
+template <int DIM, typename T>
+bool search_order(std::span<const T> pts, std::span<const T> query_point,
+                  std::array<size_t, max_ordered_points>& order,
+                  size_t num_pts) {
+    std::array<point<DIM>, max_ordered_points> x;
+    double scale = 0;
+    for (size_t i = 0; i < num_pts; i++) {
+        for (int d = 0; d < DIM; d++) x[i][d] = pts[DIM * i + d] - query_point[d];
+        scale = std::max(scale, dot<DIM>(x[i], x[i]));
+    }
+    std::array<size_t, DIM + 1> simplex = {0};
+    size_t size = 1;
+    point<DIM> v = x[0];
+    for (size_t iter = 0; iter < 2 * num_pts; iter++) {
+        const double vv = dot<DIM>(v, v);
+        if (!(vv > 1e-24 * scale)) {
+            // the query point is on the hull up to rounding
+            break;
+        }
+        size_t w = 0;
+        double w_dist = dot<DIM>(v, x[0]);
+        for (size_t i = 1; i < num_pts; i++) {
+            const double dist = dot<DIM>(v, x[i]);
+            if (dist < w_dist) {
+                w = i;
+                w_dist = dist;
+            }
+        }
+        if (vv - w_dist <= 1e-12 * vv ||
+            std::find(simplex.begin(), simplex.begin() + size, w) !=
+                simplex.begin() + size) {
+            // no point is closer to the query point along `v`
+            break;
+        }
+        simplex[size++] = w;
+        v = closest_on_simplex<DIM>(x.data(), simplex, size);
+        if (size == DIM + 1) {
+            break;
+        }
+    }
+    if (size == DIM + 1 && in_simplex<DIM>(pts, query_point, simplex)) {
+        return true;
+    }
+    std::array<double, max_ordered_points> key;
+    for (size_t i = 0; i < num_pts; i++) {
+        order[i] = i;
+        key[i] = dot<DIM>(v, x[i]);
+    }
+    std::sort(order.begin(), order.begin() + num_pts,
+              [&](size_t i, size_t j) { return key[i] < key[j]; });
+    return false;
+}
+
+/// The test of every plane in the input order.
+template <int DIM, typename T>
+bool contains_exhaustive(std::span<const T> pts, std::span<const T> query_point) {
+    struct identity {
+        size_t operator[](size_t i) const { return i; }
+    };
+    auto separates = [&](auto... plane) {
+        return is_separating_plane(pts, query_point, plane...);
+    };
+    return no_separating_plane<DIM>(identity{}, pts.size() / DIM, separates);
+}
+
+/// Whether the query point lies in the convex hull of the 2D points. Seen
+/// from the query point, the points are swept into the smallest cone that
+/// holds their directions: the query point is outside the hull iff the
+/// cone stays narrower than a half-plane. Each point takes two filtered
+/// exact predicates against the sides `lo` and `hi` of the cone, so the
+/// hull is never built. Collinear points keep the convention of
+/// `contains_exhaustive`: with no line that has points on one side only, a
+/// query point on their line is contained.
+template <typename T>
+bool in_hull_2d(std::span<const T> pts, std::span<const T> query_point) {
+    const size_t num_pts = pts.size() / 2;
+    const T* q = query_point.data();
+    auto p = [&](size_t i) { return pts.data() + 2 * i; };
+    auto is_query = [&](size_t i) { return p(i)[0] == q[0] && p(i)[1] == q[1]; };
+    if (is_query(0)) {
+        return true;
+    }
+    // `lo` to `hi` counterclockwise is the cone, whose angle is below pi
+    const T* lo = p(0);
+    const T* hi = p(0);
+    for (size_t i = 1; i < num_pts; i++) {
+        if (is_query(i)) {
+            return true;
+        }
+        const int side_lo = filtered_predicates::orient2d(q, lo, p(i));
+        const int side_hi = filtered_predicates::orient2d(q, hi, p(i));
+        if (side_lo == 0 && side_hi == 0) {
+            // the cone is a ray and the point is on its line: it's inside if
+            // it's on the opposite ray
+            const int d = lo[0] != q[0] ? 0 : 1;
+            if ((p(i)[d] > q[d]) != (lo[d] > q[d])) {
+                return true;
+            }
+        } else if (side_hi > 0) {
+            if (side_lo <= 0) {
+                return true;
+            }
+            hi = p(i);
+        } else if (side_lo < 0) {
+            if (side_hi >= 0) {
+                return true;
+            }
+            lo = p(i);
+        }
+    }
+    // a ray from the query point holds all the points, which are on one line
+    // with it
+    return filtered_predicates::orient2d(q, lo, hi) == 0;
+}
+
+}  // namespace details
+
+/// Whether the query point lies in the convex hull of the points, i.e., no
+/// plane (line in 2D) through DIM of the points separates the query point
+/// from the other points. In 2D, it's the cone sweep of
+/// `details::in_hull_2d`. In 3D, every such plane is checked by the exact
+/// predicates, and a floating-point GJK search only certifies an inside
+/// query point or picks the order of the planes. The result is the same
+/// as `details::contains_exhaustive`.
+template <int DIM, typename T>
+bool contains(std::span<const T> pts, std::span<const T> query_point) {
+    static_assert(std::is_same_v<T, IGL_PREDICATES_REAL>);
+    const size_t num_pts = pts.size() / DIM;
+    if (num_pts == 0) {
+        return true;
+    }
+    if constexpr (DIM == 2) {
+        return details::in_hull_2d(pts, query_point);
+    } else {
+        if (num_pts > details::max_ordered_points) {
+            return details::contains_exhaustive<DIM>(pts, query_point);
+        }
+        std::array<size_t, details::max_ordered_points> order;
+        if (details::search_order<DIM>(pts, query_point, order, num_pts)) {
+            return true;
+        }
+        const details::point_set<DIM, T> point_set(pts);
+        auto separates = [&](auto... plane) {
+            return details::is_separating_plane(point_set, query_point.data(),
+                                                plane...);
+        };
+        return details::no_separating_plane<DIM>(order, num_pts, separates);
+    }
+}
+
 }  // namespace convexhull_membership
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "predicates.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+/// Orientation predicates with a static floating-point filter in front of
+/// the adaptive exact predicates of predicates.c. The determinant is evaluated
+/// relative to the first point, and its sign is certain if it exceeds an error
+/// bound derived from the largest coordinate differences (the semi-static
+/// filters of CGAL). The signs follow `orient2d` and `orient3d`. All of them
+/// are safe to call from several threads at once.
+namespace filtered_predicates {
+
+/// The largest number of points of a batch, one bit each in the mask of
+/// uncertain points.
+constexpr size_t max_batch_size = 32;
+
+/// Initializes the constants of the exact predicates once. `exactinit` writes
+/// file-level statics of predicates.c, so it isn't called again while other
+/// threads may be reading them.
+inline void init() {
+    static const bool initialized = (exactinit(), true);
+    (void)initialized;
+}
+
+/// The exact `orient2d` on constant points, after `init`.
+inline double exact_orient2d(const double pa[2], const double pb[2],
+                             const double pc[2]) {
+    init();
+    return ::orient2d(const_cast<double*>(pa), const_cast<double*>(pb),
+                      const_cast<double*>(pc));
+}
+
+/// The exact `orient3d` on constant points, after `init`.
+inline double exact_orient3d(const double pa[3], const double pb[3],
+                             const double pc[3], const double pd[3]) {
+    init();
+    return ::orient3d(const_cast<double*>(pa), const_cast<double*>(pb),
+                      const_cast<double*>(pc), const_cast<double*>(pd));
+}
+
+/// The sign of `orient2d(pa, pb, pc)`.
+inline int orient2d(const double pa[2], const double pb[2], const double pc[2]) {
+    const double pqx = pb[0] - pa[0], pqy = pb[1] - pa[1];
+    const double prx = pc[0] - pa[0], pry = pc[1] - pa[1];
+    const double det = pqx * pry - pqy * prx;
+    double maxx = std::max(std::abs(pqx), std::abs(prx));
+    double maxy = std::max(std::abs(pqy), std::abs(pry));
+    if (maxx > maxy) std::swap(maxx, maxy);
+    // the bounds keep the error bound from underflow and the determinant from overflow
+    if (maxx >= 1e-146 && maxy < 1e153) {
+        const double eps = 8.8872057372592798e-16 * maxx * maxy;
+        if (det > eps) return 1;
+        if (det < -eps) return -1;
+    }
+    const double exact = exact_orient2d(pa, pb, pc);
+    return (exact > 0) - (exact < 0);
+}
+
+/// The sign of `orient3d(pa, pb, pc, pd)`.
+inline int orient3d(const double pa[3], const double pb[3], const double pc[3],
+                    const double pd[3]) {
+    const double pqx = pb[0] - pa[0], pqy = pb[1] - pa[1], pqz = pb[2] - pa[2];
+    const double prx = pc[0] - pa[0], pry = pc[1] - pa[1], prz = pc[2] - pa[2];
+    const double psx = pd[0] - pa[0], psy = pd[1] - pa[1], psz = pd[2] - pa[2];
+    // the normal of the plane points to the side where `orient3d` is positive
+    const double nx = pry * pqz - prz * pqy;
+    const double ny = prz * pqx - prx * pqz;
+    const double nz = prx * pqy - pry * pqx;
+    const double det = nx * psx + ny * psy + nz * psz;
+    const double maxx = std::max({std::abs(pqx), std::abs(prx), std::abs(psx)});
+    const double maxy = std::max({std::abs(pqy), std::abs(pry), std::abs(psy)});
+    const double maxz = std::max({std::abs(pqz), std::abs(prz), std::abs(psz)});
+    if (std::min({maxx, maxy, maxz}) >= 1e-97 && std::max({maxx, maxy, maxz}) < 1e102) {
+        const double eps = 5.1107127829973299e-15 * maxx * maxy * maxz;
+        if (det > eps) return 1;
+        if (det < -eps) return -1;
+    }
+    const double exact = exact_orient3d(pa, pb, pc, pd);
+    return (exact > 0) - (exact < 0);
+}
+
+/// The filtered signs of `orient2d(pa, pb, (x[l], y[l]))` for the `num` points
+/// of `x` and `y`. The loop runs over the points with no branches, so it maps
+/// onto SIMD lanes.
+///
+/// @param[out] sign            The certain signs, and 0 for the uncertain points.
+///
+/// @return         The mask of uncertain points, to be resolved by `orient2d`.
+inline uint32_t orient2d_batch(const double pa[2], const double pb[2],
+                               const double* x, const double* y, size_t num,
+                               int8_t* sign) {
+    assert(num <= max_batch_size);
+    const double pqx = pb[0] - pa[0], pqy = pb[1] - pa[1];
+    const double pq_maxx = std::abs(pqx), pq_maxy = std::abs(pqy);
+    uint32_t uncertain = 0;
+    for (size_t l = 0; l < num; l++) {
+        const double prx = x[l] - pa[0], pry = y[l] - pa[1];
+        const double det = pqx * pry - pqy * prx;
+        const double maxx = std::max(pq_maxx, std::abs(prx));
+        const double maxy = std::max(pq_maxy, std::abs(pry));
+        const bool in_range = std::min(maxx, maxy) >= 1e-146 && std::max(maxx, maxy) < 1e153;
+        const double eps = 8.8872057372592798e-16 * maxx * maxy;
+        const int s = (det > eps) - (det < -eps);
+        sign[l] = int8_t(in_range ? s : 0);
+        uncertain |= uint32_t(sign[l] == 0) << l;
+    }
+    return uncertain;
+}
+
+/// The filtered signs of `orient3d(pa, pb, pc, (x[l], y[l], z[l]))` for the
+/// `num` points of `x`, `y` and `z`. The parameters follow `orient2d_batch`.
+inline uint32_t orient3d_batch(const double pa[3], const double pb[3],
+                               const double pc[3], const double* x,
+                               const double* y, const double* z, size_t num,
+                               int8_t* sign) {
+    assert(num <= max_batch_size);
+    const double pqx = pb[0] - pa[0], pqy = pb[1] - pa[1], pqz = pb[2] - pa[2];
+    const double prx = pc[0] - pa[0], pry = pc[1] - pa[1], prz = pc[2] - pa[2];
+    const double nx = pry * pqz - prz * pqy;
+    const double ny = prz * pqx - prx * pqz;
+    const double nz = prx * pqy - pry * pqx;
+    const double plane_maxx = std::max(std::abs(pqx), std::abs(prx));
+    const double plane_maxy = std::max(std::abs(pqy), std::abs(pry));
+    const double plane_maxz = std::max(std::abs(pqz), std::abs(prz));
+    uint32_t uncertain = 0;
+    for (size_t l = 0; l < num; l++) {
+        const double psx = x[l] - pa[0], psy = y[l] - pa[1], psz = z[l] - pa[2];
+        const double det = nx * psx + ny * psy + nz * psz;
+        const double maxx = std::max(plane_maxx, std::abs(psx));
+        const double maxy = std::max(plane_maxy, std::abs(psy));
+        const double maxz = std::max(plane_maxz, std::abs(psz));
+        const bool in_range = std::min(std::min(maxx, maxy), maxz) >= 1e-97 &&
+                              std::max(std::max(maxx, maxy), maxz) < 1e102;
+        const double eps = 5.1107127829973299e-15 * maxx * maxy * maxz;
+        const int s = (det > eps) - (det < -eps);
+        sign[l] = int8_t(in_range ? s : 0);
+        uncertain |= uint32_t(sign[l] == 0) << l;
+    }
+    return uncertain;
+}
+
+}  // namespace filtered_predicates
@@ -2,6 +2,8 @@
 
 #include "ImplicitFunction.h"
 #include <Eigen/Core>
+#include <span>
+#include <vector>
 
 
 template<typename Scalar>
@@ -86,11 +88,53 @@ public:
         return loc_part + poly_part;
     }
 
+    /// Sums the terms of the control points directly, without the kernel vectors of `evaluate` and `evaluate_gradient`, which are allocated per point.
+    void evaluate_batch(std::span<const Scalar> x, std::span<const Scalar> y, std::span<const Scalar> z,
+                        std::span<Scalar> values) const override {
+        for (size_t k = 0; k < values.size(); ++k) {
+            values[k] = evaluate_point(Vec3(x[k], y[k], z[k]), nullptr);
+        }
+    }
+
+    void evaluate_gradient_batch(std::span<const Scalar> x, std::span<const Scalar> y, std::span<const Scalar> z,
+                                 std::span<Scalar> values, std::span<Scalar> gx, std::span<Scalar> gy, std::span<Scalar> gz) const override {
+        Vec3 grad;
+        for (size_t k = 0; k < values.size(); ++k) {
+            values[k] = evaluate_point(Vec3(x[k], y[k], z[k]), &grad);
+            gx[k] = grad(0);
+            gy[k] = grad(1);
+            gz[k] = grad(2);
+        }
+    }
+
 private:
     VecX coeff_a_;
     Vec4 coeff_b_;
     std::vector<Vec3> control_points_;
 
+    // sum(ai * fi) + sum(hi * gi) + c, and its gradient if `grad` is set
+    Scalar evaluate_point(const Vec3 &p, Vec3 *grad) const {
+        size_t num_pt = control_points_.size();
+        Scalar value = coeff_b_(0) + coeff_b_(1) * p(0) + coeff_b_(2) * p(1) + coeff_b_(3) * p(2);
+        if (grad) {
+            *grad = coeff_b_.template tail<3>();
+        }
+        for (size_t i = 0; i < num_pt; ++i) {
+            Vec3 diff = p - control_points_[i];
+            Scalar len = diff.norm();
+            Vec3 h(coeff_a_[num_pt + i], coeff_a_[2 * num_pt + i], coeff_a_[3 * num_pt + i]);
+            Scalar hd = h.dot(diff);
+            value += coeff_a_[i] * len * len * len + 3 * len * hd;
+            if (grad) {
+                *grad += 3 * len * coeff_a_[i] * diff;
+                if (len >= 1e-8) {
+                    *grad += 3 * (len * h + diff * (hd / len));
+                }
+            }
+        }
+        return value;
+    }
+
     // |p1-p2|^3
     static Scalar kernel_function(const Vec3 &p1, const Vec3 &p2) {
         return pow((p1 - p2).norm(), 3);
@@ -1,10 +1,64 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <span>
+
 template <typename Scalar>
 class ImplicitFunction
 {
 public:
     virtual Scalar evaluate(Scalar x, Scalar y, Scalar z) const = 0;
     virtual Scalar evaluate_gradient(Scalar x, Scalar y, Scalar z, Scalar &gx, Scalar &gy, Scalar &gz) const = 0;
+    /// Evaluates the function at the points (`x[i]`, `y[i]`, `z[i]`) and writes the values to `values[i]`.
+    /// All spans have the same size. The default calls `evaluate` per point.
+    virtual void evaluate_batch(std::span<const Scalar> x, std::span<const Scalar> y, std::span<const Scalar> z,
+                                std::span<Scalar> values) const
+    {
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            values[i] = evaluate(x[i], y[i], z[i]);
+        }
+    }
+    /// Evaluates the function and its gradient at the points (`x[i]`, `y[i]`, `z[i]`), like `evaluate_batch`.
+    /// The default calls `evaluate_gradient` per point.
+    virtual void evaluate_gradient_batch(std::span<const Scalar> x, std::span<const Scalar> y, std::span<const Scalar> z,
+                                         std::span<Scalar> values, std::span<Scalar> gx, std::span<Scalar> gy, std::span<Scalar> gz) const
+    {
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            values[i] = evaluate_gradient(x[i], y[i], z[i], gx[i], gy[i], gz[i]);
+        }
+    }
+    /// Writes an axis-aligned box that contains the zero set of the function.
+    /// Returns `false` if the zero set is unbounded or no such box is known.
+    virtual bool zero_set_bbox(std::array<Scalar, 3> &/*bbox_min*/, std::array<Scalar, 3> &/*bbox_max*/) const { return false; }
     virtual ~ImplicitFunction() = default;
-};
\ No newline at end of file
+};
+
+/// Base of the functions whose scalar evaluation is cheap enough to inline, e.g., the primitives. It overrides the batched evaluation with loops over
+/// the scalar evaluation of `Function`, whose calls are qualified, so they're bound statically and may be inlined and vectorized across the points.
+template <typename Function, typename Scalar>
+class BatchedImplicitFunction : public ImplicitFunction<Scalar>
+{
+public:
+    void evaluate_batch(std::span<const Scalar> x, std::span<const Scalar> y, std::span<const Scalar> z,
+                        std::span<Scalar> values) const override
+    {
+        const Function &function = static_cast<const Function &>(*this);
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            values[i] = function.Function::evaluate(x[i], y[i], z[i]);
+        }
+    }
+
+    void evaluate_gradient_batch(std::span<const Scalar> x, std::span<const Scalar> y, std::span<const Scalar> z,
+                                 std::span<Scalar> values, std::span<Scalar> gx, std::span<Scalar> gy, std::span<Scalar> gz) const override
+    {
+        const Function &function = static_cast<const Function &>(*this);
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            values[i] = function.Function::evaluate_gradient(x[i], y[i], z[i], gx[i], gy[i], gz[i]);
+        }
+    }
+};
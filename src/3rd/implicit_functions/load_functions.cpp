@@ -112,6 +112,22 @@ std::unique_ptr<ImplicitFunction<double>> load_Hermite_RBF(const nlohmann::json&
     }
 }
 
+/// Writes the values of `function` at the points of `xs`, `ys` and `zs` to the `j`th column of `funcVals`, evaluated as one batch.
+static void evaluate_column(const ImplicitFunction<double> &function,
+                            const std::vector<double> &xs,
+                            const std::vector<double> &ys,
+                            const std::vector<double> &zs,
+                            Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> &funcVals,
+                            int j)
+{
+    std::vector<double> values(xs.size());
+    function.evaluate_batch(xs, ys, zs, values);
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        funcVals(i, j) = values[i];
+    }
+}
+
 bool load_functions(const std::string &filename,
                     const std::vector<std::array<double, 3>> &pts,
                     Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> &funcVals)
@@ -134,6 +150,14 @@ bool load_functions(const std::string &filename,
     auto n_pts = static_cast<Eigen::Index>(pts.size());
     auto n_func = static_cast<Eigen::Index>(data.size());
     funcVals.resize(n_pts, n_func);
+    // the coordinates as separate arrays, for the batched evaluation
+    std::vector<double> xs(n_pts), ys(n_pts), zs(n_pts);
+    for (int i = 0; i < n_pts; i++)
+    {
+        xs[i] = pts[i][0];
+        ys[i] = pts[i][1];
+        zs[i] = pts[i][2];
+    }
     for (int j = 0; j < n_func; ++j)
     {
         auto type = data[j]["type"].get<std::string>();
@@ -151,10 +175,7 @@ bool load_functions(const std::string &filename,
             }
             //
             PlaneDistanceFunction<double> plane(point, normal);
-            for (int i = 0; i < n_pts; i++)
-            {
-                funcVals(i, j) = plane.evaluate(pts[i][0], pts[i][1], pts[i][2]);
-            }
+            evaluate_column(plane, xs, ys, zs, funcVals, j);
         }
         else if (type == "line")
         {
@@ -170,10 +191,7 @@ bool load_functions(const std::string &filename,
             }
             //
             CylinderDistanceFunction<double> line(point, unit_vector, 0);
-            for (int i = 0; i < n_pts; i++)
-            {
-                funcVals(i, j) = line.evaluate(pts[i][0], pts[i][1], pts[i][2]);
-            }
+            evaluate_column(line, xs, ys, zs, funcVals, j);
         }
         else if (type == "cylinder")
         {
@@ -219,10 +237,7 @@ bool load_functions(const std::string &filename,
                 cylinder = std::make_unique<CylinderSquaredDistanceFunction<double>>(axis_point, axis_unit_vector, radius);
             else
                 cylinder = std::make_unique<CylinderDistanceFunction<double>>(axis_point, axis_unit_vector, radius);
-            for (int i = 0; i < n_pts; i++)
-            {
-                funcVals(i, j) = cylinder->evaluate(pts[i][0], pts[i][1], pts[i][2]);
-            }
+            evaluate_column(*cylinder, xs, ys, zs, funcVals, j);
         }
         else if (type == "sphere")
         {
@@ -242,10 +257,7 @@ bool load_functions(const std::string &filename,
             {
                 sphere = std::make_unique<SphereUnsignedDistanceFunction<double>>(center, -radius);
             }
-            for (int i = 0; i < n_pts; i++)
-            {
-                funcVals(i, j) = sphere->evaluate(pts[i][0], pts[i][1], pts[i][2]);
-            }
+            evaluate_column(*sphere, xs, ys, zs, funcVals, j);
         }
         else if (type == "torus")
         {
@@ -263,10 +275,7 @@ bool load_functions(const std::string &filename,
             auto minor_radius = data[j]["minor_radius"].get<double>();
             //
             TorusDistanceFunction<double> torus(center, axis_unit_vector, major_radius, minor_radius);
-            for (int i = 0; i < n_pts; i++)
-            {
-                funcVals(i, j) = torus.evaluate(pts[i][0], pts[i][1], pts[i][2]);
-            }
+            evaluate_column(torus, xs, ys, zs, funcVals, j);
         }
         else if (type == "circle")
         {
@@ -283,10 +292,7 @@ bool load_functions(const std::string &filename,
             auto radius = data[j]["radius"].get<double>();
             //
             TorusDistanceFunction<double> circle(center, axis_unit_vector, radius, 0);
-            for (int i = 0; i < n_pts; i++)
-            {
-                funcVals(i, j) = circle.evaluate(pts[i][0], pts[i][1], pts[i][2]);
-            }
+            evaluate_column(circle, xs, ys, zs, funcVals, j);
         }
         else if (type == "cone")
         {
@@ -303,10 +309,7 @@ bool load_functions(const std::string &filename,
             auto apex_angle = data[j]["apex_angle"].get<double>();
             //
             ConeDistanceFunction<double> cone(apex, axis_unit_vector, apex_angle);
-            for (int i = 0; i < n_pts; i++)
-            {
-                funcVals(i, j) = cone.evaluate(pts[i][0], pts[i][1], pts[i][2]);
-            }
+            evaluate_column(cone, xs, ys, zs, funcVals, j);
         }
         else if (type == "zero")
         {
@@ -319,10 +322,7 @@ bool load_functions(const std::string &filename,
             auto pos = filename.find_last_of("/\\");
             auto path_name = filename.substr(0, pos + 1);
             auto rbf = load_Hermite_RBF(data[j], path_name);
-            for (int i = 0; i < n_pts; i++)
-            {
-                funcVals(i, j) = rbf->evaluate(pts[i][0], pts[i][1], pts[i][2]);
-            }
+            evaluate_column(*rbf, xs, ys, zs, funcVals, j);
         }
 #if IMPLICIT_FUNCTIONS_WITH_SHADER_SUPPORT
         else if (type == "shader") {
@@ -344,7 +344,7 @@ bool load_functions(const std::string &filename,
     return true;
 }
 
-bool load_functions(const std::string &filename, std::vector<std::unique_ptr<ImplicitFunction<double>>> &functions)
+bool load_functions(const std::string &filename, std::vector<std::unique_ptr<ImplicitFunction<double>>> &functions, std::vector<bool> *gradient_free)
 {
     using json = nlohmann::json;
     std::ifstream fin(filename.c_str());
@@ -363,6 +363,10 @@ bool load_functions(const std::string &filename, std::vector<std::unique_ptr<Imp
     //
     size_t n_func = data.size();
     functions.resize(n_func);
+    if (gradient_free)
+    {
+        gradient_free->assign(n_func, false);
+    }
     for (int j = 0; j < n_func; ++j)
     {
         auto type = data[j]["type"].get<std::string>();
@@ -550,6 +554,10 @@ bool load_functions(const std::string &filename, std::vector<std::unique_ptr<Imp
             std::cout << "undefined type: " << type << std::endl;
             return false;
         }
+        if (gradient_free)
+        {
+            (*gradient_free)[j] = data[j].contains("gradient_free") && data[j]["gradient_free"].get<bool>();
+        }
     }
     return true;
 }
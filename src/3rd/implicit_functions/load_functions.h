@@ -8,4 +8,6 @@ bool load_functions(const std::string &filename,
                     const std::vector<std::array<double, 3>> &pts,
                     Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> &funcVals);
 
-bool load_functions(const std::string &filename, std::vector<std::unique_ptr<ImplicitFunction<double>>> &functions);
+/// Loads the functions of a function file. If `gradient_free` is set, it receives whether each function has `"gradient_free": true`,
+/// i.e., whether its gradients should be replaced by samples of its values.
+bool load_functions(const std::string &filename, std::vector<std::unique_ptr<ImplicitFunction<double>>> &functions, std::vector<bool> *gradient_free = nullptr);
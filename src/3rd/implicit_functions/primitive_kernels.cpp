@@ -0,0 +1,71 @@
+#include "primitive_kernels.h"
+
+#include <cmath>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace {
+
+// the lane operations of the scalar fallback, see `primitive_lanes.h`
+inline double sqrt(double a) { return std::sqrt(a); }
+inline double abs(double a) { return std::abs(a); }
+inline bool equal_zero(double a) { return a == 0; }
+inline bool less(double a, double b) { return a < b; }
+inline double select(bool mask, double a, double b) { return mask ? a : b; }
+
+} // namespace
+
+#include "primitive_lanes.h"
+
+void evaluate_primitive_scalar(const primitive_params &params, size_t n,
+                               const double *x, const double *y, const double *z,
+                               double *values, double *gx, double *gy, double *gz)
+{
+    const lane_params<double> c(params);
+    double unused;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (gx)
+        {
+            evaluate_lanes<true>(params.kind, c, x[i], y[i], z[i], values[i], gx[i], gy[i], gz[i]);
+        }
+        else
+        {
+            evaluate_lanes<false>(params.kind, c, x[i], y[i], z[i], values[i], unused, unused, unused);
+        }
+    }
+}
+
+bool cpu_has_avx2()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+    __cpuid(info, 1);
+    // the OS saves the YMM registers: OSXSAVE, AVX, and the SSE and AVX state enabled in XCR0
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+    {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+primitive_kernel primitive_dispatch()
+{
+    static const primitive_kernel kernel = cpu_has_avx2() ? evaluate_primitive_avx2 : evaluate_primitive_scalar;
+    return kernel;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+/// The batched kernels of the analytic primitives of `primitives.h` in double precision. Every kernel computes the value (and optionally the gradient)
+/// of one primitive at many points, without branches, so the points run across the lanes of SIMD registers: 4 points per AVX2 instruction, or one by one
+/// in the scalar fallback. The kernel is chosen once at runtime from the instruction sets of the CPU. Both compute the same operations in the same order as
+/// the scalar `evaluate` and `evaluate_gradient` of the primitives, and the special cases of their branches are selected per lane, so the results are
+/// the same bit for bit.
+
+enum class primitive_kind {
+    plane,
+    cylinder,
+    cylinder_squared,
+    sphere,
+    sphere_unsigned,
+    sphere_squared,
+    cone,
+    torus
+};
+
+/// The parameters of a primitive, see the constructors in `primitives.h`.
+struct primitive_params
+{
+    primitive_kind kind;
+    /// The point on the plane, the axis point of a cylinder, or the center or apex.
+    std::array<double, 3> point;
+    /// The unit normal of the plane or the unit axis.
+    std::array<double, 3> axis = {0, 0, 0};
+    /// The radius or major radius, or the cosine of the apex angle of a cone.
+    double radius = 0;
+    /// The minor radius of a torus.
+    double minor_radius = 0;
+};
+
+/// The kernels of one instruction set. `gx`, `gy` and `gz` are either all nullptr, then only the values are computed, as by `evaluate`,
+/// or all set, then the values and gradients are computed as by `evaluate_gradient`. Both may give different values at the special cases.
+using primitive_kernel = void (*)(const primitive_params &params, size_t n,
+                                  const double *x, const double *y, const double *z,
+                                  double *values, double *gx, double *gy, double *gz);
+
+/// The scalar fallback.
+void evaluate_primitive_scalar(const primitive_params &params, size_t n,
+                               const double *x, const double *y, const double *z,
+                               double *values, double *gx, double *gy, double *gz);
+
+/// The AVX2 kernel. It may only be called if `cpu_has_avx2()`.
+void evaluate_primitive_avx2(const primitive_params &params, size_t n,
+                             const double *x, const double *y, const double *z,
+                             double *values, double *gx, double *gy, double *gz);
+
+/// Whether the CPU and the operating system support AVX2, and the AVX2 kernel is compiled in (x86-64 only).
+bool cpu_has_avx2();
+
+/// The kernel chosen for this CPU.
+primitive_kernel primitive_dispatch();
+
+/// Evaluates a primitive by the kernel chosen for this CPU. The parameters follow `primitive_kernel`.
+inline void evaluate_primitive(const primitive_params &params, size_t n,
+                               const double *x, const double *y, const double *z,
+                               double *values, double *gx = nullptr, double *gy = nullptr, double *gz = nullptr)
+{
+    primitive_dispatch()(params, n, x, y, z, values, gx, gy, gz);
+}
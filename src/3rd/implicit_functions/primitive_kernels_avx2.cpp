@@ -0,0 +1,127 @@
+// The AVX2 kernel of the primitives. The code after the pragmas is compiled for AVX2 without changing the build flags, so only the intrinsics and
+// the lane-generic kernels, which have internal linkage, are included after them: an inline function of another header compiled for AVX2 here could
+// be shared with the translation units that run on any CPU. FMA isn't enabled, so the products and sums are rounded as in the scalar code.
+
+#include "primitive_kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("avx2")
+#endif
+
+#include <immintrin.h>
+
+namespace {
+
+/// 4 doubles in an AVX register.
+struct lane4
+{
+    __m256d v;
+
+    lane4() = default;
+    lane4(__m256d v) : v(v) {}
+    explicit lane4(double a) : v(_mm256_set1_pd(a)) {}
+};
+
+inline lane4 operator+(lane4 a, lane4 b) { return _mm256_add_pd(a.v, b.v); }
+inline lane4 operator-(lane4 a, lane4 b) { return _mm256_sub_pd(a.v, b.v); }
+inline lane4 operator*(lane4 a, lane4 b) { return _mm256_mul_pd(a.v, b.v); }
+inline lane4 operator/(lane4 a, lane4 b) { return _mm256_div_pd(a.v, b.v); }
+inline lane4 operator-(lane4 a) { return _mm256_xor_pd(a.v, _mm256_set1_pd(-0.0)); }
+inline lane4 sqrt(lane4 a) { return _mm256_sqrt_pd(a.v); }
+inline lane4 abs(lane4 a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v); }
+inline __m256d equal_zero(lane4 a) { return _mm256_cmp_pd(a.v, _mm256_setzero_pd(), _CMP_EQ_OQ); }
+inline __m256d less(lane4 a, lane4 b) { return _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ); }
+inline lane4 select(__m256d mask, lane4 a, lane4 b) { return _mm256_blendv_pd(b.v, a.v, mask); }
+
+} // namespace
+
+#include "primitive_lanes.h"
+
+namespace {
+
+/// Computes the points in packs of 4. The parameters follow `primitive_kernel`.
+template <bool Gradient>
+void evaluate_packs(const primitive_params &params, size_t n,
+                    const double *x, const double *y, const double *z,
+                    double *values, double *gx, double *gy, double *gz)
+{
+    const lane_params<lane4> c(params);
+    lane4 value(0.0), grad_x(0.0), grad_y(0.0), grad_z(0.0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        evaluate_lanes<Gradient>(params.kind, c, lane4(_mm256_loadu_pd(x + i)), lane4(_mm256_loadu_pd(y + i)), lane4(_mm256_loadu_pd(z + i)), value, grad_x, grad_y, grad_z);
+        _mm256_storeu_pd(values + i, value.v);
+        if constexpr (Gradient)
+        {
+            _mm256_storeu_pd(gx + i, grad_x.v);
+            _mm256_storeu_pd(gy + i, grad_y.v);
+            _mm256_storeu_pd(gz + i, grad_z.v);
+        }
+    }
+    if (i == n)
+    {
+        return;
+    }
+    // the last pack is padded by copies of its first point
+    const size_t count = n - i;
+    alignas(32) double p[3][4], out[4][4];
+    for (size_t l = 0; l < 4; l++)
+    {
+        const size_t k = i + (l < count ? l : 0);
+        p[0][l] = x[k];
+        p[1][l] = y[k];
+        p[2][l] = z[k];
+    }
+    evaluate_lanes<Gradient>(params.kind, c, lane4(_mm256_load_pd(p[0])), lane4(_mm256_load_pd(p[1])), lane4(_mm256_load_pd(p[2])), value, grad_x, grad_y, grad_z);
+    _mm256_store_pd(out[0], value.v);
+    _mm256_store_pd(out[1], grad_x.v);
+    _mm256_store_pd(out[2], grad_y.v);
+    _mm256_store_pd(out[3], grad_z.v);
+    for (size_t l = 0; l < count; l++)
+    {
+        values[i + l] = out[0][l];
+        if constexpr (Gradient)
+        {
+            gx[i + l] = out[1][l];
+            gy[i + l] = out[2][l];
+            gz[i + l] = out[3][l];
+        }
+    }
+}
+
+} // namespace
+
+void evaluate_primitive_avx2(const primitive_params &params, size_t n,
+                             const double *x, const double *y, const double *z,
+                             double *values, double *gx, double *gy, double *gz)
+{
+    if (gx)
+    {
+        evaluate_packs<true>(params, n, x, y, z, values, gx, gy, gz);
+    }
+    else
+    {
+        evaluate_packs<false>(params, n, x, y, z, values, gx, gy, gz);
+    }
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#else
+
+// `cpu_has_avx2` is false off x86-64, so this is never called.
+void evaluate_primitive_avx2(const primitive_params &params, size_t n,
+                             const double *x, const double *y, const double *z,
+                             double *values, double *gx, double *gy, double *gz)
+{
+    evaluate_primitive_scalar(params, n, x, y, z, values, gx, gy, gz);
+}
+
+#endif
@@ -0,0 +1,164 @@
+#pragma once
+
+// The lane-generic kernels of the primitives, only included by the translation units of the kernels (`primitive_kernels.cpp` and
+// `primitive_kernels_avx2.cpp`). `Lane` is a pack of points, `double` for the scalar fallback, with the arithmetic operators and
+//   sqrt(a), abs(a), equal_zero(a), less(a, b) returning a `Mask`, and select(mask, a, b) choosing `a` in the lanes of the mask.
+// The kernels are in an unnamed namespace, so a translation unit compiled for an instruction set doesn't share their code with another one.
+// Each follows its scalar counterpart in `primitives.h` operation by operation.
+
+#include "primitive_kernels.h"
+
+namespace {
+
+template <typename Lane>
+struct lane_params
+{
+    Lane p0, p1, p2, a0, a1, a2, r, minor;
+
+    explicit lane_params(const primitive_params &params)
+        : p0(params.point[0]), p1(params.point[1]), p2(params.point[2]),
+          a0(params.axis[0]), a1(params.axis[1]), a2(params.axis[2]),
+          r(params.radius), minor(params.minor_radius)
+    {
+    }
+};
+
+/// Computes one pack of points. The gradient is only computed if `Gradient`.
+template <bool Gradient, typename Lane>
+inline void evaluate_lanes(primitive_kind kind, const lane_params<Lane> &c,
+                           const Lane &x, const Lane &y, const Lane &z,
+                           Lane &value, Lane &gx, Lane &gy, Lane &gz)
+{
+    const Lane zero(0.0);
+    switch (kind)
+    {
+    case primitive_kind::plane:
+    {
+        value = c.a0 * (x - c.p0) + c.a1 * (y - c.p1) + c.a2 * (z - c.p2);
+        if constexpr (Gradient)
+        {
+            gx = c.a0;
+            gy = c.a1;
+            gz = c.a2;
+        }
+        break;
+    }
+    case primitive_kind::cylinder:
+    case primitive_kind::cylinder_squared:
+    {
+        const Lane v0 = x - c.p0, v1 = y - c.p1, v2 = z - c.p2;
+        const Lane d = c.a0 * v0 + c.a1 * v1 + c.a2 * v2;
+        const Lane q0 = v0 - d * c.a0, q1 = v1 - d * c.a1, q2 = v2 - d * c.a2;
+        const Lane squared_norm = q0 * q0 + q1 * q1 + q2 * q2;
+        if (kind == primitive_kind::cylinder_squared)
+        {
+            value = c.r * c.r - squared_norm;
+            if constexpr (Gradient)
+            {
+                gx = Lane(-2.0) * q0;
+                gy = Lane(-2.0) * q1;
+                gz = Lane(-2.0) * q2;
+            }
+            break;
+        }
+        const Lane norm = sqrt(squared_norm);
+        value = c.r - norm;
+        if constexpr (Gradient)
+        {
+            const auto axial = equal_zero(norm);
+            gx = select(axial, zero, -q0 / norm);
+            gy = select(axial, zero, -q1 / norm);
+            gz = select(axial, zero, -q2 / norm);
+            value = select(axial, c.r, value);
+        }
+        break;
+    }
+    case primitive_kind::sphere:
+    case primitive_kind::sphere_unsigned:
+    {
+        const Lane v0 = x - c.p0, v1 = y - c.p1, v2 = z - c.p2;
+        const Lane norm = sqrt(v0 * v0 + v1 * v1 + v2 * v2);
+        if constexpr (!Gradient)
+        {
+            value = kind == primitive_kind::sphere ? c.r - norm : -abs(c.r - norm);
+        }
+        else
+        {
+            const auto center = equal_zero(norm);
+            gx = select(center, zero, -v0 / norm);
+            gy = select(center, zero, -v1 / norm);
+            gz = select(center, zero, -v2 / norm);
+            if (kind == primitive_kind::sphere)
+            {
+                value = select(center, c.r, c.r - norm);
+            }
+            else
+            {
+                // the gradient points outwards inside of the sphere
+                const auto inside = less(norm, c.r);
+                gx = select(inside, -gx, gx);
+                gy = select(inside, -gy, gy);
+                gz = select(inside, -gz, gz);
+                value = select(center, -c.r, select(inside, norm - c.r, c.r - norm));
+            }
+        }
+        break;
+    }
+    case primitive_kind::sphere_squared:
+    {
+        if constexpr (!Gradient)
+        {
+            const Lane v0 = c.p0 - x, v1 = c.p1 - y, v2 = c.p2 - z;
+            value = c.r * c.r - (v0 * v0 + v1 * v1 + v2 * v2);
+        }
+        else
+        {
+            gx = Lane(2.0) * (c.p0 - x);
+            gy = Lane(2.0) * (c.p1 - y);
+            gz = Lane(2.0) * (c.p2 - z);
+            value = c.r * c.r - (gx * gx + gy * gy + gz * gz) / Lane(4.0);
+        }
+        break;
+    }
+    case primitive_kind::cone:
+    {
+        // `r` holds the cosine of the apex angle
+        const Lane v0 = x - c.p0, v1 = y - c.p1, v2 = z - c.p2;
+        const Lane norm = sqrt(v0 * v0 + v1 * v1 + v2 * v2);
+        const Lane d = c.a0 * v0 + c.a1 * v1 + c.a2 * v2;
+        value = d - c.r * norm;
+        if constexpr (Gradient)
+        {
+            const auto apex = equal_zero(norm);
+            const Lane factor = c.r / norm;
+            gx = select(apex, zero, c.a0 - v0 * factor);
+            gy = select(apex, zero, c.a1 - v1 * factor);
+            gz = select(apex, zero, c.a2 - v2 * factor);
+            value = select(apex, zero, value);
+        }
+        break;
+    }
+    case primitive_kind::torus:
+    {
+        const Lane v0 = x - c.p0, v1 = y - c.p1, v2 = z - c.p2;
+        const Lane d = c.a0 * v0 + c.a1 * v1 + c.a2 * v2;
+        const Lane para0 = d * c.a0, para1 = d * c.a1, para2 = d * c.a2;
+        const Lane q0 = v0 - para0, q1 = v1 - para1, q2 = v2 - para2;
+        const Lane perp_norm = sqrt(q0 * q0 + q1 * q1 + q2 * q2);
+        const auto axial = equal_zero(perp_norm);
+        const Lane rt_axis = sqrt(para0 * para0 + para1 * para1 + para2 * para2 + c.r * c.r);
+        const Lane rt_off = sqrt(c.r * (c.r - Lane(2.0) * perp_norm) + (v0 * v0 + v1 * v1 + v2 * v2));
+        const Lane rt = select(axial, rt_axis, rt_off);
+        value = c.minor - rt;
+        if constexpr (Gradient)
+        {
+            gx = select(axial, -para0 / rt, (v0 - c.r * q0 / perp_norm) / rt);
+            gy = select(axial, -para1 / rt, (v1 - c.r * q1 / perp_norm) / rt);
+            gz = select(axial, -para2 / rt, (v2 - c.r * q2 / perp_norm) / rt);
+        }
+        break;
+    }
+    }
+}
+
+} // namespace
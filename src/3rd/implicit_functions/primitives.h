@@ -1,11 +1,49 @@
 #pragma once
 
+#include <algorithm>
+#include <type_traits>
+
 #include "ImplicitFunction.h"
+#include "primitive_kernels.h"
 #include "vector_math.h"
 
+/// Base of the analytic primitives. In double precision, their batched evaluation runs the SIMD kernel of `primitive_kernels.h` on the parameters
+/// returned by `kernel_params` of `Function`, with the same results as the scalar evaluation. Otherwise it loops over the scalar evaluation.
+template <typename Function, typename Scalar>
+class PrimitiveFunction : public BatchedImplicitFunction<Function, Scalar>
+{
+public:
+    void evaluate_batch(std::span<const Scalar> x, std::span<const Scalar> y, std::span<const Scalar> z,
+                        std::span<Scalar> values) const override
+    {
+        if constexpr (std::is_same_v<Scalar, double>)
+        {
+            evaluate_primitive(static_cast<const Function &>(*this).kernel_params(), values.size(), x.data(), y.data(), z.data(), values.data());
+        }
+        else
+        {
+            BatchedImplicitFunction<Function, Scalar>::evaluate_batch(x, y, z, values);
+        }
+    }
+
+    void evaluate_gradient_batch(std::span<const Scalar> x, std::span<const Scalar> y, std::span<const Scalar> z,
+                                 std::span<Scalar> values, std::span<Scalar> gx, std::span<Scalar> gy, std::span<Scalar> gz) const override
+    {
+        if constexpr (std::is_same_v<Scalar, double>)
+        {
+            evaluate_primitive(static_cast<const Function &>(*this).kernel_params(), values.size(), x.data(), y.data(), z.data(), values.data(),
+                               gx.data(), gy.data(), gz.data());
+        }
+        else
+        {
+            BatchedImplicitFunction<Function, Scalar>::evaluate_gradient_batch(x, y, z, values, gx, gy, gz);
+        }
+    }
+};
+
 
 template <typename Scalar>
-class ConstantFunction : public ImplicitFunction<Scalar>
+class ConstantFunction : public BatchedImplicitFunction<ConstantFunction<Scalar>, Scalar>
 {
 public:
     explicit ConstantFunction(Scalar value) : value_(value) {}
@@ -23,7 +61,7 @@ private:
 };
 
 template <typename Scalar>
-class PlaneDistanceFunction : public ImplicitFunction<Scalar>
+class PlaneDistanceFunction : public PrimitiveFunction<PlaneDistanceFunction<Scalar>, Scalar>
 {
 public:
     PlaneDistanceFunction(const std::array<Scalar, 3> &point, const std::array<Scalar, 3> &normal)
@@ -45,13 +83,19 @@ public:
         return compute_dot(normal_, {x - point_[0], y - point_[1], z - point_[2]});
     }
 
+    /// The parameters of the batched kernel, see `PrimitiveFunction`.
+    primitive_params kernel_params() const
+    {
+        return {primitive_kind::plane, {point_[0], point_[1], point_[2]}, {normal_[0], normal_[1], normal_[2]}};
+    }
+
 private:
     std::array<Scalar, 3> point_;
     std::array<Scalar, 3> normal_;
 };
 
 template <typename Scalar>
-class CylinderDistanceFunction : public ImplicitFunction<Scalar>
+class CylinderDistanceFunction : public PrimitiveFunction<CylinderDistanceFunction<Scalar>, Scalar>
 {
 public:
     CylinderDistanceFunction(const std::array<Scalar, 3> &axis_point,
@@ -93,6 +137,12 @@ public:
         }
     }
 
+    /// The parameters of the batched kernel, see `PrimitiveFunction`.
+    primitive_params kernel_params() const
+    {
+        return {primitive_kind::cylinder, {axis_point_[0], axis_point_[1], axis_point_[2]}, {axis_unit_vector_[0], axis_unit_vector_[1], axis_unit_vector_[2]}, double(radius_)};
+    }
+
 private:
     std::array<Scalar, 3> axis_point_;
     std::array<Scalar, 3> axis_unit_vector_;
@@ -100,7 +150,7 @@ private:
 };
 
 template <typename Scalar>
-class CylinderSquaredDistanceFunction : public ImplicitFunction<Scalar>
+class CylinderSquaredDistanceFunction : public PrimitiveFunction<CylinderSquaredDistanceFunction<Scalar>, Scalar>
 {
 public:
     CylinderSquaredDistanceFunction(const std::array<Scalar, 3> &axis_point,
@@ -131,6 +181,12 @@ public:
         return radius_ * radius_ - compute_squared_norm(vec_perp);
     }
 
+    /// The parameters of the batched kernel, see `PrimitiveFunction`.
+    primitive_params kernel_params() const
+    {
+        return {primitive_kind::cylinder_squared, {axis_point_[0], axis_point_[1], axis_point_[2]}, {axis_unit_vector_[0], axis_unit_vector_[1], axis_unit_vector_[2]}, double(radius_)};
+    }
+
 private:
     std::array<Scalar, 3> axis_point_;
     std::array<Scalar, 3> axis_unit_vector_;
@@ -138,7 +194,7 @@ private:
 };
 
 template <typename Scalar>
-class SphereDistanceFunction : public ImplicitFunction<Scalar>
+class SphereDistanceFunction : public PrimitiveFunction<SphereDistanceFunction<Scalar>, Scalar>
 {
 public:
     SphereDistanceFunction(const std::array<Scalar, 3> &center, Scalar radius)
@@ -171,13 +227,29 @@ public:
         }
     }
 
+    bool zero_set_bbox(std::array<Scalar, 3> &bbox_min, std::array<Scalar, 3> &bbox_max) const override
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            bbox_min[i] = center_[i] - abs(radius_);
+            bbox_max[i] = center_[i] + abs(radius_);
+        }
+        return true;
+    }
+
+    /// The parameters of the batched kernel, see `PrimitiveFunction`.
+    primitive_params kernel_params() const
+    {
+        return {primitive_kind::sphere, {center_[0], center_[1], center_[2]}, {0, 0, 0}, double(radius_)};
+    }
+
 private:
     std::array<Scalar, 3> center_;
     Scalar radius_;
 };
 
 template <typename Scalar>
-class SphereUnsignedDistanceFunction : public ImplicitFunction<Scalar>
+class SphereUnsignedDistanceFunction : public PrimitiveFunction<SphereUnsignedDistanceFunction<Scalar>, Scalar>
 {
 public:
     SphereUnsignedDistanceFunction(const std::array<Scalar, 3> &center, Scalar radius)
@@ -217,13 +289,29 @@ public:
         }
     }
 
+    bool zero_set_bbox(std::array<Scalar, 3> &bbox_min, std::array<Scalar, 3> &bbox_max) const override
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            bbox_min[i] = center_[i] - abs(radius_);
+            bbox_max[i] = center_[i] + abs(radius_);
+        }
+        return true;
+    }
+
+    /// The parameters of the batched kernel, see `PrimitiveFunction`.
+    primitive_params kernel_params() const
+    {
+        return {primitive_kind::sphere_unsigned, {center_[0], center_[1], center_[2]}, {0, 0, 0}, double(radius_)};
+    }
+
 private:
     std::array<Scalar, 3> center_;
     Scalar radius_;
 };
 
 template <typename Scalar>
-class SphereSquaredDistanceFunction : public ImplicitFunction<Scalar>
+class SphereSquaredDistanceFunction : public PrimitiveFunction<SphereSquaredDistanceFunction<Scalar>, Scalar>
 {
 public:
     SphereSquaredDistanceFunction(const std::array<Scalar, 3> &center, Scalar radius)
@@ -244,13 +332,29 @@ public:
         return radius_ * radius_ - (gx * gx + gy * gy + gz * gz) / 4;
     }
 
+    bool zero_set_bbox(std::array<Scalar, 3> &bbox_min, std::array<Scalar, 3> &bbox_max) const override
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            bbox_min[i] = center_[i] - abs(radius_);
+            bbox_max[i] = center_[i] + abs(radius_);
+        }
+        return true;
+    }
+
+    /// The parameters of the batched kernel, see `PrimitiveFunction`.
+    primitive_params kernel_params() const
+    {
+        return {primitive_kind::sphere_squared, {center_[0], center_[1], center_[2]}, {0, 0, 0}, double(radius_)};
+    }
+
 private:
     std::array<Scalar, 3> center_;
     Scalar radius_;
 };
 
 template <typename Scalar>
-class ConeDistanceFunction : public ImplicitFunction<Scalar>
+class ConeDistanceFunction : public PrimitiveFunction<ConeDistanceFunction<Scalar>, Scalar>
 {
 public:
     ConeDistanceFunction(const std::array<Scalar, 3> &apex,
@@ -287,6 +391,12 @@ public:
         }
     }
 
+    /// The parameters of the batched kernel, see `PrimitiveFunction`.
+    primitive_params kernel_params() const
+    {
+        return {primitive_kind::cone, {apex_[0], apex_[1], apex_[2]}, {axis_unit_vector_[0], axis_unit_vector_[1], axis_unit_vector_[2]}, double(cos(apex_angle_))};
+    }
+
 private:
     std::array<Scalar, 3> apex_;
     std::array<Scalar, 3> axis_unit_vector_;
@@ -294,7 +404,7 @@ private:
 };
 
 template <typename Scalar>
-class TorusDistanceFunction : public ImplicitFunction<Scalar>
+class TorusDistanceFunction : public PrimitiveFunction<TorusDistanceFunction<Scalar>, Scalar>
 {
 public:
     TorusDistanceFunction(const std::array<Scalar, 3> &center,
@@ -349,6 +459,24 @@ public:
         }
     }
 
+    bool zero_set_bbox(std::array<Scalar, 3> &bbox_min, std::array<Scalar, 3> &bbox_max) const override
+    {
+        // the center circle spans major_radius * sqrt(1 - a_i^2) along the ith axis, widened by the tube
+        for (int i = 0; i < 3; i++)
+        {
+            Scalar extent = abs(major_radius_) * sqrt(std::max(Scalar(0), 1 - axis_unit_vector_[i] * axis_unit_vector_[i])) + abs(minor_radius_);
+            bbox_min[i] = center_[i] - extent;
+            bbox_max[i] = center_[i] + extent;
+        }
+        return true;
+    }
+
+    /// The parameters of the batched kernel, see `PrimitiveFunction`.
+    primitive_params kernel_params() const
+    {
+        return {primitive_kind::torus, {center_[0], center_[1], center_[2]}, {axis_unit_vector_[0], axis_unit_vector_[1], axis_unit_vector_[2]}, double(major_radius_), double(minor_radius_)};
+    }
+
 private:
     std::array<Scalar, 3> center_;
     std::array<Scalar, 3> axis_unit_vector_;
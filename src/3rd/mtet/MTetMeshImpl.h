@@ -353,29 +353,7 @@ public:
             TetId adj_tet_id(is_same_tet(adj_tets[0], tet_id) ? adj_tets[1] : adj_tets[0]);
 
             // Update adjacency.
-            if (!is_same_tet(adj_tet_id, invalid_tet_id)) {
-                TetKey adj_tet_key(value_of(adj_tet_id));
-                const MTet& adj_tet = *m_tets.get(adj_tet_key);
-                uint8_t sum = 0; // Local indices in mirror should sum to 6.
-
-                // Update tag to store mirror corner mapping.
-                for (uint8_t i = 0; i < 4; i++) {
-                    for (uint8_t j = 0; j < 4; j++) {
-                        if (tet.vertices[i] == adj_tet.vertices[j]) {
-                            set_mirror_index(adj_tet_key, i, j);
-                            sum += j;
-                        }
-                    }
-                }
-                set_mirror_index(adj_tet_key, local_fid, 6 - sum);
-                assert(
-                    get_mirror_index(adj_tet_key, 0) + get_mirror_index(adj_tet_key, 1) +
-                        get_mirror_index(adj_tet_key, 2) + get_mirror_index(adj_tet_key, 3) ==
-                    6);
-                tet.mirrors[i0] = TetId(adj_tet_key);
-            } else {
-                tet.mirrors[i0] = invalid_tet_id;
-            }
+            link_mirror(tet, local_fid, adj_tet_id);
         };
 
         /**
@@ -399,6 +377,26 @@ public:
         });
     }
 
+    void initialize_connectivity(
+        std::span<const TetId> tet_ids,
+        std::span<const std::array<TetId, 4>> adjacency)
+    {
+        assert(tet_ids.size() == adjacency.size());
+        assert(tet_ids.size() == m_tets.size());
+        const size_t n = tet_ids.size();
+
+        // The adjacency is given, so only the mirror corner mapping needs to be computed.
+        dr::parallel_for(dr::blocked_range<size_t>(0, n, 256), [&](dr::blocked_range<size_t> range) {
+            for (auto i = range.begin(); i != range.end(); ++i) {
+                assert(has_tet(tet_ids[i]));
+                MTet& tet = *m_tets.get(TetKey(value_of(tet_ids[i])));
+                for (uint8_t local_fid = 0; local_fid < 4; local_fid++) {
+                    link_mirror(tet, local_fid, adjacency[i][local_fid]);
+                }
+            }
+        });
+    }
+
 public:
     bool has_vertex(VertexId vertex_id) const
     {
@@ -921,6 +919,43 @@ public:
     const auto& get_tets() const { return m_tets; }
 
 private:
+    /**
+     * Link a tet to its adjacent tet across a local face.
+     *
+     * @param tet          The current tet.
+     * @param local_fid    The local face id of the current tet, which is shared with the adjcent
+     *                     tet.
+     * @param adj_tet_id   The id of the adjacent tet, or `invalid_tet_id` for a boundary face.
+     *
+     * The mirror corner mapping is stored in the tag bits of the key saved in `tet.mirrors`.
+     */
+    void link_mirror(MTet& tet, uint8_t local_fid, TetId adj_tet_id) const
+    {
+        if (!is_same_tet(adj_tet_id, invalid_tet_id)) {
+            TetKey adj_tet_key(value_of(adj_tet_id));
+            const MTet& adj_tet = *m_tets.get(adj_tet_key);
+            uint8_t sum = 0; // Local indices in mirror should sum to 6.
+
+            // Update tag to store mirror corner mapping.
+            for (uint8_t i = 0; i < 4; i++) {
+                for (uint8_t j = 0; j < 4; j++) {
+                    if (tet.vertices[i] == adj_tet.vertices[j]) {
+                        set_mirror_index(adj_tet_key, i, j);
+                        sum += j;
+                    }
+                }
+            }
+            set_mirror_index(adj_tet_key, local_fid, 6 - sum);
+            assert(
+                get_mirror_index(adj_tet_key, 0) + get_mirror_index(adj_tet_key, 1) +
+                    get_mirror_index(adj_tet_key, 2) + get_mirror_index(adj_tet_key, 3) ==
+                6);
+            tet.mirrors[local_fid] = TetId(adj_tet_key);
+        } else {
+            tet.mirrors[local_fid] = invalid_tet_id;
+        }
+    }
+
     /**
      * Get the next tet adjacent to the current tet around a given edge.
      *
@@ -36,6 +36,13 @@ void MTetMesh::initialize_connectivity()
     m_impl->initialize_connectivity();
 }
 
+void MTetMesh::initialize_connectivity(
+    std::span<const TetId> tet_ids,
+    std::span<const std::array<TetId, 4>> adjacency)
+{
+    m_impl->initialize_connectivity(tet_ids, adjacency);
+}
+
 bool MTetMesh::has_vertex(VertexId vertex_id) const
 {
     return m_impl->has_vertex(vertex_id);
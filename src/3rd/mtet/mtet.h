@@ -38,6 +38,17 @@ public:
     TetId add_tet(VertexId v0, VertexId v1, VertexId v2, VertexId v3);
     void initialize_connectivity();
 
+    /**
+     * Initialize connectivity from a known tet adjacency instead of matching shared faces.
+     *
+     * @param tet_ids    The ids of all tets in the mesh.
+     * @param adjacency  `adjacency[i][j]` is the tet across the face opposite to local vertex `j`
+     *                   of `tet_ids[i]`, or the default `TetId()` for a boundary face.
+     */
+    void initialize_connectivity(
+        std::span<const TetId> tet_ids,
+        std::span<const std::array<TetId, 4>> adjacency);
+
 public:
     bool has_vertex(VertexId vertex_id) const;
     bool has_tet(TetId tet_id) const;
@@ -5,6 +5,9 @@
 //  Created by Yiwen Ju on 8/1/24.
 //
 
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
 #include "csg.h"
 
 bool load_csgTree(const std::string filename, llvm_vecsmall::SmallVector<csg_unit, 20>& tree){
@@ -98,3 +101,214 @@ std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> iterTree(c
     }
     return std::pair(interval, af);
 }
+
+csg_program::csg_program(const llvm_vecsmall::SmallVector<csg_unit, 20> &tree)
+{
+    const int n_units = int(tree.size());
+    if (n_units == 0){
+        throw std::runtime_error("ERROR: empty CSG tree");
+    }
+    auto num_children = [&](int node){ return tree[node - 1].operation == Negation ? 1 : 2; };
+    for (int node = 1; node <= n_units; node++){
+        const csg_unit &unit = tree[node - 1];
+        if (unit.operation != Intersection && unit.operation != Union && unit.operation != Negation){
+            throw std::runtime_error("ERROR: not a valid CSG operation");
+        }
+        for (int i = 0; i < num_children(node); i++){
+            if (unit.elements[i] > n_units){
+                throw std::runtime_error("ERROR: the CSG tree refers to a missing unit");
+            }
+            if (unit.elements[i] <= 0 && -unit.elements[i] - 1 >= 32){
+                throw std::runtime_error("ERROR: the CSG program supports up to 32 functions");
+            }
+        }
+    }
+    
+    /// the stack entries needed by the subtree of each unit (its Ershov number), computed in postorder with an explicit stack
+    std::vector<int> need(n_units + 1, 0);
+    /// 0: not visited, 1: on the stack, 2: done
+    std::vector<char> state(n_units + 1, 0);
+    auto element_need = [&](int element){ return element > 0 ? need[element] : 1; };
+    std::vector<int> stack = {1};
+    while (!stack.empty()){
+        const int node = stack.back();
+        const csg_unit &unit = tree[node - 1];
+        if (state[node] == 0){
+            state[node] = 1;
+            for (int i = 0; i < num_children(node); i++){
+                const int child = unit.elements[i];
+                if (child > 0 && state[child] == 1){
+                    throw std::runtime_error("ERROR: the CSG tree has a cycle");
+                }
+                if (child > 0 && state[child] == 0){
+                    stack.push_back(child);
+                }
+            }
+            continue;
+        }
+        stack.pop_back();
+        if (state[node] == 2){
+            continue;
+        }
+        state[node] = 2;
+        if (unit.operation == Negation){
+            need[node] = element_need(unit.elements[0]);
+        } else {
+            const int need0 = element_need(unit.elements[0]), need1 = element_need(unit.elements[1]);
+            need[node] = need0 == need1 ? need0 + 1 : std::max(need0, need1);
+        }
+    }
+    if (size_t(need[1]) > max_stack){
+        throw std::runtime_error("ERROR: the CSG tree is too deep");
+    }
+    
+    /// emit the program, a unit's operation after its children's code; the `bool` marks a unit whose children are emitted
+    std::vector<std::pair<int, bool>> emit = {{1, false}};
+    while (!emit.empty()){
+        auto [element, expanded] = emit.back();
+        emit.pop_back();
+        if (element <= 0){
+            m_code.push_back({Function, -element - 1});
+            m_functions |= uint32_t(1) << (-element - 1);
+            continue;
+        }
+        const csg_unit &unit = tree[element - 1];
+        if (expanded){
+            m_code.push_back({unit.operation, 0});
+            continue;
+        }
+        emit.push_back({element, true});
+        if (unit.operation == Negation){
+            emit.push_back({unit.elements[0], false});
+        } else if (element_need(unit.elements[1]) > element_need(unit.elements[0])){
+            emit.push_back({unit.elements[0], false});
+            emit.push_back({unit.elements[1], false});
+        } else {
+            emit.push_back({unit.elements[1], false});
+            emit.push_back({unit.elements[0], false});
+        }
+    }
+}
+
+std::pair<std::array<double, 2>, uint32_t> csg_program::evaluate(std::span<const std::array<double, 2>> funcInt) const
+{
+    std::array<std::array<double, 2>, max_stack> stack_int;
+    std::array<uint32_t, max_stack> stack_active;
+    size_t top = 0;
+    for (const instruction &ins : m_code){
+        switch (ins.operation){
+            case Function:
+                stack_int[top] = funcInt[ins.function];
+                stack_active[top] = stack_int[top][0] * stack_int[top][1] > 0 ? 0 : uint32_t(1) << ins.function;
+                top++;
+                break;
+            case Constant:
+                stack_int[top] = {double(ins.function), double(ins.function)};
+                stack_active[top] = 0;
+                top++;
+                break;
+            case Negation:
+            {
+                std::array<double, 2> &interval = stack_int[top - 1];
+                interval = {std::min(-interval[0], -interval[1]), std::max(-interval[0], -interval[1])};
+                if (!(interval[0] * interval[1] <= 0)){
+                    stack_active[top - 1] = 0;
+                }
+                break;
+            }
+            default:
+            {
+                top--;
+                std::array<double, 2> &interval = stack_int[top - 1];
+                const std::array<double, 2> &second = stack_int[top];
+                if (ins.operation == Intersection){
+                    interval = {std::max(interval[0], second[0]), std::max(interval[1], second[1])};
+                } else {
+                    interval = {std::min(interval[0], second[0]), std::min(interval[1], second[1])};
+                }
+                stack_active[top - 1] = interval[0] * interval[1] <= 0 ? stack_active[top - 1] | stack_active[top] : 0;
+                break;
+            }
+        }
+    }
+    return {stack_int[0], stack_active[0]};
+}
+
+csg_program csg_program::specialize(std::span<const std::array<double, 2>> funcInt) const
+{
+    csg_program program;
+    std::array<std::array<double, 2>, max_stack> stack_int;
+    /// the index of the first instruction of each stack entry's code in the specialized program
+    std::array<size_t, max_stack> stack_begin;
+    size_t top = 0;
+    for (const instruction &ins : m_code){
+        switch (ins.operation){
+            case Function:
+            case Constant:
+                stack_int[top] = ins.operation == Function ? funcInt[ins.function] : std::array<double, 2>{double(ins.function), double(ins.function)};
+                stack_begin[top] = program.m_code.size();
+                program.m_code.push_back(ins);
+                top++;
+                break;
+            case Negation:
+            {
+                std::array<double, 2> &interval = stack_int[top - 1];
+                interval = {std::min(-interval[0], -interval[1]), std::max(-interval[0], -interval[1])};
+                program.m_code.push_back(ins);
+                break;
+            }
+            default:
+            {
+                top--;
+                std::array<double, 2> &interval = stack_int[top - 1];
+                const std::array<double, 2> &second = stack_int[top];
+                if (ins.operation == Intersection){
+                    interval = {std::max(interval[0], second[0]), std::max(interval[1], second[1])};
+                } else {
+                    interval = {std::min(interval[0], second[0]), std::min(interval[1], second[1])};
+                }
+                /// if the result still contains zero, a constant operand is inside for an intersection or outside for a union,
+                /// and the result has the signs and the active functions of the other operand
+                if (program.m_code[stack_begin[top]].operation == Constant){
+                    program.m_code.pop_back();
+                } else if (program.m_code[stack_begin[top - 1]].operation == Constant){
+                    program.m_code.erase(program.m_code.begin() + stack_begin[top - 1]);
+                } else {
+                    program.m_code.push_back(ins);
+                }
+                break;
+            }
+        }
+        /// the code of a subtree of one sign collapses into a constant
+        const std::array<double, 2> &interval = stack_int[top - 1];
+        if (interval[0] * interval[1] > 0){
+            program.m_code.resize(stack_begin[top - 1]);
+            program.m_code.push_back({Constant, interval[0] > 0 ? 1 : -1});
+        }
+    }
+    for (const instruction &ins : program.m_code){
+        if (ins.operation == Function){
+            program.m_functions |= uint32_t(1) << ins.function;
+        }
+    }
+    return program;
+}
+
+std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> csg_program::operator()(const llvm_vecsmall::SmallVector<std::array<double, 2>, 20> &funcInt) const
+{
+    auto [interval, active] = evaluate(funcInt);
+    llvm_vecsmall::SmallVector<int, 20> af(funcInt.size(), 1);
+    for (size_t funcIter = 0; funcIter < funcInt.size(); funcIter++){
+        af[funcIter] = (active >> funcIter) & 1 ? 0 : 1;
+    }
+    return std::pair(interval, af);
+}
+
+bool load_csgTree(const std::string filename, csg_program& program){
+    llvm_vecsmall::SmallVector<csg_unit, 20> tree;
+    if (!load_csgTree(filename, tree)){
+        return false;
+    }
+    program = csg_program(tree);
+    return true;
+}
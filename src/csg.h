@@ -7,13 +7,19 @@
 
 #ifndef csg_h
 #define csg_h
+#include <array>
+#include <cstdint>
+#include <span>
+#include <utility>
 #include "adaptive_grid_gen.h"
 
 /// Enums for CSG boolean operations
 enum csg_operations{
     Intersection,
     Union,
-    Negation
+    Negation,
+    Function, /* only in `csg_program`: pushes the interval of a function */
+    Constant /* only in `csg_program`: pushes a subtree of one sign, see `csg_program::specialize` */
 };
 
 ///Defines the enumeration of CSG operations. In the data structure, Intersection is 0, Union is 1, and Negation is 2.
@@ -38,4 +44,135 @@ bool load_csgTree(const std::string filename, llvm_vecsmall::SmallVector<csg_uni
 ///@param[out] std::pair
 std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> iterTree(const llvm_vecsmall::SmallVector<csg_unit, 20>csgTree,const int curNode,const llvm_vecsmall::SmallVector<std::array<double , 2>, 20> funcInt);
 
+/// A CSG tree compiled into a flat program in postorder, which evaluates the same intervals and active functions as `iterTree`
+/// on a fixed-size stack, without recursion or heap allocation. The active functions are stored as bitsets, one bit per function.
+/// The deeper child of a union or an intersection is evaluated first, so the stack holds at most one entry more than the
+/// log of the number of leaves.
+///
+/// It's also callable as the `csg_func` of `gridRefine`, and the criteria then evaluate the program directly.
+class csg_program
+{
+public:
+    /// One step of the program: an operation on the top entries of the stack, or pushing the interval of `function`.
+    /// A `Constant` pushes the interval {`function`, `function`} with no active functions, where `function` is 1 or -1.
+    struct instruction {
+        int operation;
+        int function;
+    };
+    /// The capacity of the evaluation stack.
+    static constexpr size_t max_stack = 64;
+    
+    csg_program() = default;
+    /// Compiles a tree in the format of `load_csgTree`, whose root is the first unit. It throws a `std::runtime_error` if the tree
+    /// is malformed or refers to more than 32 functions.
+    explicit csg_program(const llvm_vecsmall::SmallVector<csg_unit, 20> &tree);
+    
+    /// Evaluates the tree on the intervals of all functions.
+    ///
+    /// @param[in] funcInt          The intervals of all the functions
+    ///
+    /// @return         The interval of the tree, and the bitset of active functions as in `iterTree`.
+    std::pair<std::array<double, 2>, uint32_t> evaluate(std::span<const std::array<double, 2>> funcInt) const;
+    
+    /// Evaluates the tree on `W` sets of intervals at once, e.g., on the tets of a batch. The `l`th lane of `low[f]` and `high[f]`
+    /// is the interval of the `f`th function in the `l`th set.
+    ///
+    /// @param[out] result_low, result_high         The intervals of the tree in each lane.
+    /// @param[out] active          The bitsets of active functions in each lane.
+    template <size_t W>
+    void evaluate_batch(std::span<const std::array<double, W>> low,
+                        std::span<const std::array<double, W>> high,
+                        std::array<double, W> &result_low,
+                        std::array<double, W> &result_high,
+                        std::array<uint32_t, W> &active) const;
+    
+    /// The same as `iterTree(tree, 1, funcInt)`, so the program can be used as `csg_func`. The inactive functions are marked by 1.
+    std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> operator()(const llvm_vecsmall::SmallVector<std::array<double, 2>, 20> &funcInt) const;
+    
+    /// Specializes the program to a region of space, e.g., a tet, where the functions take values in `funcInt`.
+    /// Every subtree whose interval doesn't contain zero is replaced by a `Constant` of its sign, and an operand that can't change
+    /// the sign of its union or intersection is dropped, so only the part of the tree that may still change is left.
+    /// Union, intersection and negation commute with the sign of the intervals, so on intervals within `funcInt`, the specialized program
+    /// evaluates the same active functions and intervals of the same signs as this program.
+    ///
+    /// @param[in] funcInt          The intervals of all the functions in the region
+    ///
+    /// @return         The specialized program.
+    csg_program specialize(std::span<const std::array<double, 2>> funcInt) const;
+    
+    /// The instructions in the order of evaluation.
+    std::span<const instruction> code() const { return m_code; }
+    
+    /// The bitset of functions the program refers to. The intervals of the other functions are never read.
+    uint32_t functions() const { return m_functions; }
+    
+private:
+    llvm_vecsmall::SmallVector<instruction, 40> m_code;
+    uint32_t m_functions = 0;
+};
+
+///load the csg file and compile it into a `csg_program`
+///
+///@param[in] filename          The name of the input CSG tree
+///@param[out] program          The compiled program
+///
+bool load_csgTree(const std::string filename, csg_program& program);
+
+template <size_t W>
+void csg_program::evaluate_batch(std::span<const std::array<double, W>> low,
+                                 std::span<const std::array<double, W>> high,
+                                 std::array<double, W> &result_low,
+                                 std::array<double, W> &result_high,
+                                 std::array<uint32_t, W> &active) const
+{
+    std::array<std::array<double, W>, max_stack> stack_low, stack_high;
+    std::array<std::array<uint32_t, W>, max_stack> stack_active;
+    size_t top = 0;
+    for (const instruction &ins : m_code){
+        switch (ins.operation){
+            case Function:
+                stack_low[top] = low[ins.function];
+                stack_high[top] = high[ins.function];
+                for (size_t l = 0; l < W; l++){
+                    stack_active[top][l] = stack_low[top][l] * stack_high[top][l] > 0 ? 0 : uint32_t(1) << ins.function;
+                }
+                top++;
+                break;
+            case Constant:
+                stack_low[top].fill(double(ins.function));
+                stack_high[top].fill(double(ins.function));
+                stack_active[top].fill(0);
+                top++;
+                break;
+            case Negation:
+                for (size_t l = 0; l < W; l++){
+                    double x0 = -stack_low[top - 1][l], x1 = -stack_high[top - 1][l];
+                    stack_low[top - 1][l] = std::min(x0, x1);
+                    stack_high[top - 1][l] = std::max(x0, x1);
+                    if (!(stack_low[top - 1][l] * stack_high[top - 1][l] <= 0)){
+                        stack_active[top - 1][l] = 0;
+                    }
+                }
+                break;
+            default:
+                top--;
+                for (size_t l = 0; l < W; l++){
+                    double &x0 = stack_low[top - 1][l], &x1 = stack_high[top - 1][l];
+                    if (ins.operation == Intersection){
+                        x0 = std::max(x0, stack_low[top][l]);
+                        x1 = std::max(x1, stack_high[top][l]);
+                    } else {
+                        x0 = std::min(x0, stack_low[top][l]);
+                        x1 = std::min(x1, stack_high[top][l]);
+                    }
+                    stack_active[top - 1][l] = x0 * x1 <= 0 ? stack_active[top - 1][l] | stack_active[top][l] : 0;
+                }
+                break;
+        }
+    }
+    result_low = stack_low[0];
+    result_high = stack_high[0];
+    active = stack_active[0];
+}
+
 #endif /* csg_h */
@@ -0,0 +1,128 @@
+//
+//  function_index.cpp
+//  adaptive_mesh_refinement
+//
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include "function_index.h"
+
+function_index::function_index(const std::vector<std::unique_ptr<ImplicitFunction<double>>> &functions) : m_functions(functions)
+{
+    if (functions.size() > 32){
+        throw std::runtime_error("ERROR: the function index supports up to 32 functions");
+    }
+    const size_t funcNum = functions.size();
+    m_all = funcNum == 32 ? ~uint32_t(0) : (uint32_t(1) << funcNum) - 1;
+    m_outside_sign.assign(funcNum, 1.0);
+    std::vector<std::array<double, 3>> box_min(funcNum), box_max(funcNum);
+    std::vector<uint32_t> bounded;
+    for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+        if (!functions[funcIter]->zero_set_bbox(box_min[funcIter], box_max[funcIter])){
+            m_unbounded |= uint32_t(1) << funcIter;
+            continue;
+        }
+        // widen the box against the rounding of its bounds, then sample the sign at a point outside of it
+        std::array<double, 3> outside;
+        for (int i = 0; i < 3; i++){
+            double margin = 1e-9 * (std::abs(box_min[funcIter][i]) + std::abs(box_max[funcIter][i]) + 1);
+            box_min[funcIter][i] -= margin;
+            box_max[funcIter][i] += margin;
+            outside[i] = box_max[funcIter][i] + (box_max[funcIter][i] - box_min[funcIter][i]) + 1;
+        }
+        double value = functions[funcIter]->evaluate(outside[0], outside[1], outside[2]);
+        if (!(value != 0) || !std::isfinite(value)){
+            m_unbounded |= uint32_t(1) << funcIter;
+            continue;
+        }
+        m_outside_sign[funcIter] = value > 0 ? 1.0 : -1.0;
+        bounded.push_back(uint32_t(funcIter));
+    }
+    if (bounded.empty()){
+        return;
+    }
+
+    // top-down build: split the functions of a node at the median of their box centers along the longest side
+    m_nodes.reserve(2 * bounded.size() - 1);
+    m_nodes.emplace_back();
+    struct build_task { uint32_t node, begin, end; };
+    std::vector<build_task> stack = {{0, 0, uint32_t(bounded.size())}};
+    while (!stack.empty()){
+        build_task task = stack.back();
+        stack.pop_back();
+        node &n = m_nodes[task.node];
+        n.bbox_min.fill(std::numeric_limits<double>::max());
+        n.bbox_max.fill(std::numeric_limits<double>::lowest());
+        std::array<double, 3> center_min = n.bbox_min, center_max = n.bbox_max;
+        for (uint32_t i = task.begin; i < task.end; i++){
+            for (int d = 0; d < 3; d++){
+                n.bbox_min[d] = std::min(n.bbox_min[d], box_min[bounded[i]][d]);
+                n.bbox_max[d] = std::max(n.bbox_max[d], box_max[bounded[i]][d]);
+                double center = box_min[bounded[i]][d] + box_max[bounded[i]][d];
+                center_min[d] = std::min(center_min[d], center);
+                center_max[d] = std::max(center_max[d], center);
+            }
+        }
+        if (task.end - task.begin == 1){
+            n.func = int32_t(bounded[task.begin]);
+            continue;
+        }
+        int axis = 0;
+        for (int d = 1; d < 3; d++){
+            if (center_max[d] - center_min[d] > center_max[axis] - center_min[axis]){
+                axis = d;
+            }
+        }
+        uint32_t mid = (task.begin + task.end) / 2;
+        std::nth_element(bounded.begin() + task.begin, bounded.begin() + mid, bounded.begin() + task.end, [&](uint32_t f0, uint32_t f1)
+                         { return box_min[f0][axis] + box_max[f0][axis] < box_min[f1][axis] + box_max[f1][axis]; });
+        n.first = uint32_t(m_nodes.size());
+        m_nodes.emplace_back();
+        m_nodes.emplace_back();
+        stack.push_back({m_nodes[task.node].first, task.begin, mid});
+        stack.push_back({m_nodes[task.node].first + 1, mid, task.end});
+    }
+}
+
+uint32_t function_index::query(const std::array<double, 3> &bbox_min, const std::array<double, 3> &bbox_max) const
+{
+    uint32_t mask = m_unbounded;
+    if (m_nodes.empty()){
+        return mask;
+    }
+    std::array<uint32_t, 64> stack;
+    size_t top = 0;
+    stack[top++] = 0;
+    while (top > 0){
+        const node &n = m_nodes[stack[--top]];
+        if (n.bbox_min[0] > bbox_max[0] || n.bbox_max[0] < bbox_min[0] ||
+            n.bbox_min[1] > bbox_max[1] || n.bbox_max[1] < bbox_min[1] ||
+            n.bbox_min[2] > bbox_max[2] || n.bbox_max[2] < bbox_min[2]){
+            continue;
+        }
+        if (n.func >= 0){
+            mask |= uint32_t(1) << n.func;
+        } else {
+            stack[top++] = n.first;
+            stack[top++] = n.first + 1;
+        }
+    }
+    return mask;
+}
+
+llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> function_index::evaluate(std::span<const double, 3> data, uint32_t mask) const
+{
+    llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> vertex_eval(m_functions.size());
+    for (size_t funcIter = 0; funcIter < m_functions.size(); funcIter++){
+        if ((mask >> funcIter) & 1){
+            Eigen::RowVector4d eval;
+            eval[0] = m_functions[funcIter]->evaluate_gradient(data[0], data[1], data[2], eval[1], eval[2], eval[3]);
+            vertex_eval[funcIter] = eval;
+        } else {
+            vertex_eval[funcIter] = placeholder(funcIter);
+        }
+    }
+    return vertex_eval;
+}
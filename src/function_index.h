@@ -0,0 +1,71 @@
+//
+//  function_index.h
+//  adaptive_mesh_refinement
+//
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+#include "SmallVector.h"
+#include "3rd/implicit_functions/ImplicitFunction.h"
+#include <Eigen/Core>
+
+/// A bounding volume hierarchy over the zero sets of the implicit functions. The zero set of a function with a bounded zero set
+/// (see `ImplicitFunction::zero_set_bbox`) can't cross a region outside its box, and the function has the same sign everywhere outside the box.
+/// Such a function doesn't need to be evaluated or checked on a tet whose bounding box misses its box.
+/// Functions with an unbounded zero set are never culled. It supports up to 32 functions, one bit each in a mask.
+class function_index
+{
+public:
+    /// Builds the hierarchy. The functions are kept by reference and have to outlive the index.
+    ///
+    /// @param[in] functions            The implicit functions.
+    function_index(const std::vector<std::unique_ptr<ImplicitFunction<double>>> &functions);
+
+    /// The number of functions.
+    size_t size() const { return m_functions.size(); }
+
+    /// The mask of all the functions.
+    uint32_t all() const { return m_all; }
+
+    /// Finds the functions whose zero set may cross the box.
+    ///
+    /// @param[in] bbox_min, bbox_max           The box.
+    ///
+    /// @return         A bitmask whose `f`th bit represents whether the zero set of the `f`th function may cross the box.
+    uint32_t query(const std::array<double, 3> &bbox_min, const std::array<double, 3> &bbox_max) const;
+
+    /// The value and the gradient standing in for a culled function. It's the sign of the function outside its box with a zero gradient,
+    /// so a tet whose values of the function are all placeholders passes none of the checks of that function.
+    ///
+    /// @param[in] funcIter         The index of the function.
+    Eigen::RowVector4d placeholder(size_t funcIter) const { return {m_outside_sign[funcIter], 0, 0, 0}; }
+
+    /// Evaluates the functions of `mask` at a point, and fills the others with their `placeholder`.
+    ///
+    /// @param[in] data         The 3D coordinate.
+    /// @param[in] mask         The functions to evaluate.
+    ///
+    /// @return         The values and gradients of all the functions, in the layout of the `func` argument of `gridRefine`.
+    llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> evaluate(std::span<const double, 3> data, uint32_t mask) const;
+
+private:
+    /// A node of the hierarchy. A leaf holds one function; an inner node's children are stored at `first` and `first + 1`.
+    struct node
+    {
+        std::array<double, 3> bbox_min;
+        std::array<double, 3> bbox_max;
+        uint32_t first;
+        int32_t func = -1;
+    };
+
+    const std::vector<std::unique_ptr<ImplicitFunction<double>>> &m_functions;
+    std::vector<node> m_nodes;
+    std::vector<double> m_outside_sign;
+    /// functions without a bounded zero set
+    uint32_t m_unbounded = 0;
+    uint32_t m_all = 0;
+};
@@ -4,9 +4,22 @@
 
 
 #include "grid_mesh.h"
+#include "3rd/nanothread/nanothread.h"
+
+namespace dr = drjit;
 
 namespace grid_mesh {
 
+    // The 6 tets of a Kuhn cell are the monotone paths along its main diagonal.
+    // Path `t` walks from the diagonal start along axes kuhn_paths[t][0], [1] and [2].
+    constexpr std::array<std::array<size_t, 3>, 6> kuhn_paths = {{
+        {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}}};
+    // sign of the axis permutation of each path
+    constexpr std::array<int, 6> kuhn_path_sign = {1, -1, -1, 1, 1, -1};
+    // the path with its first (resp. last) two axes swapped, i.e. the neighbor in the same cell
+    constexpr std::array<size_t, 6> kuhn_swap_first = {2, 4, 0, 5, 1, 3};
+    constexpr std::array<size_t, 6> kuhn_swap_last = {1, 0, 3, 2, 5, 4};
+
     mtet::MTetMesh generate_tet_mesh(const std::array<size_t, 3> &resolution,
                                      const std::array<double, 3> &bbox_min,
                                      const std::array<double, 3> &bbox_max,
@@ -97,11 +110,137 @@ namespace grid_mesh {
         return mesh;
     }
 
+    mtet::MTetMesh generate_kuhn_lattice(const std::array<size_t, 3> &resolution,
+                                     const std::array<double, 3> &bbox_min,
+                                     const std::array<double, 3> &bbox_max) {
+        assert(resolution[0] > 0 && resolution[1] > 0 && resolution[2] > 0);
+        const size_t N0 = resolution[0] + 1;
+        const size_t N1 = resolution[1] + 1;
+        const size_t N2 = resolution[2] + 1;
+        const size_t num_cells = resolution[0] * resolution[1] * resolution[2];
+        std::vector<std::array<double, 3>> pts(N0 * N1 * N2);
+        std::vector<std::array<size_t, 4>> tets(num_cells * 6);
+        auto compute_coordinate = [&](double t, size_t i) {
+            return t * (bbox_max[i] - bbox_min[i]) + bbox_min[i];
+        };
+        // vertices
+        dr::parallel_for(dr::blocked_range<size_t>(0, N0, 1), [&](dr::blocked_range<size_t> range) {
+            for (size_t i : range) {
+                double x = compute_coordinate(double(i) / double(N0 - 1), 0);
+                for (size_t j = 0; j < N1; j++) {
+                    double y = compute_coordinate(double(j) / double(N1 - 1), 1);
+                    for (size_t k = 0; k < N2; k++) {
+                        double z = compute_coordinate(double(k) / double(N2 - 1), 2);
+                        pts[i * N1 * N2 + j * N2 + k] = {x, y, z};
+                    }
+                }
+            }
+        });
+        // The diagonal of cell (i, j, k) starts at the local corner given by the parity of
+        // (i, j, k). A path tet is positively oriented iff the product of its step directions
+        // and its permutation sign is positive; otherwise its last two vertices are swapped.
+        auto locate_cell = [&](size_t c) {
+            const size_t k = c % resolution[2];
+            const size_t j = (c / resolution[2]) % resolution[1];
+            const size_t i = c / (resolution[1] * resolution[2]);
+            return std::array<size_t, 6>{i, j, k, i % 2, j % 2, k % 2};
+        };
+        auto is_flipped = [](const std::array<size_t, 6> &cell, size_t t) {
+            const int sign = (cell[3] + cell[4] + cell[5]) % 2 == 0 ? 1 : -1;
+            return sign * kuhn_path_sign[t] < 0;
+        };
+        // local slot of the path vertex `q`
+        auto slot_of = [](size_t q, bool flipped) {
+            return flipped && q >= 2 ? 5 - q : q;
+        };
+        // tets
+        dr::parallel_for(dr::blocked_range<size_t>(0, num_cells, 256), [&](dr::blocked_range<size_t> range) {
+            for (size_t c : range) {
+                const auto cell = locate_cell(c);
+                for (size_t t = 0; t < 6; t++) {
+                    std::array<size_t, 3> corner = {cell[3], cell[4], cell[5]};
+                    const bool flipped = is_flipped(cell, t);
+                    auto &tet = tets[c * 6 + t];
+                    for (size_t q = 0; q < 4; q++) {
+                        if (q > 0) {
+                            corner[kuhn_paths[t][q - 1]] ^= 1;
+                        }
+                        tet[slot_of(q, flipped)] = (cell[0] + corner[0]) * N1 * N2 +
+                                                   (cell[1] + corner[1]) * N2 + cell[2] + corner[2];
+                    }
+                }
+            }
+        });
+        // build mesh
+        mtet::MTetMesh mesh;
+        std::vector<mtet::VertexId> vertex_ids;
+        vertex_ids.reserve(pts.size());
+        for (auto &v: pts) {
+            vertex_ids.push_back(mesh.add_vertex(v[0], v[1], v[2]));
+        }
+        std::vector<mtet::TetId> tet_ids;
+        tet_ids.reserve(tets.size());
+        for (auto &t: tets) {
+            tet_ids.push_back(mesh.add_tet(vertex_ids[t[0]], vertex_ids[t[1]], vertex_ids[t[2]], vertex_ids[t[3]]));
+        }
+        // adjacency: the faces opposite to the two inner path vertices are shared with the
+        // paths of the same cell that swap the adjacent axes. The faces opposite to the diagonal
+        // ends lie on the cell boundary and are shared with the same path of the mirrored
+        // neighbor cell along the first (resp. last) axis of the path.
+        std::vector<std::array<mtet::TetId, 4>> adjacency(tets.size());
+        auto neighbor_cell = [&](const std::array<size_t, 6> &cell, size_t axis, bool forward) {
+            std::array<size_t, 3> index = {cell[0], cell[1], cell[2]};
+            if (forward) {
+                if (index[axis] + 1 == resolution[axis]) return num_cells;
+                index[axis]++;
+            } else {
+                if (index[axis] == 0) return num_cells;
+                index[axis]--;
+            }
+            return (index[0] * resolution[1] + index[1]) * resolution[2] + index[2];
+        };
+        dr::parallel_for(dr::blocked_range<size_t>(0, num_cells, 256), [&](dr::blocked_range<size_t> range) {
+            for (size_t c : range) {
+                const auto cell = locate_cell(c);
+                for (size_t t = 0; t < 6; t++) {
+                    const bool flipped = is_flipped(cell, t);
+                    const size_t first_axis = kuhn_paths[t][0];
+                    const size_t last_axis = kuhn_paths[t][2];
+                    const size_t c0 = neighbor_cell(cell, first_axis, cell[3 + first_axis] == 0);
+                    const size_t c3 = neighbor_cell(cell, last_axis, cell[3 + last_axis] == 1);
+                    auto &adj = adjacency[c * 6 + t];
+                    adj[slot_of(0, flipped)] = c0 < num_cells ? tet_ids[c0 * 6 + t] : mtet::TetId();
+                    adj[slot_of(1, flipped)] = tet_ids[c * 6 + kuhn_swap_first[t]];
+                    adj[slot_of(2, flipped)] = tet_ids[c * 6 + kuhn_swap_last[t]];
+                    adj[slot_of(3, flipped)] = c3 < num_cells ? tet_ids[c3 * 6 + t] : mtet::TetId();
+                }
+            }
+        });
+        mesh.initialize_connectivity(tet_ids, adjacency);
+        return mesh;
+    }
+
     mtet::MTetMesh generate_from_kuhn_mesh(const std::array<size_t, 3> &resolution,
                                      const std::array<double, 3> &bbox_min,
                                      const std::array<double, 3> &bbox_max,
                                      GridStyle style) {
         assert(resolution[0] > 0);
+        std::array<double, 3> bound_box = {bbox_max[0] - bbox_min[0], bbox_max[1] - bbox_min[1], bbox_max[2] - bbox_min[2]};
+        double longest_edge = *std::max_element(bound_box.begin(), bound_box.end()) * resolution[0];
+        // Bisecting a cubic Kuhn cube until a full level is completed gives the reflected Kuhn
+        // lattice with 2^k cells per axis, whose main diagonals are the longest edges.
+        // The bisection stops at a full level iff the bound lies in [diagonal, 4/3 diagonal).
+        if (bound_box[0] == bound_box[1] && bound_box[1] == bound_box[2] && longest_edge > 0) {
+            double diagonal = 3 * bound_box[0] * bound_box[0];
+            size_t cells = 1;
+            while (diagonal > longest_edge) {
+                diagonal /= 4;
+                cells *= 2;
+            }
+            if (cells == 1 || longest_edge < diagonal * 4 / 3) {
+                return generate_kuhn_lattice({cells, cells, cells}, bbox_min, bbox_max);
+            }
+        }
         std::vector<std::array<double, 3>> pts(8);
         auto compute_coordinate = [&](double t, size_t i) {
             return t * (bbox_max[i] - bbox_min[i]) + bbox_min[i];
@@ -138,9 +277,8 @@ namespace grid_mesh {
         for (auto &t: tets) {
             grid.add_tet(vertex_ids[t[0]], vertex_ids[t[1]], vertex_ids[t[2]], vertex_ids[t[3]]);
         }
-        std::array<double, 3> bound_box = {bbox_max[0] - bbox_min[0], bbox_max[1] - bbox_min[1], bbox_max[2] - bbox_min[2]};
-        double longest_edge = *std::max_element(bound_box.begin(), bound_box.end()) * resolution[0];
-        
+        grid.initialize_connectivity();
+
         auto comp = [](std::pair<mtet::Scalar, mtet::EdgeId> e0,
                        std::pair<mtet::Scalar, mtet::EdgeId> e1)
         { return e0.first < e1.first; };
@@ -21,6 +21,14 @@ namespace grid_mesh {
                                      const std::array<double, 3> &bbox_max,
                                      GridStyle style = TET5);
 
+    // generate the reflected Kuhn lattice: every cell is split into the 6 tets around its
+    // main diagonal, and the diagonal is mirrored between neighboring cells so that the
+    // lattice matches a uniform longest-edge bisection of a single Kuhn cube.
+    // The connectivity of the returned mesh is already initialized.
+    mtet::MTetMesh generate_kuhn_lattice(const std::array<size_t, 3> &resolution,
+                                     const std::array<double, 3> &bbox_min,
+                                     const std::array<double, 3> &bbox_max);
+
     mtet::MTetMesh generate_from_kuhn_mesh(const std::array<size_t, 3> &resolution,
                                      const std::array<double, 3> &bbox_min,
                                      const std::array<double, 3> &bbox_max,
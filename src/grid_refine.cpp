@@ -6,193 +6,1074 @@
 //
 
 #include "grid_refine.h"
+#include "3rd/nanothread/nanothread.h"
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
 
-bool gridRefine(
+namespace dr = drjit;
+
+/// Local vertex indices of the 6 edges of a tet, in the same order as `mtet::MTetMesh::foreach_edge_in_tet`.
+constexpr std::array<std::array<int, 2>, 6> tet_edges = {{{0, 1}, {1, 2}, {2, 0}, {0, 3}, {1, 3}, {2, 3}}};
+
+bool evaluate_crit(
+                   const int mode,
+                   const Eigen::Matrix<double, 4, 3> &pts,
+                   const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+                   const size_t funcNum,
+                   const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> &csg_func,
+                   const double threshold,
+                   const bool curve_network,
+                   bool &active,
+                   int &sub_call_two,
+                   int &sub_call_three,
+                   pair_hint *hint
+                   )
+{
+    switch (mode){
+        case IA:
+            return critIA(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hint);
+        case MI:
+            return critMI(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hint);
+        case CSG:
+            return critCSG(pts, tet_info, funcNum, csg_func, threshold, curve_network, active, sub_call_two, sub_call_three, hint);
+        default:
+            throw std::runtime_error("no implicit complexes specified");
+    }
+}
+
+int estimate_uniform_depth(
+                           const int mode,
+                           const bool curve_network,
+                           const double threshold,
+                           const int max_elements,
+                           const size_t funcNum,
+                           const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func,
+                           const IndexMap &vertex_func_grad_map,
+                           const mtet::MTetMesh &grid
+                           )
+{
+    /// Beyond this depth the uniform grid is far too large for any element budget.
+    const int max_depth = 16;
+    int depth = max_depth;
+    bool any_refinable = false;
+    int sub_call_two = 0;
+    int sub_call_three = 0;
+    Eigen::Matrix<double, 4, 3> pts;
+    std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info;
+    grid.seq_foreach_tet([&]([[maybe_unused]] mtet::TetId tid, std::span<const mtet::VertexId, 4> vs)
+                         {
+        for (int i = 0; i < 4; ++i){
+            auto coords = grid.get_vertex(vs[i]);
+            pts.row(i) = Eigen::RowVector3d({coords[0], coords[1], coords[2]});
+            tet_info[i] = vertex_func_grad_map.at(value_of(vs[i]));
+        }
+        int tet_depth = 0;
+        double scaled_threshold = threshold;
+        while (tet_depth < depth){
+            bool isActive = false;
+            if (!evaluate_crit(mode, pts, tet_info, funcNum, csg_func, scaled_threshold, curve_network, isActive, sub_call_two, sub_call_three)){
+                break;
+            }
+            tet_depth++;
+            scaled_threshold *= 4;
+        }
+        /// the tets the criteria don't refine, e.g., in empty space, don't bound the depth
+        if (tet_depth > 0){
+            depth = std::min(depth, tet_depth);
+            any_refinable = true;
+        }
+    });
+    if (!any_refinable){
+        return 0;
+    }
+    /// every halving of all edges splits a tet into 8 tets (3 bisections)
+    while (depth > 0 && static_cast<double>(grid.get_num_tets()) * std::pow(8.0, depth) > static_cast<double>(max_elements)){
+        depth--;
+    }
+    return depth;
+}
+
+void collect_refinable_tets(
+                            const int mode,
+                            const bool curve_network,
+                            const double threshold,
+                            const size_t funcNum,
+                            const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func,
+                            const IndexMap &vertex_func_grad_map,
+                            const mtet::MTetMesh &grid,
+                            std::span<const mtet::TetId> tets,
+                            std::vector<mtet::TetId> &refinable
+                            )
+{
+    std::vector<char> refine(tets.size());
+    dr::parallel_for(dr::blocked_range<size_t>(0, tets.size(), 1024), [&](dr::blocked_range<size_t> range)
+                     {
+        int sub_call_two = 0, sub_call_three = 0;
+        Eigen::Matrix<double, 4, 3> pts;
+        std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info;
+        for (size_t i : range){
+            std::span<const mtet::VertexId, 4> vs = grid.get_tet(tets[i]);
+            for (int j = 0; j < 4; ++j){
+                auto coords = grid.get_vertex(vs[j]);
+                pts.row(j) = Eigen::RowVector3d({coords[0], coords[1], coords[2]});
+                tet_info[j] = vertex_func_grad_map.at(value_of(vs[j]));
+            }
+            bool isActive = false;
+            refine[i] = evaluate_crit(mode, pts, tet_info, funcNum, csg_func, threshold, curve_network, isActive, sub_call_two, sub_call_three);
+        }
+    });
+    for (size_t i = 0; i < tets.size(); i++){
+        if (refine[i]){
+            refinable.push_back(tets[i]);
+        }
+    }
+}
+
+void uniform_refine(const mtet::Scalar max_edge_length, mtet::MTetMesh &grid)
+{
+    auto edge_length = [](std::span<const Scalar, 3> p0, std::span<const Scalar, 3> p1)
+    {
+        return (p0[0] - p1[0]) * (p0[0] - p1[0]) + (p0[1] - p1[1]) * (p0[1] - p1[1]) + (p0[2] - p1[2]) * (p0[2] - p1[2]);
+    };
+    /// squared length bound with a small tolerance so that rounding on non-dyadic coordinates doesn't trigger an extra level
+    const mtet::Scalar bound = max_edge_length * max_edge_length * (1 + 1e-8);
+    const mtet::MTetMesh &const_grid = grid;
+    std::vector<mtet::TetId> tets;
+    std::vector<std::pair<mtet::Scalar, mtet::EdgeId>> longest_edges;
+    auto comp = [](std::pair<mtet::Scalar, mtet::EdgeId> e0,
+                   std::pair<mtet::Scalar, mtet::EdgeId> e1)
+    { return e0.first > e1.first; };
+    while (true){
+        /// compute the longest edge of every tet in parallel
+        tets.clear();
+        tets.reserve(grid.get_num_tets());
+        grid.seq_foreach_tet([&](mtet::TetId tid, [[maybe_unused]] std::span<const mtet::VertexId, 4> vs)
+                             { tets.push_back(tid); });
+        longest_edges.resize(tets.size());
+        dr::parallel_for(dr::blocked_range<size_t>(0, tets.size(), 1024), [&](dr::blocked_range<size_t> range)
+                         {
+            for (size_t i : range){
+                std::span<const mtet::VertexId, 4> vs = const_grid.get_tet(tets[i]);
+                mtet::Scalar longest_edge_length = 0;
+                int longest_edge = 0;
+                for (int j = 0; j < 6; ++j){
+                    mtet::Scalar l = edge_length(const_grid.get_vertex(vs[tet_edges[j][0]]), const_grid.get_vertex(vs[tet_edges[j][1]]));
+                    if (l > longest_edge_length){
+                        longest_edge_length = l;
+                        longest_edge = j;
+                    }
+                }
+                longest_edges[i] = {longest_edge_length, const_grid.get_edge(tets[i], longest_edge)};
+            }
+        });
+        std::erase_if(longest_edges, [&](const auto &e){ return e.first <= bound; });
+        if (longest_edges.empty()){
+            break;
+        }
+        std::stable_sort(longest_edges.begin(), longest_edges.end(), comp);
+        for (const auto &[l, eid] : longest_edges){
+            /// the edge is gone if one of its tets has been split earlier in this pass
+            if (grid.has_edge(eid)){
+                grid.split_edge(eid);
+            }
+        }
+    }
+}
+
+int bulk_refine(
                 const int mode,
                 const bool curve_network,
                 const double threshold,
                 const double alpha,
                 const int max_elements,
                 const size_t funcNum,
+                const int depth,
                 const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> func,
                 const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func,
                 mtet::MTetMesh &grid,
-                tet_metric &metric_list,
-                std::array<double, timer_amount> profileTimer
+                IndexMap &vertex_func_grad_map
                 )
 {
-    /// Tet Metric
-    int sub_call_two = 0;
-    int sub_call_three = 0;
+    evaluate_vertices(funcNum, func, grid, vertex_func_grad_map);
+    /// the deferral of `alpha` depends on the activeness of the tets created before each split, which a level only knows after it
+    if (depth < 0 && std::isfinite(alpha)){
+        return 0;
+    }
+    const int max_depth = depth < 0 ? estimate_uniform_depth(mode, curve_network, threshold, max_elements, funcNum, csg_func, vertex_func_grad_map, grid) : depth;
+    mtet::Scalar max_edge_length = 0;
+    std::vector<mtet::TetId> tets;
+    grid.seq_foreach_tet([&](mtet::TetId tid, std::span<const mtet::VertexId, 4> vs)
+                         {
+        tets.push_back(tid);
+        for (int j = 0; j < 6; ++j){
+            auto p0 = grid.get_vertex(vs[tet_edges[j][0]]);
+            auto p1 = grid.get_vertex(vs[tet_edges[j][1]]);
+            max_edge_length = std::max(max_edge_length, (p0[0] - p1[0]) * (p0[0] - p1[0]) + (p0[1] - p1[1]) * (p0[1] - p1[1]) + (p0[2] - p1[2]) * (p0[2] - p1[2]));
+        }
+    });
+    max_edge_length = std::sqrt(max_edge_length);
+    if (depth > 0){
+        for (int level = 1; level <= depth; level++){
+            uniform_refine(max_edge_length / std::pow(2.0, level), grid);
+            evaluate_vertices(funcNum, func, grid, vertex_func_grad_map);
+        }
+        return depth;
+    }
+    
+    /// Only the tets the criteria refine are split in the order of the adaptive loop: the longest edges of the refinable tets are queued, and all the queued edges
+    /// of the longest length are split in one pass, after which the criteria of the new tets run in parallel.
+    std::vector<mtet::TetId> refinable;
+    std::vector<std::pair<mtet::Scalar, mtet::EdgeId>> Q;
+    auto comp = [](std::pair<mtet::Scalar, mtet::EdgeId> e0,
+                   std::pair<mtet::Scalar, mtet::EdgeId> e1)
+    { return e0.first < e1.first; };
+    auto queue_refinable = [&]()
+    {
+        refinable.clear();
+        collect_refinable_tets(mode, curve_network, threshold, funcNum, csg_func, vertex_func_grad_map, grid, tets, refinable);
+        for (mtet::TetId tid : refinable){
+            Q.push_back(longest_tet_edge(grid, tid));
+            std::push_heap(Q.begin(), Q.end(), comp);
+        }
+        tets.clear();
+    };
+    queue_refinable();
+    int level = 0;
+    for (int next_level = 1; next_level <= max_depth; next_level++){
+        /// squared length bound with a small tolerance, as in `uniform_refine`
+        const mtet::Scalar bound = std::pow(max_edge_length / std::pow(2.0, next_level), 2) * (1 + 1e-8);
+        bool split = false;
+        while (!Q.empty() && Q.front().first > bound){
+            const mtet::Scalar longest = Q.front().first;
+            while (!Q.empty() && Q.front().first == longest){
+                std::pop_heap(Q.begin(), Q.end(), comp);
+                mtet::EdgeId eid = Q.back().second;
+                Q.pop_back();
+                if (!grid.has_edge(eid)){
+                    continue;
+                }
+                auto [vid, eid0, eid1] = grid.split_edge(eid);
+                split = true;
+                if (grid.get_num_tets() > max_elements){
+                    evaluate_vertices(funcNum, func, grid, vertex_func_grad_map);
+                    return next_level;
+                }
+                grid.foreach_tet_around_edge(eid0, [&](mtet::TetId tid){ tets.push_back(tid); });
+                grid.foreach_tet_around_edge(eid1, [&](mtet::TetId tid){ tets.push_back(tid); });
+            }
+            /// the new tets split again in this pass are gone
+            std::erase_if(tets, [&](mtet::TetId tid){ return !grid.has_tet(tid); });
+            std::sort(tets.begin(), tets.end(), [](mtet::TetId t0, mtet::TetId t1){ return value_of(t0) < value_of(t1); });
+            tets.erase(std::unique(tets.begin(), tets.end()), tets.end());
+            evaluate_vertices(funcNum, func, grid, vertex_func_grad_map);
+            queue_refinable();
+        }
+        if (!split){
+            break;
+        }
+        level = next_level;
+    }
+    return level;
+}
 
-    /// initialize vertex map: vertex index -> {{f_i, gx, gy, gz} | for all f_i in the function}
+void evaluate_vertices(
+                       const size_t funcNum,
+                       const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> func,
+                       const mtet::MTetMesh &grid,
+                       IndexMap &vertex_func_grad_map
+                       )
+{
+    std::vector<uint64_t> vids;
+    std::vector<std::array<Scalar, 3>> coords;
+    grid.seq_foreach_vertex([&](VertexId vid, std::span<const Scalar, 3> data)
+                            {
+        if (!vertex_func_grad_map.contains(value_of(vid))){
+            vids.push_back(value_of(vid));
+            coords.push_back({data[0], data[1], data[2]});
+        }
+    });
+    std::vector<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>> evals(vids.size());
+    dr::parallel_for(dr::blocked_range<size_t>(0, vids.size(), 256), [&](dr::blocked_range<size_t> range)
+                     {
+        for (size_t i : range){
+            evals[i] = func(std::span<const Scalar, 3>(coords[i]), funcNum);
+        }
+    });
+    vertex_func_grad_map.reserve(vertex_func_grad_map.size() + vids.size());
+    for (size_t i = 0; i < vids.size(); ++i){
+        vertex_func_grad_map[vids[i]] = std::move(evals[i]);
+    }
+}
+
+grid_choice choose_initial_grid(
+                                const int mode,
+                                const bool curve_network,
+                                const double threshold,
+                                const size_t funcNum,
+                                const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> func,
+                                const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func,
+                                const std::array<double, 3> &bbox_min,
+                                const std::array<double, 3> &bbox_max
+                                )
+{
+    /// resolution of the finest candidate along the longest side of the bounding box, which also serves as the sampling lattice (a power of 2)
+    const size_t lattice_res = 16;
+    /// relative cost of a tet created by an adaptive split (heap, hash and split) to a tet of the initial grid
+    const double adaptive_cost = 2;
     
-    using IndexMap = ankerl::unordered_dense::map<uint64_t, llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>>;
-    IndexMap vertex_func_grad_map;
-    vertex_func_grad_map.reserve(grid.get_num_vertices());
+    std::array<double, 3> extent;
+    for (int i = 0; i < 3; ++i){
+        extent[i] = bbox_max[i] - bbox_min[i];
+        // the cells of the candidates are located by dividing by the extent
+        if (!(extent[i] > 0) || !std::isfinite(extent[i])){
+            throw std::runtime_error("ERROR: the bounding box of the grid is flat or unbounded");
+        }
+    }
+    const double L = *std::max_element(extent.begin(), extent.end());
+    auto resolution_of = [&](size_t r)
+    {
+        std::array<size_t, 3> resolution;
+        for (int i = 0; i < 3; ++i){
+            resolution[i] = std::max<size_t>(1, static_cast<size_t>(std::round(r * extent[i] / L)));
+        }
+        return resolution;
+    };
+    /// index of the grid cell of the given resolution containing the point
+    auto cell_of = [&](const std::array<size_t, 3> &resolution, const Eigen::RowVector3d &p)
+    {
+        size_t index = 0;
+        for (int i = 0; i < 3; ++i){
+            size_t c = std::min(resolution[i] - 1, static_cast<size_t>(std::max(0.0, (p[i] - bbox_min[i]) / extent[i] * resolution[i])));
+            index = index * resolution[i] + c;
+        }
+        return index;
+    };
     
-    /// hash for mounting a boolean that represents the activeness to a tet
-    using tetActive = ankerl::unordered_dense::map<std::span<VertexId, 4>, bool, TetHash, TetEqual>;
-    tetActive tet_active_map;
-    tet_active_map.reserve(grid.get_num_tets());
+    /// The tets of a candidate grid that pass the zero-crossing test and the criteria.
+    struct candidate_eval
+    {
+        size_t tets = 0;
+        size_t refinable = 0;
+        std::vector<uint8_t> cell_active;
+    };
+    mtet::MTetMesh lattice;
+    IndexMap lattice_values;
+    auto evaluate_candidate = [&](const std::array<size_t, 3> &resolution, grid_mesh::GridStyle style, mtet::MTetMesh &candidate, IndexMap &values)
+    {
+        candidate_eval result;
+        candidate = grid_mesh::generate_tet_mesh(resolution, bbox_min, bbox_max, style);
+        evaluate_vertices(funcNum, func, candidate, values);
+        result.cell_active.assign(resolution[0] * resolution[1] * resolution[2], 0);
+        int sub_call_two = 0, sub_call_three = 0;
+        Eigen::Matrix<double, 4, 3> pts;
+        std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info;
+        candidate.seq_foreach_tet([&](mtet::TetId tid, std::span<const mtet::VertexId, 4> vs)
+                                  {
+            for (int i = 0; i < 4; ++i){
+                auto coords = candidate.get_vertex(vs[i]);
+                pts.row(i) = Eigen::RowVector3d({coords[0], coords[1], coords[2]});
+                tet_info[i] = values.at(value_of(vs[i]));
+            }
+            bool isActive = false;
+            if (evaluate_crit(mode, pts, tet_info, funcNum, csg_func, threshold, curve_network, isActive, sub_call_two, sub_call_three)){
+                result.refinable++;
+            }
+            if (isActive){
+                result.cell_active[cell_of(resolution, pts.colwise().mean())] = 1;
+            }
+            result.tets++;
+        });
+        return result;
+    };
+    
+    // the finest candidate is the reference for the location of the complex
+    const std::array<size_t, 3> n = resolution_of(lattice_res);
+    const candidate_eval reference = evaluate_candidate(n, grid_mesh::TET6, lattice, lattice_values);
+    const double lattice_diameter = std::sqrt(std::pow(extent[0] / n[0], 2) + std::pow(extent[1] / n[1], 2) + std::pow(extent[2] / n[2], 2));
+    
+    // fraction of active blocks of 2^b lattice cells
+    std::vector<double> active_fraction;
+    for (size_t b = 1; b <= lattice_res; b *= 2){
+        std::array<size_t, 3> blocks = {(n[0] + b - 1) / b, (n[1] + b - 1) / b, (n[2] + b - 1) / b};
+        std::vector<uint8_t> block_active(blocks[0] * blocks[1] * blocks[2], 0);
+        for (size_t i = 0; i < n[0]; ++i){
+            for (size_t j = 0; j < n[1]; ++j){
+                for (size_t k = 0; k < n[2]; ++k){
+                    block_active[((i / b) * blocks[1] + j / b) * blocks[2] + k / b] |= reference.cell_active[(i * n[1] + j) * n[2] + k];
+                }
+            }
+        }
+        active_fraction.push_back(static_cast<double>(std::count(block_active.begin(), block_active.end(), 1)) / block_active.size());
+    }
+    /// The fraction of space within cells of diameter `e` that contains the complex. Below the lattice resolution it shrinks linearly like a surface.
+    auto fraction_at = [&](double e)
+    {
+        if (e < lattice_diameter){
+            return active_fraction[0] * e / lattice_diameter;
+        }
+        size_t b = std::min(active_fraction.size() - 1, static_cast<size_t>(std::log2(e / lattice_diameter)));
+        return active_fraction[b];
+    };
+    
+    // how many more halvings the lattice tets need: the distance error scales with the squared edge length,
+    // so a tet needs k more halvings if it still fails the criteria under the threshold `threshold * 4^(k-1)`
+    double depth_sum = 0;
+    size_t depth_count = 0;
+    {
+        int sub_call_two = 0, sub_call_three = 0;
+        Eigen::Matrix<double, 4, 3> pts;
+        std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info;
+        /// probe a strided subset of about 512 tets to keep it cheap for expensive criteria
+        const size_t stride = std::max<size_t>(1, lattice.get_num_tets() / 512);
+        size_t tet_index = 0;
+        lattice.seq_foreach_tet([&](mtet::TetId tid, std::span<const mtet::VertexId, 4> vs)
+                                {
+            if (tet_index++ % stride != 0){
+                return;
+            }
+            for (int i = 0; i < 4; ++i){
+                auto coords = lattice.get_vertex(vs[i]);
+                pts.row(i) = Eigen::RowVector3d({coords[0], coords[1], coords[2]});
+                tet_info[i] = lattice_values.at(value_of(vs[i]));
+            }
+            int depth = 0;
+            double scaled_threshold = threshold;
+            bool isActive = false;
+            while (depth < 32 && evaluate_crit(mode, pts, tet_info, funcNum, csg_func, scaled_threshold, curve_network, isActive, sub_call_two, sub_call_three)){
+                depth++;
+                scaled_threshold *= 4;
+            }
+            if (depth > 0){
+                depth_sum += depth;
+                depth_count++;
+            }
+        });
+    }
+    /// the edge length the refinement reaches on average
+    double target_length = std::sqrt(3.0) * L / lattice_res;
+    if (depth_count > 0){
+        target_length /= std::pow(2.0, depth_sum / depth_count);
+    }
+    
+    // calibrate the tet counts of each style after every level of uniform refinement on a unit cell
+    const int calibration_levels = 3;
+    std::array<std::array<double, calibration_levels + 1>, 2> style_tets;
+    const std::array<double, 2> style_edge = {std::sqrt(2.0), std::sqrt(3.0)};
+    for (int style = grid_mesh::TET5; style <= grid_mesh::TET6; ++style){
+        mtet::MTetMesh cell = grid_mesh::generate_tet_mesh({1, 1, 1}, {0, 0, 0}, {1, 1, 1}, static_cast<grid_mesh::GridStyle>(style));
+        cell.initialize_connectivity();
+        style_tets[style][0] = cell.get_num_tets();
+        for (int level = 1; level <= calibration_levels; ++level){
+            uniform_refine(style_edge[style] / std::pow(2.0, level), cell);
+            style_tets[style][level] = cell.get_num_tets();
+        }
+    }
+    
+    grid_choice best = {n, grid_mesh::TET6, std::numeric_limits<double>::infinity()};
+    for (size_t r = lattice_res; r >= 1; r /= 2){
+        const std::array<size_t, 3> resolution = resolution_of(r);
+        double cell_size = 0;
+        for (int i = 0; i < 3; ++i){
+            cell_size = std::max(cell_size, extent[i] / resolution[i]);
+        }
+        for (int style = grid_mesh::TET5; style <= grid_mesh::TET6; ++style){
+            mtet::MTetMesh candidate;
+            IndexMap values;
+            const candidate_eval eval = r == lattice_res && style == grid_mesh::TET6 ? reference : evaluate_candidate(resolution, static_cast<grid_mesh::GridStyle>(style), candidate, values);
+            // reject the candidate if it misses a part of the complex found on the lattice
+            bool missed = false;
+            for (size_t i = 0; i < n[0] && !missed; ++i){
+                for (size_t j = 0; j < n[1] && !missed; ++j){
+                    for (size_t k = 0; k < n[2] && !missed; ++k){
+                        if (reference.cell_active[(i * n[1] + j) * n[2] + k]){
+                            Eigen::RowVector3d center((i + 0.5) * extent[0] / n[0] + bbox_min[0], (j + 0.5) * extent[1] / n[1] + bbox_min[1], (k + 0.5) * extent[2] / n[2] + bbox_min[2]);
+                            missed = !eval.cell_active[cell_of(resolution, center)];
+                        }
+                    }
+                }
+            }
+            if (missed){
+                continue;
+            }
+            const auto &tets = style_tets[style];
+            double cost = eval.tets;
+            /// tets per initial tet at the current level
+            double level_tets = 1;
+            /// the longest edge of the tets at the current level
+            double edge = style_edge[style] * cell_size;
+            for (int level = 1; eval.refinable > 0 && edge / 2 >= target_length && level < 64; ++level){
+                level_tets *= level <= calibration_levels ? tets[level] / tets[level - 1] : tets[calibration_levels] / tets[calibration_levels - 1];
+                /// the refinable initial tets are known, finer levels use the fraction found on the lattice
+                const double refined_part = level == 1 ? eval.refinable : eval.tets * fraction_at(edge);
+                cost += adaptive_cost * refined_part * level_tets;
+                edge /= 2;
+            }
+            if (cost < best.cost){
+                best = {resolution, static_cast<grid_mesh::GridStyle>(style), cost};
+            }
+        }
+        if (r == 1){
+            break;
+        }
+    }
+    return best;
+}
 
-    grid.seq_foreach_vertex([&](VertexId vid, std::span<const Scalar, 3> data)
-                            {vertex_func_grad_map[value_of(vid)] = func(data, funcNum);});
+/// A tet sent to the workers of `pipelined_refine`, together with its criteria results.
+struct crit_task
+{
+    mtet::TetId tid;
+    std::array<std::array<Scalar, 3>, 4> coords;
+    std::array<mtet::VertexId, 4> vs;
+    bool refine = false;
+    bool active = false;
+};
 
+void pipelined_refine(
+                      const int mode,
+                      const bool curve_network,
+                      const double threshold,
+                      const double alpha,
+                      const int max_elements,
+                      const size_t funcNum,
+                      const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> func,
+                      const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func,
+                      const int num_threads,
+                      mtet::MTetMesh &grid,
+                      IndexMap &vertex_func_grad_map,
+                      tetActive &tet_active_map,
+                      int &sub_call_two,
+                      int &sub_call_three,
+                      crit_stats &stats
+                      )
+{
+    std::mutex queue_mutex;
+    std::condition_variable job_cv, result_cv;
+    std::deque<std::vector<crit_task>> jobs, results;
+    bool stop = false;
+    std::shared_mutex map_mutex;
+    
+    auto worker = [&]()
+    {
+        int worker_call_two = 0, worker_call_three = 0;
+        pair_hint worker_hint;
+        Eigen::Matrix<double, 4, 3> pts;
+        std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info;
+        while (true){
+            std::vector<crit_task> batch;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                job_cv.wait(lock, [&]{ return stop || !jobs.empty(); });
+                if (jobs.empty()){
+                    break;
+                }
+                batch = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            for (crit_task &task : batch){
+                for (int i = 0; i < 4; ++i){
+                    pts.row(i) = Eigen::RowVector3d({task.coords[i][0], task.coords[i][1], task.coords[i][2]});
+                    const uint64_t vid = value_of(task.vs[i]);
+                    bool found = false;
+                    {
+                        std::shared_lock<std::shared_mutex> lock(map_mutex);
+                        auto it = vertex_func_grad_map.find(vid);
+                        if (it != vertex_func_grad_map.end()){
+                            tet_info[i] = it->second;
+                            found = true;
+                        }
+                    }
+                    if (!found){
+                        tet_info[i] = func(std::span<const Scalar, 3>(task.coords[i]), funcNum);
+                        std::unique_lock<std::shared_mutex> lock(map_mutex);
+                        vertex_func_grad_map.try_emplace(vid, tet_info[i]);
+                    }
+                }
+                task.refine = evaluate_crit(mode, pts, tet_info, funcNum, csg_func, threshold, curve_network, task.active, worker_call_two, worker_call_three, &worker_hint);
+            }
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                results.push_back(std::move(batch));
+            }
+            result_cv.notify_one();
+        }
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        sub_call_two += worker_call_two;
+        sub_call_three += worker_call_three;
+        stats.merge(worker_hint.stats);
+    };
+    std::vector<std::thread> workers;
+    for (int i = 0; i < num_threads; ++i){
+        workers.emplace_back(worker);
+    }
+    
     auto comp = [](std::pair<mtet::Scalar, mtet::EdgeId> e0,
                    std::pair<mtet::Scalar, mtet::EdgeId> e1)
     { return e0.first < e1.first; };
     std::vector<std::pair<mtet::Scalar, mtet::EdgeId>> Q;
-
-    Eigen::Matrix<double, 4, 3> pts;
-    std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info;
-    for (size_t i = 0; i < tet_info.size(); i++){
-        tet_info[i].resize(funcNum);
-    }
-    double activeTet = 0;
-    auto push_longest_edge = [&](mtet::TetId tid)
+    /// number of batches sent to the workers whose results haven't been applied
+    size_t in_flight = 0;
+    /// bound of pending batches, so that the heap order stays close to the serial one
+    const size_t max_in_flight = 4 * num_threads;
+    /// tets sent to the workers whose results haven't been applied
+    ankerl::unordered_dense::set<uint64_t> pending_tets;
+    std::vector<crit_task> batch;
+    auto add_task = [&](mtet::TetId tid)
     {
+        crit_task task;
+        task.tid = tid;
+        pending_tets.insert(value_of(tid));
         std::span<VertexId, 4> vs = grid.get_tet(tid);
+        for (int i = 0; i < 4; ++i){
+            task.vs[i] = vs[i];
+            auto coords = grid.get_vertex(vs[i]);
+            task.coords[i] = {coords[0], coords[1], coords[2]};
+        }
+        batch.push_back(task);
+    };
+    auto dispatch = [&]()
+    {
+        if (batch.empty()){
+            return;
+        }
         {
-            //Timer eval_timer(evaluation, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
-            for (int i = 0; i < 4; ++i)
-            {
-                auto vid = vs[i];
-                auto coords = grid.get_vertex(vid);
-                pts.row(i) = Eigen::RowVector3d({coords[0], coords[1], coords[2]});
-                llvm_vecsmall::SmallVector<std::array<double, 4>, 20> func_gradList(funcNum);
-                
-                llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> func_info(funcNum);
-                std::array<double, 4> func_grad;
-                if (!vertex_func_grad_map.contains(value_of(vid))) {
-                    func_info = func(coords, funcNum);
-                    vertex_func_grad_map[value_of(vid)] = func_info;
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            jobs.push_back(std::move(batch));
+        }
+        batch.clear();
+        in_flight++;
+        job_cv.notify_one();
+    };
+    auto collect = [&](bool wait)
+    {
+        std::deque<std::vector<crit_task>> ready;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            if (wait){
+                result_cv.wait(lock, [&]{ return !results.empty(); });
+            }
+            ready.swap(results);
+        }
+        for (const auto &done : ready){
+            for (const crit_task &task : done){
+                pending_tets.erase(value_of(task.tid));
+                if (!grid.has_tet(task.tid)){
+                    continue;
                 }
-                else {
-                    //func_gradList = vertex_func_grad_map[value_of(vid)];
-                    func_info = vertex_func_grad_map[value_of(vid)];
+                tet_active_map[grid.get_tet(task.tid)] = task.active;
+                if (task.refine){
+                    Q.emplace_back(longest_tet_edge(grid, task.tid));
+                    std::push_heap(Q.begin(), Q.end(), comp);
                 }
-                tet_info[i] = func_info;
             }
-            //eval_timer.Stop();
+            in_flight--;
         }
-        bool isActive = 0;
-        bool subResult;
-        {
-            //Timer sub_timer(subdivision, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
-            switch (mode){
-                case IA:
-                    subResult = critIA(pts, tet_info, funcNum, threshold, curve_network, isActive, sub_call_two, sub_call_three);
-                    break;
-                case MI:
-                    subResult = critMI(pts, tet_info, funcNum, threshold, curve_network, isActive, sub_call_two, sub_call_three);
+    };
+    
+    // Initialize the workers with all tets.
+    grid.seq_foreach_tet([&](mtet::TetId tid, [[maybe_unused]] std::span<const mtet::VertexId, 4> vs)
+                         {
+        add_task(tid);
+        if (batch.size() == 64){
+            dispatch();
+        }
+    });
+    dispatch();
+    
+    // Keep splitting the longest edge
+    while (true)
+    {
+        collect(false);
+        if (Q.empty() || in_flight > max_in_flight){
+            if (in_flight == 0){
+                break;
+            }
+            collect(true);
+            continue;
+        }
+        std::pop_heap(Q.begin(), Q.end(), comp);
+        auto [edge_length, eid] = Q.back();
+        if (!grid.has_edge(eid)){
+            Q.pop_back();
+            continue;
+        }
+        //implement alpha value:
+        mtet::Scalar comp_edge_length = alpha * edge_length;
+        // a tet around the edge whose activeness is still being evaluated may defer the split, so wait for its results first
+        if (std::isfinite(alpha)){
+            bool pending = false;
+            grid.foreach_tet_around_edge(eid, [&](mtet::TetId tid){
+                pending = pending || pending_tets.contains(value_of(tid));
+            });
+            if (pending){
+                std::push_heap(Q.begin(), Q.end(), comp);
+                collect(true);
+                continue;
+            }
+        }
+        bool addedActive = false;
+        grid.foreach_tet_around_edge(eid,[&](mtet::TetId tid){
+            std::span<VertexId, 4> vs = grid.get_tet(tid);
+            if(tet_active_map.contains(vs) && tet_active_map[vs]){
+                auto longest = longest_tet_edge(grid, tid);
+                if (longest.first > comp_edge_length) {
+                    Q.emplace_back(longest);
+                    std::push_heap(Q.begin(), Q.end(), comp);
+                    addedActive = true;
+                }
+            }
+        });
+        if(addedActive){
+            continue;
+        }
+        Q.pop_back();
+        auto [vid, eid0, eid1] = grid.split_edge(eid);
+        if (grid.get_num_tets() > max_elements) {
+            break;
+        }
+        grid.foreach_tet_around_edge(eid0, add_task);
+        grid.foreach_tet_around_edge(eid1, add_task);
+        dispatch();
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stop = true;
+        jobs.clear();
+    }
+    job_cv.notify_all();
+    for (auto &t : workers){
+        t.join();
+    }
+}
+
+/// The extensions of the single-threaded loop of `gridRefine` as the hooks of `adaptive_refine` (see `no_refine_hooks`). The failed pairs of `refine_options::pair_hints`
+/// are stored by a tet until it's split, and the tets around the split edge pass them to their children, which are found by their two vertices off the edge.
+/// The functions of `refine_options::culling` are found for every tet and evaluated at every new vertex, and the gradients of `refine_options::gradient_free`
+/// are replaced by the midpoint samples.
+struct refine_extensions
+{
+    mtet::MTetMesh &grid;
+    IndexMap &vertex_func_grad_map;
+    size_t funcNum;
+    /// The midpoint samples of the functions without gradients, or nullptr.
+    midpoint_samples *samples = nullptr;
+    /// The function evaluations of `gridRefine`, for the new vertices with `samples`.
+    const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> *func = nullptr;
+    /// The function index of the culling, or nullptr.
+    const function_index *culling = nullptr;
+    /// The functions whose zero set may cross the bounding box of the last tet, with `culling`.
+    uint32_t tet_functions = 0;
+    bool pair_hints = false;
+    
+    ankerl::unordered_dense::map<std::array<uint64_t, 4>, std::array<uint32_t, 20>, SortedTetHash> failed_pairs;
+    /// the failed pairs of the tets around the split edge, each keyed by its two vertices off the edge
+    llvm_vecsmall::SmallVector<std::pair<std::array<uint64_t, 2>, std::array<uint32_t, 20>>, 16> parent_pairs;
+    /// the vertices of the split edge and the new vertex
+    std::array<uint64_t, 3> split_vertices = {};
+    
+    refine_extensions(mtet::MTetMesh &grid, IndexMap &vertex_func_grad_map, size_t funcNum) : grid(grid), vertex_func_grad_map(vertex_func_grad_map), funcNum(funcNum) {}
+    
+    static std::array<uint64_t, 4> sorted_key(std::span<const VertexId, 4> vs)
+    {
+        std::array<uint64_t, 4> key = {value_of(vs[0]), value_of(vs[1]), value_of(vs[2]), value_of(vs[3])};
+        std::sort(key.begin(), key.end());
+        return key;
+    }
+    
+    /// the vertices of a tet that aren't in `excluded`, in ascending order
+    static std::array<uint64_t, 2> off_vertices(std::span<const VertexId, 4> vs, std::span<const uint64_t> excluded)
+    {
+        std::array<uint64_t, 2> off = {};
+        size_t n = 0;
+        for (uint64_t v : sorted_key(vs)){
+            if (std::find(excluded.begin(), excluded.end(), v) == excluded.end() && n < 2){
+                off[n++] = v;
+            }
+        }
+        return off;
+    }
+    
+    /// the functions whose zero set may cross the bounding box of a tet
+    uint32_t tet_func_mask(std::span<const VertexId, 4> vs) const
+    {
+        std::array<Scalar, 3> bbox_min, bbox_max;
+        auto p0 = grid.get_vertex(vs[0]);
+        for (int d = 0; d < 3; d++){
+            bbox_min[d] = bbox_max[d] = p0[d];
+        }
+        for (int i = 1; i < 4; i++){
+            auto p = grid.get_vertex(vs[i]);
+            for (int d = 0; d < 3; d++){
+                bbox_min[d] = std::min(bbox_min[d], p[d]);
+                bbox_max[d] = std::max(bbox_max[d], p[d]);
+            }
+        }
+        return culling->query(bbox_min, bbox_max);
+    }
+    
+    void before_criterion(std::span<const VertexId, 4> vs,
+                          const Eigen::Matrix<double, 4, 3> &pts,
+                          std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+                          pair_hint &hint)
+    {
+        if (samples){
+            samples->replace_gradients(pts, tet_info, funcNum);
+        }
+        if (culling){
+            tet_functions = tet_func_mask(vs);
+        }
+        if (pair_hints){
+            hint.skip = {};
+            std::array<uint64_t, 2> off = off_vertices(vs, split_vertices);
+            for (const auto &[parent_off, parent_failed] : parent_pairs){
+                if (parent_off == off){
+                    hint.skip = parent_failed;
                     break;
-                case CSG:
-                    subResult = critCSG(pts, tet_info, funcNum, csg_func, threshold, curve_network, isActive, sub_call_two, sub_call_three);
+                }
+            }
+        }
+    }
+    
+    void after_criterion(std::span<const VertexId, 4> vs, const pair_hint &hint, bool /*refinable*/)
+    {
+        if (pair_hints){
+            for (uint32_t failed : hint.failed){
+                if (failed){
+                    failed_pairs[sorted_key(vs)] = hint.failed;
                     break;
-                default:
-                    throw std::runtime_error("no implicit complexes specified");
-                    return false;
+                }
             }
-            //sub_timer.Stop();
         }
-        //vertex_active_map[vertexHash(vs)] = isActive;
-        tet_active_map[vs] = isActive;
-        //Timer eval_timer(evaluation, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
-        if (subResult)
-        {
-            mtet::EdgeId longest_edge;
-            mtet::Scalar longest_edge_length = 0;
-            grid.foreach_edge_in_tet(tid, [&](mtet::EdgeId eid, mtet::VertexId v0, mtet::VertexId v1)
+    }
+    
+    void before_split(mtet::EdgeId eid)
+    {
+        if (!pair_hints){
+            return;
+        }
+        std::array<VertexId, 2> vs_old = grid.get_edge_vertices(eid);
+        split_vertices = {value_of(vs_old[0]), value_of(vs_old[1]), 0};
+        parent_pairs.clear();
+        grid.foreach_tet_around_edge(eid, [&](mtet::TetId tid)
                                      {
-                auto p0 = grid.get_vertex(v0);
-                auto p1 = grid.get_vertex(v1);
-                mtet::Scalar l = (p0[0] - p1[0]) * (p0[0] - p1[0]) + (p0[1] - p1[1]) * (p0[1] - p1[1]) +
-                (p0[2] - p1[2]) * (p0[2] - p1[2]);
-                if (l > longest_edge_length) {
-                    longest_edge_length = l;
-                    longest_edge = eid;
+            std::span<VertexId, 4> vs = grid.get_tet(tid);
+            auto it = failed_pairs.find(sorted_key(vs));
+            if (it != failed_pairs.end()){
+                parent_pairs.emplace_back(off_vertices(vs, std::span<const uint64_t>(split_vertices.data(), 2)), it->second);
+                failed_pairs.erase(it);
+            } });
+    }
+    
+    void after_split(mtet::VertexId vid, mtet::EdgeId eid0, mtet::EdgeId eid1)
+    {
+        split_vertices[2] = value_of(vid);
+        if (culling){
+            /// the tets around the new vertex are the tets around the two halves of the edge
+            uint32_t mask = 0;
+            grid.foreach_tet_around_edge(eid0, [&](mtet::TetId tid)
+                                         { mask |= tet_func_mask(grid.get_tet(tid)); });
+            grid.foreach_tet_around_edge(eid1, [&](mtet::TetId tid)
+                                         { mask |= tet_func_mask(grid.get_tet(tid)); });
+            vertex_func_grad_map[value_of(vid)] = culling->evaluate(grid.get_vertex(vid), mask);
+        }
+        if (samples){
+            vertex_func_grad_map[value_of(vid)] = samples->split_vertex(grid.get_vertex(vid), funcNum, *func);
+        }
+    }
+};
+
+bool gridRefine(
+                const int mode,
+                const bool curve_network,
+                const double threshold,
+                const double alpha,
+                const int max_elements,
+                const size_t funcNum,
+                const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> func,
+                const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func,
+                mtet::MTetMesh &grid,
+                tet_metric &metric_list,
+                std::array<double, timer_amount> profileTimer,
+                const refine_options &options
+                )
+{
+    /// Tet Metric
+    int sub_call_two = 0;
+    int sub_call_three = 0;
+
+    /// initialize vertex map: vertex index -> {{f_i, gx, gy, gz} | for all f_i in the function}
+    IndexMap vertex_func_grad_map;
+    vertex_func_grad_map.reserve(grid.get_num_vertices());
+    
+    /// hash for mounting a boolean that represents the activeness to a tet
+    tetActive tet_active_map;
+    tet_active_map.reserve(grid.get_num_tets());
+
+    /// functions are culled by their zero sets, see `refine_options::culling`
+    const function_index *culling = mode == MI || options.num_threads > 1 ? nullptr : options.culling;
+    if (culling && culling->size() != funcNum){
+        throw std::runtime_error("ERROR: the function index doesn't match the functions");
+    }
+    /// the functions without gradients are sampled at the edge midpoints, see `refine_options::gradient_free`
+    const uint32_t gradient_free = culling ? 0 : options.gradient_free;
+    if (gradient_free && options.uniform_depth != 0){
+        throw std::runtime_error("ERROR: the bulk refinement needs the gradients of all the functions");
+    }
+    if (gradient_free && !options.value_func){
+        throw std::runtime_error("ERROR: the functions without gradients need a value function");
+    }
+    std::optional<midpoint_samples> samples;
+    if (gradient_free){
+        samples.emplace(gradient_free, options.value_func, options.masked_func);
+    }
+    refine_extensions extensions(grid, vertex_func_grad_map, funcNum);
+    extensions.samples = samples ? &*samples : nullptr;
+    extensions.func = &func;
+    extensions.culling = culling;
+    /// With `pair_hints`, the pairs of functions whose zero-crossing test failed in a tet are passed to its children.
+    extensions.pair_hints = options.pair_hints && !culling && mode != MI;
+
+    if (options.uniform_depth == 0){
+        if (culling){
+            /// a vertex is evaluated for the functions of all the tets around it. Later tets around it are inside these tets, so they don't need more.
+            ankerl::unordered_dense::map<uint64_t, uint32_t> vertex_masks;
+            vertex_masks.reserve(grid.get_num_vertices());
+            grid.seq_foreach_tet([&]([[maybe_unused]] mtet::TetId tid, std::span<const mtet::VertexId, 4> vs)
+                                 {
+                uint32_t mask = extensions.tet_func_mask(vs);
+                for (int i = 0; i < 4; i++){
+                    vertex_masks[value_of(vs[i])] |= mask;
                 } });
-            Q.emplace_back(longest_edge_length, longest_edge);
-            //eval_timer.Stop();
-            return true;
+            grid.seq_foreach_vertex([&](VertexId vid, std::span<const Scalar, 3> data)
+                                    {vertex_func_grad_map[value_of(vid)] = culling->evaluate(data, vertex_masks[value_of(vid)]);});
+        } else {
+            grid.seq_foreach_vertex([&](VertexId vid, std::span<const Scalar, 3> data)
+                                    {vertex_func_grad_map[value_of(vid)] = func(data, funcNum);});
         }
-        //eval_timer.Stop();
-        return false;
-    };
+    }
 
+    /// The criteria restricted to the functions whose zero set may cross the tet, which `extensions` finds before each call (see `refine_options::culling`).
+    /// The other functions keep one sign over the tet: they're never active for IA, and CSG sees them as the constant intervals of their sign.
+    std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> sub_info;
+    llvm_vecsmall::SmallVector<int, 20> sub_funcs;
+    const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> sub_csg_func =
+    [&](llvm_vecsmall::SmallVector<std::array<double, 2>, 20> subInt)
+    {
+        llvm_vecsmall::SmallVector<std::array<double, 2>, 20> funcInt(funcNum);
+        for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+            double sign = culling->placeholder(funcIter)[0];
+            funcInt[funcIter] = {sign, sign};
+        }
+        for (size_t subIter = 0; subIter < sub_funcs.size(); subIter++){
+            funcInt[sub_funcs[subIter]] = subInt[subIter];
+        }
+        std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> csgResult = csg_func(funcInt);
+        llvm_vecsmall::SmallVector<int, 20> subInactive(sub_funcs.size());
+        for (size_t subIter = 0; subIter < sub_funcs.size(); subIter++){
+            subInactive[subIter] = csgResult.second[sub_funcs[subIter]];
+        }
+        return std::pair(csgResult.first, subInactive);
+    };
+    auto culled_crit = [&](const Eigen::Matrix<double, 4, 3> &pts,
+                           const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+                           bool &isActive,
+                           int &sub_call_two,
+                           int &sub_call_three,
+                           pair_hint *hint)
+    {
+        sub_funcs.clear();
+        for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+            if ((extensions.tet_functions >> funcIter) & 1){
+                sub_funcs.push_back(int(funcIter));
+            }
+        }
+        if (sub_funcs.empty()){
+            isActive = false;
+            return false;
+        }
+        for (int i = 0; i < 4; ++i){
+            sub_info[i].resize(sub_funcs.size());
+            for (size_t subIter = 0; subIter < sub_funcs.size(); subIter++){
+                sub_info[i][subIter] = tet_info[i][sub_funcs[subIter]];
+            }
+        }
+        if (mode == IA){
+            return critIA(pts, sub_info, sub_funcs.size(), threshold, curve_network, isActive, sub_call_two, sub_call_three, hint);
+        }
+        return critCSG(pts, sub_info, sub_funcs.size(), sub_csg_func, threshold, curve_network, isActive, sub_call_two, sub_call_three, hint);
+    };
+    /// The tets of IA and CSG are evaluated in batches (see `critIA_batch`). Culling takes precedence, as the tets of a batch would share the same functions.
+    const bool batched = options.batch_criteria && !culling && (mode == IA || mode == CSG);
+    pair_hint hint;
+    auto refine = [&](const auto &criterion)
+    {
+        adaptive_refine(criterion, alpha, max_elements, funcNum, func, grid, vertex_func_grad_map, tet_active_map, sub_call_two, sub_call_three, hint, extensions);
+    };
 
     {
         Timer timer(total_time, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
         
-        // Initialize priority queue.
-        grid.seq_foreach_tet([&](mtet::TetId tid, [[maybe_unused]] std::span<const mtet::VertexId, 4> vs)
-                             { push_longest_edge(tid); });
-        std::make_heap(Q.begin(), Q.end(), comp);
+        // Bulk uniform refinement without queue and criteria
+        if (options.uniform_depth != 0){
+            metric_list.uniform_depth = bulk_refine(mode, curve_network, threshold, alpha, max_elements, funcNum, options.uniform_depth, func, csg_func, grid, vertex_func_grad_map);
+            tet_active_map.reserve(grid.get_num_tets());
+        }
         
-        // Keep splitting the longest edge
-        while (!Q.empty())
-        {
-            std::pop_heap(Q.begin(), Q.end(), comp);
-            auto [edge_length, eid] = Q.back();
-            if (!grid.has_edge(eid)){
-                Q.pop_back();
-                continue;
+        if (options.num_threads > 1 && !gradient_free){
+            pipelined_refine(mode, curve_network, threshold, alpha, max_elements, funcNum, func, csg_func, options.num_threads, grid, vertex_func_grad_map, tet_active_map, sub_call_two, sub_call_three, hint.stats);
+        } else if (culling){
+            refine(culled_crit);
+        } else if (batched){
+            if (mode == IA){
+                refine(ia_batch_criterion{funcNum, threshold, curve_network});
+            } else {
+                refine(csg_batch_criterion{funcNum, csg_func, threshold, curve_network});
             }
-            //implement alpha value:
-            mtet::Scalar comp_edge_length = alpha * edge_length;
-            bool addedActive = false;
-            grid.foreach_tet_around_edge(eid,[&](mtet::TetId tid){
-                std::span<VertexId, 4> vs = grid.get_tet(tid);
-                if(/*vertex_active_map.contains(vertexHash(vs))*/tet_active_map.contains(vs)){
-                    if (tet_active_map[vs]){
-                        mtet::EdgeId longest_edge;
-                        mtet::Scalar longest_edge_length = 0;
-                        grid.foreach_edge_in_tet(tid, [&](mtet::EdgeId eid_active, mtet::VertexId v0, mtet::VertexId v1)
-                                                 {
-                            auto p0 = grid.get_vertex(v0);
-                            auto p1 = grid.get_vertex(v1);
-                            mtet::Scalar l = (p0[0] - p1[0]) * (p0[0] - p1[0]) + (p0[1] - p1[1]) * (p0[1] - p1[1]) +
-                            (p0[2] - p1[2]) * (p0[2] - p1[2]);
-                            if (l > longest_edge_length) {
-                                longest_edge_length = l;
-                                longest_edge = eid_active;
-                            }
-                        });
-                        if (longest_edge_length > comp_edge_length) {
-                            Q.emplace_back(longest_edge_length, longest_edge);
-                            addedActive = true;
-                        }
-                    }
-                }
-            });
-            if(addedActive){
-                std::push_heap(Q.begin(), Q.end(), comp);
-                continue;
-            }
-            Q.pop_back();
-            std::array<VertexId, 2> vs_old = grid.get_edge_vertices(eid);
-            //Timer split_timer(splitting, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
-            auto [vid, eid0, eid1] = grid.split_edge(eid);
-            //split_timer.Stop();
-            //std::cout << "Number of elements: " << mesh.get_num_tets() << std::endl;
-            if (grid.get_num_tets() > max_elements) {
-                break;
+        } else {
+            // the criterion of the modality chosen once
+            switch (mode){
+                case IA:
+                    refine(ia_criterion{funcNum, threshold, curve_network});
+                    break;
+                case MI:
+                    refine(mi_criterion{funcNum, threshold, curve_network, options.dominance_pruning});
+                    break;
+                case CSG:
+                    refine(csg_criterion{funcNum, csg_func, threshold, curve_network});
+                    break;
+                default:
+                    throw std::runtime_error("no implicit complexes specified");
             }
-            grid.foreach_tet_around_edge(eid0, [&](mtet::TetId tid)
-                                         {
-                if (push_longest_edge(tid)) {
-                    std::push_heap(Q.begin(), Q.end(), comp);
-                } });
-            grid.foreach_tet_around_edge(eid1, [&](mtet::TetId tid)
-                                         {
-                if (push_longest_edge(tid)) {
-                    std::push_heap(Q.begin(), Q.end(), comp);
-                } });
         }
         timer.Stop();
     }
     
+    collect_metrics(grid, tet_active_map, metric_list);
+    metric_list.two_func_check = sub_call_two;
+    metric_list.three_func_check = sub_call_three;
+    metric_list.two_func_skipped = hint.skipped_two;
+    metric_list.three_func_skipped = hint.skipped_three;
+    metric_list.crit_branches = hint.stats;
+    if (samples){
+        metric_list.midpoint_evaluations = samples->evaluations();
+    }
+    metric_list.vertex_func_grad_map = vertex_func_grad_map;
+    //profiled time(see details in time.h) and profiled number of calls to zero
+    std::cout << time_label[0] << ": " << profileTimer[0] << std::endl;
+    return true;
+}
+
+void collect_metrics(mtet::MTetMesh &grid,
+                     tetActive &tet_active_map,
+                     tet_metric &metric_list)
+{
     std::vector<mtet::TetId> activeTetId;
     grid.seq_foreach_tet([&](mtet::TetId tid, std::span<const VertexId, 4> data) {
         std::span<VertexId, 4> vs = grid.get_tet(tid);
@@ -222,11 +1103,141 @@ bool gridRefine(
         }
     });
     metric_list.total_tet = grid.get_num_tets();
-    metric_list.two_func_check = sub_call_two;
-    metric_list.three_func_check = sub_call_three;
-    metric_list.vertex_func_grad_map = vertex_func_grad_map;
     metric_list.activeTetId = activeTetId;
-    //profiled time(see details in time.h) and profiled number of calls to zero
-    std::cout << time_label[0] << ": " << profileTimer[0] << std::endl;
+}
+
+void midpoint_samples::replace_gradients(const Eigen::Matrix<double, 4, 3> &pts,
+                                         std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+                                         const size_t funcNum)
+{
+    const uint32_t functions = funcNum < 32 ? m_functions & ((uint32_t(1) << funcNum) - 1) : m_functions;
+    if (!functions){
+        return;
+    }
+    /// the midpoints of the 6 edges, at the coordinates of `mtet::MTetMesh::split_edge`
+    std::array<std::array<Scalar, 3>, 6> keys;
+    for (size_t e = 0; e < tet_edges.size(); e++){
+        const int v0 = tet_edges[e][0], v1 = tet_edges[e][1];
+        keys[e] = {(pts(v0, 0) + pts(v1, 0)) / 2, (pts(v0, 1) + pts(v1, 1)) / 2, (pts(v0, 2) + pts(v1, 2)) / 2};
+        auto [it, inserted] = m_values.try_emplace(keys[e]);
+        if (inserted){
+            it->second.resize(funcNum);
+            for (uint32_t rest = functions; rest; rest &= rest - 1){
+                const int funcIter = std::countr_zero(rest);
+                it->second[funcIter] = m_value_func(keys[e], funcIter);
+                m_evaluations++;
+            }
+        }
+    }
+    /// the values are looked up once all are inserted, as an insertion may move the others
+    std::array<const llvm_vecsmall::SmallVector<double, 20> *, 6> mid;
+    for (size_t e = 0; e < tet_edges.size(); e++){
+        mid[e] = &m_values.find(keys[e])->second;
+    }
+    for (int i = 0; i < 4; i++){
+        /// the edges from vertex `i`: the directional derivative of the quadratic interpolation along edge `i`-`j` at `i` is `4 f(mid) - 3 f(i) - f(j)`
+        std::array<int, 3> others{}, edges{};
+        int n = 0;
+        for (size_t e = 0; e < tet_edges.size(); e++){
+            if (tet_edges[e][0] == i || tet_edges[e][1] == i){
+                others[n] = tet_edges[e][0] == i ? tet_edges[e][1] : tet_edges[e][0];
+                edges[n++] = int(e);
+            }
+        }
+        const Eigen::RowVector3d e0 = pts.row(others[0]) - pts.row(i), e1 = pts.row(others[1]) - pts.row(i), e2 = pts.row(others[2]) - pts.row(i);
+        /// the rows of the inverse of the matrix with rows e0, e1, e2, scaled by its determinant
+        const Eigen::RowVector3d c0 = e1.cross(e2), c1 = e2.cross(e0), c2 = e0.cross(e1);
+        const double det = e0.dot(c0);
+        for (uint32_t rest = functions; rest; rest &= rest - 1){
+            const int funcIter = std::countr_zero(rest);
+            const double fi = tet_info[i][funcIter][0];
+            const double d0 = 4 * (*mid[edges[0]])[funcIter] - 3 * fi - tet_info[others[0]][funcIter][0];
+            const double d1 = 4 * (*mid[edges[1]])[funcIter] - 3 * fi - tet_info[others[1]][funcIter][0];
+            const double d2 = 4 * (*mid[edges[2]])[funcIter] - 3 * fi - tet_info[others[2]][funcIter][0];
+            tet_info[i][funcIter].tail<3>() = (d0 * c0 + d1 * c1 + d2 * c2) / det;
+        }
+    }
+}
+
+llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> midpoint_samples::split_vertex(std::span<const Scalar, 3> data,
+                                                                                 const size_t funcNum,
+                                                                                 const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> &func)
+{
+    const uint32_t all = funcNum < 32 ? (uint32_t(1) << funcNum) - 1 : ~uint32_t(0);
+    const uint32_t functions = m_functions & all;
+    const uint32_t with_gradients = all & ~functions;
+    llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> eval;
+    if (!with_gradients){
+        eval.resize(funcNum);
+    } else if (m_masked_func){
+        eval = m_masked_func(data, with_gradients);
+    } else {
+        eval = func(data, funcNum);
+    }
+    auto it = m_values.find({data[0], data[1], data[2]});
+    for (uint32_t rest = functions; rest; rest &= rest - 1){
+        const int funcIter = std::countr_zero(rest);
+        double value;
+        if (it != m_values.end()){
+            value = it->second[funcIter];
+        } else {
+            value = m_value_func(data, funcIter);
+            m_evaluations++;
+        }
+        eval[funcIter] = Eigen::RowVector4d(value, 0, 0, 0);
+    }
+    if (it != m_values.end()){
+        m_values.erase(it);
+    }
+    return eval;
+}
+
+llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> coordinate_cache::operator()(std::span<const Scalar, 3> data, size_t funcNum)
+{
+    const std::array<Scalar, 3> key = {data[0], data[1], data[2]};
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        auto it = m_values.find(key);
+        if (it != m_values.end()){
+            m_hits++;
+            return it->second;
+        }
+    }
+    m_misses++;
+    llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> eval = m_func(data, funcNum);
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_values.try_emplace(key, eval);
+    return eval;
+}
+
+bool gridRefineMulti(
+                     const std::vector<int> &modes,
+                     const bool curve_network,
+                     const double threshold,
+                     const double alpha,
+                     const int max_elements,
+                     const size_t funcNum,
+                     const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> func,
+                     const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func,
+                     const mtet::MTetMesh &grid,
+                     std::vector<mtet::MTetMesh> &grids,
+                     std::vector<tet_metric> &metric_lists,
+                     std::vector<std::array<double, timer_amount>> &profileTimers,
+                     const refine_options &options
+                     )
+{
+    coordinate_cache cache(func);
+    auto cached_func = [&](std::span<const Scalar, 3> data, size_t funcNum){
+        return cache(data, funcNum);
+    };
+    grids.assign(modes.size(), grid);
+    metric_lists.assign(modes.size(), tet_metric());
+    profileTimers.assign(modes.size(), std::array<double, timer_amount>{});
+    for (size_t i = 0; i < modes.size(); i++){
+        if (!gridRefine(modes[i], curve_network, threshold, alpha, max_elements, funcNum, cached_func, csg_func, grids[i], metric_lists[i], profileTimers[i], options)){
+            return false;
+        }
+    }
+    std::cout << "function evaluations: " << cache.misses() << ", reused: " << cache.hits() << std::endl;
     return true;
 }
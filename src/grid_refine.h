@@ -7,12 +7,17 @@
 
 #pragma once
 
+#include <atomic>
+#include <shared_mutex>
 #include "SmallVector.h"
 #include "3rd/implicit_functions/ImplicitFunction.h"
 
 #include "adaptive_grid_gen.h"
+#include "function_index.h"
+#include "grid_mesh.h"
 #include "io_ad.h"
 #include "refine_crit.h"
+#include "refine_criterion.h"
 #include "tet_quality.h"
 
 using namespace mtet;
@@ -41,6 +46,303 @@ struct TetEqual
     }
 };
 
+/// Hash a vertex coordinate by its bits. Bisections of the same edge compute identical midpoints, so equal coordinates are compared exactly.
+struct CoordHash
+{
+    using is_avalanching = void;
+    auto operator()(std::array<Scalar, 3> const& x) const noexcept -> uint64_t {
+        return ankerl::unordered_dense::detail::wyhash::hash(x.data(), sizeof(Scalar) * 3);
+    }
+};
+
+/// Hash a tet by its sorted vertex ids. Unlike `TetHash`, the key doesn't refer to the mesh, so it stays valid after the tet is split.
+struct SortedTetHash
+{
+    using is_avalanching = void;
+    auto operator()(std::array<uint64_t, 4> const& x) const noexcept -> uint64_t {
+        return ankerl::unordered_dense::detail::wyhash::hash(x.data(), sizeof(uint64_t) * 4);
+    }
+};
+
+/// A cache of function values and gradients keyed by vertex coordinates. It can be shared by the refinements of several modalities on the same functions,
+/// as the same vertex gets different ids in different grids. It's safe to use from multiple threads.
+class coordinate_cache
+{
+public:
+    /// @param[in] func         The function evaluator to cache, see `gridRefine`.
+    coordinate_cache(const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> func) : m_func(func) {}
+    
+    /// Returns the cached evaluation of `data`, or evaluates and caches it.
+    llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> operator()(std::span<const Scalar, 3> data, size_t funcNum);
+    
+    /// The number of evaluations served from the cache.
+    size_t hits() const { return m_hits; }
+    /// The number of evaluations of the wrapped function.
+    size_t misses() const { return m_misses; }
+    
+private:
+    std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> m_func;
+    ankerl::unordered_dense::map<std::array<Scalar, 3>, llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>, CoordHash> m_values;
+    std::shared_mutex m_mutex;
+    std::atomic<size_t> m_hits = 0;
+    std::atomic<size_t> m_misses = 0;
+};
+
+/// The values of the functions at the midpoints of the edges of a grid, which stand in for the gradients of the functions that have none (see `refine_options::gradient_free`).
+/// The gradient of such a function at a vertex of a tet is replaced by the gradient of the quadratic interpolation of its values at the vertices and the edge midpoints of the tet,
+/// which agrees with the function along the edges. The bezier values of `bezierConstruct` are then exact for quadratic functions, as they are with the true gradients,
+/// but this is an approximation otherwise: the error of the interpolation isn't bounded, so a tet may miss a zero crossing that the true gradients would find.
+/// Only the values of the functions without gradients are evaluated at a midpoint, once for all the tets around its edge, and they're kept until the edge is split.
+class midpoint_samples
+{
+public:
+    /// @param[in] functions            The bitset of the functions without gradients.
+    /// @param[in] value_func           The value of one function at a point, see `refine_options::value_func`.
+    /// @param[in] masked_func          The values and gradients of the functions of a bitset at a point, see `refine_options::masked_func`. It may be empty.
+    midpoint_samples(uint32_t functions,
+                     const std::function<double(std::span<const Scalar, 3>, size_t)> &value_func,
+                     const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, uint32_t)> &masked_func)
+    : m_functions(functions), m_value_func(value_func), m_masked_func(masked_func) {}
+    
+    /// Replaces the gradients of the functions without gradients in `tet_info` by those of their quadratic interpolations along the edges of the tet.
+    /// The parameters follow `critIA`.
+    void replace_gradients(const Eigen::Matrix<double, 4, 3> &pts,
+                           std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+                           const size_t funcNum);
+    
+    /// Evaluates the new vertex of a split edge, which is at the midpoint of the edge. The functions without gradients take the values sampled there,
+    /// whose entry is then erased as the edge is gone, and zero gradients, which `replace_gradients` replaces in every tet. The other functions are evaluated
+    /// by `masked_func` with the functions without gradients masked out, or by `func` if it's empty; nothing is evaluated if all functions lack gradients.
+    ///
+    /// @param[in] data         The coordinates of the new vertex.
+    /// @param[in] funcNum, func            See `gridRefine`.
+    ///
+    /// @return         The values and gradients of all the functions at the vertex.
+    llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> split_vertex(std::span<const Scalar, 3> data,
+                                                                   const size_t funcNum,
+                                                                   const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> &func);
+    
+    /// The number of function values evaluated at midpoints.
+    size_t evaluations() const { return m_evaluations; }
+    
+private:
+    uint32_t m_functions;
+    std::function<double(std::span<const Scalar, 3>, size_t)> m_value_func;
+    std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, uint32_t)> m_masked_func;
+    /// the values at a midpoint, indexed by function; only the functions of `m_functions` are set
+    ankerl::unordered_dense::map<std::array<Scalar, 3>, llvm_vecsmall::SmallVector<double, 20>, CoordHash> m_values;
+    size_t m_evaluations = 0;
+};
+
+/// hash for mounting a boolean that represents the activeness to a tet
+using tetActive = ankerl::unordered_dense::map<std::span<VertexId, 4>, bool, TetHash, TetEqual>;
+
+/// Optional settings of `gridRefine`. The default values reproduce the plain adaptive refinement.
+struct refine_options
+{
+    /// The number of times every edge of the initial grid is halved by a bulk uniform refinement before the adaptive loop starts.
+    /// 0 disables the bulk phase, a negative value lets `estimate_uniform_depth` choose the depth.
+    /// The bulk phase evaluates `func` and `csg_func` in parallel, so they have to be thread-safe when this is enabled.
+    int uniform_depth = 0;
+    /// The number of worker threads evaluating functions and criteria. With more than one thread the adaptive loop is pipelined (see `pipelined_refine`).
+    int num_threads = 1;
+    /// Whether the single-threaded loop evaluates the IA and CSG criteria on batches of tets (see `critIA_batch`). The results are the same either way.
+    bool batch_criteria = true;
+    /// An index over the zero sets of the functions built from the same functions as `func`. If it's set, the single-threaded loop of IA and CSG
+    /// evaluates a new vertex only for the functions whose zero set may cross one of its tets, and checks a tet only for the functions
+    /// whose zero set may cross its bounding box. The other functions get the `function_index::placeholder` of their sign.
+    /// The values of culled functions in `tet_metric::vertex_func_grad_map` are these placeholders. It takes precedence over `batch_criteria`,
+    /// and it's ignored for MI and by the pipelined loop.
+    const function_index *culling = nullptr;
+    /// Whether the single-threaded loop of IA and CSG passes the pairs of functions whose zero-crossing test failed in a tet to its children,
+    /// which skip these pairs (see `pair_hint`). The tests are conservative approximations on each tet, so a pair that failed in the parent
+    /// could pass in a child, and the grid may differ slightly. It's ignored together with `culling`.
+    bool pair_hints = false;
+    /// Whether the single-threaded loop of MI discards the materials that are below another material at all bezier control points of a tet
+    /// before checking its pairs, triples and quadruples (see the `dominance` of `critMI`). The crossings of materials below the maximum then no longer
+    /// refine the grid, so it's coarser away from the interfaces.
+    bool dominance_pruning = false;
+    /// The bitset of the functions whose gradients aren't evaluated, e.g., black-box functions or shaders with costly finite differences. Their gradients returned by `func`
+    /// are ignored, and the single-threaded loop approximates them by the values at the edge midpoints of every tet instead (see `midpoint_samples`). The grid is then only
+    /// as fine as this approximation: it's exact for quadratic functions, but no error bound is kept, so it may differ from the grid refined with the true gradients.
+    /// The bulk phase bounds the functions by their gradients, so it can't be combined with them, the pipelined loop isn't used, and they're ignored together with `culling`,
+    /// which evaluates the gradients itself. It needs `value_func`.
+    uint32_t gradient_free = 0;
+    /// The value of the function `funcIter` at a point, which samples the functions of `gradient_free` at the edge midpoints.
+    std::function<double(std::span<const Scalar, 3> data, size_t funcIter)> value_func;
+    /// Optional values and gradients of the functions of the bitset `mask` at a point, with any values for the other functions, as `function_index::evaluate`.
+    /// With `gradient_free`, a new vertex at an edge midpoint is evaluated by it without the functions of `gradient_free`, whose values were sampled there;
+    /// otherwise `func` evaluates them again.
+    std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3> data, uint32_t mask)> masked_func;
+};
+
+/// Runs the refinement criteria of the given modality (`critIA`, `critCSG` or `critMI`) on one tet. The parameters follow `critCSG`.
+/// `hint` only tracks the skipped checks and the branches of the criteria.
+///
+/// @return         A `bool` represents whether the tet is "refinable".
+bool evaluate_crit(
+                   const int mode,
+                   const Eigen::Matrix<double, 4, 3> &pts,
+                   const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+                   const size_t funcNum,
+                   const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> &csg_func,
+                   const double threshold,
+                   const bool curve_network,
+                   bool &active,
+                   int &sub_call_two,
+                   int &sub_call_three,
+                   pair_hint *hint = nullptr
+                   );
+
+/// Estimates how many times every edge of the initial grid can be halved before the refinement criteria could pass in the refined region.
+/// It's a heuristic, not a bound: it assumes that the distance error of a linear interpolation scales with the squared edge length, so that a tet
+/// whose edges are halved k times is refinable if it fails the criteria under the threshold `threshold * 4^k`. The depth is the smallest one over
+/// the initial tets that the criteria refine; the tets they don't refine, e.g., in empty space, don't bound it as `bulk_refine` doesn't split them.
+///
+/// @param[in] mode, curve_network, threshold, funcNum, csg_func            See `gridRefine`.
+/// @param[in] max_elements         The depth is capped so that the uniform grid does not exceed this number of tets.
+/// @param[in] vertex_func_grad_map         The values and gradients of all the vertices of `grid`.
+/// @param[in] grid         The initial grid.
+///
+/// @return         The number of uniform halvings of the initial edges.
+int estimate_uniform_depth(
+                           const int mode,
+                           const bool curve_network,
+                           const double threshold,
+                           const int max_elements,
+                           const size_t funcNum,
+                           const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func,
+                           const IndexMap &vertex_func_grad_map,
+                           const mtet::MTetMesh &grid
+                           );
+
+/// Runs the criteria on the given tets in parallel and appends the refinable ones to `refinable`, in the order of `tets`.
+///
+/// @param[in] mode, curve_network, threshold, funcNum, csg_func          See `gridRefine`. `csg_func` is called concurrently.
+/// @param[in] vertex_func_grad_map         The values and gradients of all the vertices of `grid`.
+/// @param[in] grid         The grid containing the tets.
+/// @param[in] tets         The tets to check.
+/// @param[out] refinable           The refinable tets are appended to it.
+void collect_refinable_tets(
+                            const int mode,
+                            const bool curve_network,
+                            const double threshold,
+                            const size_t funcNum,
+                            const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func,
+                            const IndexMap &vertex_func_grad_map,
+                            const mtet::MTetMesh &grid,
+                            std::span<const mtet::TetId> tets,
+                            std::vector<mtet::TetId> &refinable
+                            );
+
+/// Uniformly refines the grid by longest edge bisection until no edge is longer than `max_edge_length`.
+/// Each pass gathers the longest edges of all tets in parallel and splits them from the longest to the shortest; no criteria are evaluated.
+///
+/// @param[in] max_edge_length          The bound of the edge length after the refinement.
+/// @param[out] grid            The refined grid.
+void uniform_refine(const mtet::Scalar max_edge_length, mtet::MTetMesh &grid);
+
+/// Evaluates all the vertices of the grid that are not in `vertex_func_grad_map` yet in one parallel batch.
+///
+/// @param[in] funcNum, func            See `gridRefine`. `func` is called concurrently.
+/// @param[in] grid         The grid whose vertices are evaluated.
+/// @param[out] vertex_func_grad_map            The map from vertex index to the values and gradients of the vertex.
+void evaluate_vertices(
+                       const size_t funcNum,
+                       const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> func,
+                       const mtet::MTetMesh &grid,
+                       IndexMap &vertex_func_grad_map
+                       );
+
+/// The bulk phase before the adaptive refinement. It refines the grid level by level without a queue, and evaluates the new vertices of every pass in one parallel batch.
+/// With a positive depth, every level halves all the edges without any criteria. With a negative depth, a level only splits the tets that the criteria refine,
+/// longest edge first, until none of them has an edge longer than the bound of the level. The criteria of the new tets are evaluated in parallel after each pass.
+/// As the adaptive loop would split the same tets, the grid is the one of the plain adaptive refinement; only the tets with shorter edges are left to it.
+///
+/// @param[in] mode, curve_network, threshold, alpha, max_elements, funcNum, func, csg_func            See `gridRefine`.
+/// @param[in] depth            The number of levels. If it's negative, the depth is bounded by `estimate_uniform_depth` and the refinement stops at the first level
+///                             that splits no tet. It's then skipped with a finite `alpha`, whose deferral needs the activeness of the tets while they're split.
+/// @param[out] grid            The refined grid.
+/// @param[out] vertex_func_grad_map            The values and gradients of all the vertices of `grid`.
+///
+/// @return         The number of levels performed.
+int bulk_refine(
+                const int mode,
+                const bool curve_network,
+                const double threshold,
+                const double alpha,
+                const int max_elements,
+                const size_t funcNum,
+                const int depth,
+                const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> func,
+                const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func,
+                mtet::MTetMesh &grid,
+                IndexMap &vertex_func_grad_map
+                );
+
+/// The adaptive loop of `gridRefine` with the function evaluations and the criteria running on worker threads.
+/// The calling thread owns the mesh: it pops the heap and splits edges, and sends the tets around every split edge to the workers as one batch,
+/// so the new vertex is evaluated once. The workers send back whether each tet is refinable and active, and a result is only applied if its tet still exists.
+/// The heap is popped while results are still pending, hence the split order depends on thread timing and the grid may differ slightly between runs,
+/// though every remaining tet passes the criteria when the loop finishes.
+///
+/// @param[in] mode, curve_network, threshold, alpha, max_elements, funcNum, func, csg_func           See `gridRefine`. `func` and `csg_func` are called concurrently.
+/// @param[in] num_threads          The number of worker threads.
+/// @param[out] grid            The refined grid.
+/// @param[out] vertex_func_grad_map            The values and gradients of the vertices. It's shared among the workers.
+/// @param[out] tet_active_map          The activeness of the evaluated tets.
+/// @param[out] sub_call_two            A tracker of how many times two functions' distance check is called.
+/// @param[out] sub_call_three          A tracker of how many times three functions' distance check is called.
+/// @param[out] stats           The branches taken by the criteria, counted by every worker and added up when it finishes.
+void pipelined_refine(
+                      const int mode,
+                      const bool curve_network,
+                      const double threshold,
+                      const double alpha,
+                      const int max_elements,
+                      const size_t funcNum,
+                      const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> func,
+                      const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func,
+                      const int num_threads,
+                      mtet::MTetMesh &grid,
+                      IndexMap &vertex_func_grad_map,
+                      tetActive &tet_active_map,
+                      int &sub_call_two,
+                      int &sub_call_three,
+                      crit_stats &stats
+                      );
+
+/// The initial grid picked by `choose_initial_grid`.
+struct grid_choice
+{
+    std::array<size_t, 3> resolution;
+    grid_mesh::GridStyle style;
+    /// The estimated work relative to the work of one tet in the initial grid.
+    double cost;
+};
+
+/// Picks the resolution and the style of the initial grid for `grid_mesh::generate_tet_mesh` that minimizes the expected work of `gridRefine`.
+/// Candidates are grids of resolution 1, 2, 4, 8, 16 along the longest side of the bounding box in both styles. Their vertices are sampled and their tets are
+/// checked with the criteria. The finest one serves as the lattice that locates the complex at every scale. On a strided sample of about 512 of its tets,
+/// the number of halvings each refinable tet needs for `threshold` is probed, and their average estimates the edge length the refinement reaches on average. A candidate is rejected if it misses a lattice cell that contains the complex.
+/// The tet count of each style after every level of uniform refinement is calibrated on a single cell. The work of a candidate is then
+/// its initial tets plus, for every finer level, the tets inside the part that contains the complex, weighted by the higher cost of adaptive splits.
+///
+/// @param[in] mode, curve_network, threshold, funcNum, func, csg_func          See `gridRefine`. `func` is called concurrently.
+/// @param[in] bbox_min, bbox_max          The bounding box of the grid. It must have a positive, finite extent along every axis.
+///
+/// @return         The chosen resolution and style.
+grid_choice choose_initial_grid(
+                                const int mode,
+                                const bool curve_network,
+                                const double threshold,
+                                const size_t funcNum,
+                                const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> func,
+                                const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func,
+                                const std::array<double, 3> &bbox_min,
+                                const std::array<double, 3> &bbox_max
+                                );
+
 /// The main function for adaptively refine an initial grid based on a set of input implicit functions. The result forms an adaptive background grid for the given implicit complexes (check paper for details: https://dl.acm.org/doi/10.1145/3658215)
 ///
 /// @param[in] mode         The modality of the implicit complex, including Implicit Arrangement(IA), Contructive Solid Geometry(CSG), Material Interface(MI).
@@ -55,6 +357,7 @@ struct TetEqual
 /// @param[out] grid            The final adaptive grid.
 /// @param[out] metric_list         The tet metrics, see `io.h` for the detail.
 /// @param[out] profileTimer            The timer's profile, see `timer.h` for detail.
+/// @param[in] options          Optional settings, see `refine_options`.
 ///
 ///@return          Whether this function successfully proceeds.
 bool gridRefine(
@@ -68,5 +371,278 @@ bool gridRefine(
                 const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func,
                 mtet::MTetMesh &grid,
                 tet_metric &metric_list,
-                std::array<double, timer_amount> profileTimer
+                std::array<double, timer_amount> profileTimer,
+                const refine_options &options = refine_options()
                 );
+
+/// Refines one grid per modality from the same initial grid and functions, sharing a `coordinate_cache` among them.
+/// The vertices created by the same bisections in different refinements land at identical coordinates, so each of them is evaluated once.
+///
+/// @param[in] modes            The modalities to refine for, see `geo_obj`.
+/// @param[in] curve_network, threshold, alpha, max_elements, funcNum, func, csg_func, options          See `gridRefine`. They're the same for all modalities.
+/// @param[in] grid         The initial grid. It's copied for every modality.
+/// @param[out] grids           The final adaptive grid of every modality, in the order of `modes`.
+/// @param[out] metric_lists            The tet metrics of every modality.
+/// @param[out] profileTimers           The timer's profile of every modality.
+///
+///@return          Whether all the refinements successfully proceed.
+bool gridRefineMulti(
+                     const std::vector<int> &modes,
+                     const bool curve_network,
+                     const double threshold,
+                     const double alpha,
+                     const int max_elements,
+                     const size_t funcNum,
+                     const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> func,
+                     const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func,
+                     const mtet::MTetMesh &grid,
+                     std::vector<mtet::MTetMesh> &grids,
+                     std::vector<tet_metric> &metric_lists,
+                     std::vector<std::array<double, timer_amount>> &profileTimers,
+                     const refine_options &options = refine_options()
+                     );
+
+/// Collects the tet metrics of a refined grid: the tet counts, the radius ratios, and the active tets.
+///
+/// @param[in] grid         The refined grid.
+/// @param[in] tet_active_map           The activeness of the evaluated tets.
+/// @param[out] metric_list         The tet metrics. The trackers of the checks are left to the caller.
+void collect_metrics(mtet::MTetMesh &grid,
+                     tetActive &tet_active_map,
+                     tet_metric &metric_list);
+
+/// The longest edge of a tet.
+///
+/// @return         The squared length of the edge and its id.
+inline std::pair<mtet::Scalar, mtet::EdgeId> longest_tet_edge(mtet::MTetMesh &grid, mtet::TetId tid)
+{
+    mtet::EdgeId longest_edge;
+    mtet::Scalar longest_edge_length = 0;
+    grid.foreach_edge_in_tet(tid, [&](mtet::EdgeId eid, mtet::VertexId v0, mtet::VertexId v1)
+                             {
+        auto p0 = grid.get_vertex(v0);
+        auto p1 = grid.get_vertex(v1);
+        mtet::Scalar l = (p0[0] - p1[0]) * (p0[0] - p1[0]) + (p0[1] - p1[1]) * (p0[1] - p1[1]) +
+        (p0[2] - p1[2]) * (p0[2] - p1[2]);
+        if (l > longest_edge_length) {
+            longest_edge_length = l;
+            longest_edge = eid;
+        } });
+    return {longest_edge_length, longest_edge};
+}
+
+/// The hooks of `adaptive_refine`, which extend the loop by the vertex ids of its tets, e.g., to pass data from a tet to its children. These do nothing;
+/// `gridRefine` passes its own for the pair hints, the culling and the midpoint samples of `refine_options`.
+struct no_refine_hooks
+{
+    /// Called with a tet loaded into `pts` and `tet_info` before its criterion, which is called with `hint`. It may change `tet_info` and `hint`.
+    void before_criterion(std::span<const mtet::VertexId, 4> /*vs*/,
+                          const Eigen::Matrix<double, 4, 3> &/*pts*/,
+                          std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &/*tet_info*/,
+                          pair_hint &/*hint*/) {}
+    /// Called after the criterion of a tet, with the hint it was called with and whether the tet is refinable.
+    void after_criterion(std::span<const mtet::VertexId, 4> /*vs*/, const pair_hint &/*hint*/, bool /*refinable*/) {}
+    /// Called before the edge `eid` is split.
+    void before_split(mtet::EdgeId /*eid*/) {}
+    /// Called after an edge is split at the new vertex `vid` into `eid0` and `eid1`, before the tets around `vid` are evaluated.
+    void after_split(mtet::VertexId /*vid*/, mtet::EdgeId /*eid0*/, mtet::EdgeId /*eid1*/) {}
+};
+
+/// The single-threaded adaptive loop of `gridRefine` on a refinement criterion. The longest edge of every refinable tet is queued, and the longest edge in the queue is split
+/// unless an active tet around it has a longer edge (scaled by `alpha`), whose edge is queued first. The criterion is a template parameter, so it's called without any indirection.
+/// A batched criterion is called once `crit_batch_width` tets are collected, and on the rest of the tets around a split edge; the grid is the same as with its per-tet criterion.
+///
+/// @param[in] criterion            The refinement criterion, see `refinement_criterion` and `batched_refinement_criterion`.
+/// @param[in] alpha, max_elements, funcNum, func           See `gridRefine`.
+/// @param[out] grid            The refined grid.
+/// @param[in,out] vertex_func_grad_map         The values and gradients of the vertices. The vertices that aren't in it are evaluated by `func`.
+/// @param[out] tet_active_map          The activeness of the evaluated tets.
+/// @param[out] sub_call_two            A tracker of how many times two functions' distance check is called.
+/// @param[out] sub_call_three          A tracker of how many times three functions' distance check is called.
+/// @param[out] hint            The trackers of the skipped checks, passed to every call of the criterion. The hints of the tets of a batch are merged into it.
+/// @param[in,out] hooks            The hooks called on every tet and split, see `no_refine_hooks`.
+template <typename Criterion, typename Hooks = no_refine_hooks>
+requires refinement_criterion<Criterion> || batched_refinement_criterion<Criterion>
+void adaptive_refine(
+                     const Criterion &criterion,
+                     const double alpha,
+                     const int max_elements,
+                     const size_t funcNum,
+                     const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> &func,
+                     mtet::MTetMesh &grid,
+                     IndexMap &vertex_func_grad_map,
+                     tetActive &tet_active_map,
+                     int &sub_call_two,
+                     int &sub_call_three,
+                     pair_hint &hint,
+                     Hooks &&hooks = Hooks()
+                     )
+{
+    constexpr bool batched = batched_refinement_criterion<Criterion>;
+    auto comp = [](std::pair<mtet::Scalar, mtet::EdgeId> e0,
+                   std::pair<mtet::Scalar, mtet::EdgeId> e1)
+    { return e0.first < e1.first; };
+    std::vector<std::pair<mtet::Scalar, mtet::EdgeId>> Q;
+    auto heap_push = [&]()
+    {
+        std::push_heap(Q.begin(), Q.end(), comp);
+    };
+
+    Eigen::Matrix<double, 4, 3> pts;
+    std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info;
+    /// the tets of a batch, and their hints, which are kept from batch to batch
+    tet_batch batch;
+    std::array<mtet::TetId, crit_batch_width> batch_tets;
+    std::array<pair_hint, crit_batch_width> batch_hints;
+    /// runs the batched criterion on the collected tets and pushes the longest edges of the refinable ones, calling `pushed` after each
+    auto flush_batch = [&](auto &&pushed)
+    {
+        if constexpr (batched){
+            uint32_t active_mask = 0;
+            uint32_t refine_mask = criterion(batch, active_mask, sub_call_two, sub_call_three, batch_hints.data());
+            for (size_t l = 0; l < batch.size; l++){
+                std::span<VertexId, 4> vs = grid.get_tet(batch_tets[l]);
+                const bool refinable = (refine_mask >> l) & 1;
+                tet_active_map[vs] = (active_mask >> l) & 1;
+                hooks.after_criterion(vs, batch_hints[l], refinable);
+                if (refinable){
+                    Q.push_back(longest_tet_edge(grid, batch_tets[l]));
+                    pushed();
+                }
+            }
+            batch.size = 0;
+        }
+    };
+    /// runs the criterion on a tet, or collects it into the batch, and pushes its longest edge if it's refinable, calling `pushed` after it
+    auto evaluate_tet = [&](mtet::TetId tid, auto &&pushed)
+    {
+        std::span<VertexId, 4> vs = grid.get_tet(tid);
+        for (int i = 0; i < 4; ++i){
+            auto coords = grid.get_vertex(vs[i]);
+            pts.row(i) = Eigen::RowVector3d({coords[0], coords[1], coords[2]});
+            auto it = vertex_func_grad_map.find(value_of(vs[i]));
+            if (it == vertex_func_grad_map.end()){
+                it = vertex_func_grad_map.emplace(value_of(vs[i]), func(coords, funcNum)).first;
+            }
+            tet_info[i] = it->second;
+        }
+        if constexpr (batched){
+            hooks.before_criterion(vs, pts, tet_info, batch_hints[batch.size]);
+            batch.set(batch.size, pts, tet_info, funcNum);
+            batch_tets[batch.size++] = tid;
+            if (batch.size == crit_batch_width){
+                flush_batch(pushed);
+            }
+        } else {
+            hooks.before_criterion(vs, pts, tet_info, hint);
+            bool isActive = false;
+            bool subResult = criterion(pts, tet_info, isActive, sub_call_two, sub_call_three, &hint);
+            tet_active_map[vs] = isActive;
+            hooks.after_criterion(vs, hint, subResult);
+            if (subResult){
+                Q.push_back(longest_tet_edge(grid, tid));
+                pushed();
+            }
+        }
+    };
+
+    // Initialize priority queue.
+    grid.seq_foreach_tet([&](mtet::TetId tid, [[maybe_unused]] std::span<const mtet::VertexId, 4> vs)
+                         { evaluate_tet(tid, [](){}); });
+    flush_batch([](){});
+    std::make_heap(Q.begin(), Q.end(), comp);
+
+    // Keep splitting the longest edge
+    while (!Q.empty())
+    {
+        std::pop_heap(Q.begin(), Q.end(), comp);
+        auto [edge_length, eid] = Q.back();
+        if (!grid.has_edge(eid)){
+            Q.pop_back();
+            continue;
+        }
+        //implement alpha value:
+        mtet::Scalar comp_edge_length = alpha * edge_length;
+        bool addedActive = false;
+        grid.foreach_tet_around_edge(eid, [&](mtet::TetId tid){
+            auto it = tet_active_map.find(grid.get_tet(tid));
+            if (it != tet_active_map.end() && it->second){
+                std::pair<mtet::Scalar, mtet::EdgeId> longest_edge = longest_tet_edge(grid, tid);
+                if (longest_edge.first > comp_edge_length) {
+                    Q.push_back(longest_edge);
+                    addedActive = true;
+                }
+            }
+        });
+        if (addedActive){
+            heap_push();
+            continue;
+        }
+        Q.pop_back();
+        hooks.before_split(eid);
+        auto [vid, eid0, eid1] = grid.split_edge(eid);
+        if (grid.get_num_tets() > max_elements) {
+            break;
+        }
+        hooks.after_split(vid, eid0, eid1);
+        grid.foreach_tet_around_edge(eid0, [&](mtet::TetId tid)
+                                     { evaluate_tet(tid, heap_push); });
+        grid.foreach_tet_around_edge(eid1, [&](mtet::TetId tid)
+                                     { evaluate_tet(tid, heap_push); });
+        flush_batch(heap_push);
+    }
+    if constexpr (batched){
+        for (const pair_hint &batch_hint : batch_hints){
+            hint.skipped_two += batch_hint.skipped_two;
+            hint.skipped_three += batch_hint.skipped_three;
+            hint.stats.merge(batch_hint.stats);
+        }
+    }
+}
+
+/// `gridRefine` on any refinement criterion, e.g., `zero_crossing_criterion` or a criterion defined by the caller, instead of the criteria of a modality.
+/// It runs the single-threaded adaptive loop (see `adaptive_refine`) without the settings of `refine_options`.
+///
+/// @param[in] criterion            The refinement criterion, see `refinement_criterion`.
+/// @param[in] alpha, max_elements, funcNum, func           See `gridRefine`.
+/// @param[out] grid            The final adaptive grid.
+/// @param[out] metric_list         The tet metrics, see `io.h` for the detail.
+/// @param[out] profileTimer            The timer's profile, see `timer.h` for detail.
+///
+///@return          Whether this function successfully proceeds.
+template <refinement_criterion Criterion>
+bool gridRefine(
+                const Criterion &criterion,
+                const double alpha,
+                const int max_elements,
+                const size_t funcNum,
+                const std::function<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>(std::span<const Scalar, 3>, size_t)> func,
+                mtet::MTetMesh &grid,
+                tet_metric &metric_list,
+                std::array<double, timer_amount> profileTimer
+                )
+{
+    int sub_call_two = 0;
+    int sub_call_three = 0;
+    pair_hint hint;
+    IndexMap vertex_func_grad_map;
+    vertex_func_grad_map.reserve(grid.get_num_vertices());
+    tetActive tet_active_map;
+    tet_active_map.reserve(grid.get_num_tets());
+    {
+        Timer timer(total_time, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
+        grid.seq_foreach_vertex([&](VertexId vid, std::span<const Scalar, 3> data)
+                                {vertex_func_grad_map[value_of(vid)] = func(data, funcNum);});
+        adaptive_refine(criterion, alpha, max_elements, funcNum, func, grid, vertex_func_grad_map, tet_active_map, sub_call_two, sub_call_three, hint);
+        timer.Stop();
+    }
+    collect_metrics(grid, tet_active_map, metric_list);
+    metric_list.two_func_check = sub_call_two;
+    metric_list.three_func_check = sub_call_three;
+    metric_list.two_func_skipped = hint.skipped_two;
+    metric_list.three_func_skipped = hint.skipped_three;
+    metric_list.crit_branches = hint.stats;
+    metric_list.vertex_func_grad_map = std::move(vertex_func_grad_map);
+    std::cout << time_label[0] << ": " << profileTimer[0] << std::endl;
+    return true;
+}
@@ -22,6 +22,12 @@ int test_ad(int argc, const char *argv[])
         bool dfs = false;
         bool curve_network = false;
         bool discretize_later = false;
+        int uniform_depth = 0;
+        int num_threads = 1;
+        bool auto_grid = false;
+        bool cull = false;
+        bool pair_hints = false;
+        bool dominance_pruning = false;
         //bool analysis_mode = false;
     } args;
     CLI::App app{"Longest Edge Bisection Refinement"};
@@ -35,6 +41,12 @@ int test_ad(int argc, const char *argv[])
     app.add_option("-s,--shortest-edge", args.smallest_edge_length, "Shortest edge length");
     app.add_option("-d,--discretize", args.discretize_later, "Save the grid file and function values for discretizing them later");
     app.add_option("-c, --curve_network", args.curve_network, "Generate Curve Network only");
+    app.add_option("-u,--uniform-depth", args.uniform_depth, "Levels of uniform refinement before the adaptive refinement (negative: estimate)");
+    app.add_option("-j,--threads", args.num_threads, "Number of worker threads evaluating the refinement criteria");
+    app.add_flag("--auto-grid", args.auto_grid, "Replace the initial grid by a generated grid over its bounding box with automatically chosen resolution and style");
+    app.add_flag("--cull", args.cull, "Skip the functions whose zero set is far from a tet (IA and CSG)");
+    app.add_flag("--pair-hints", args.pair_hints, "Skip the pairs of functions whose zero-crossing test failed in the parent tet (IA and CSG)");
+    app.add_flag("--dominance", args.dominance_pruning, "Skip the materials that are below another material in the whole tet (MI)");
     CLI11_PARSE(app, argc, argv);
     // Read initial grid
     mtet::MTetMesh grid;
@@ -52,22 +64,39 @@ int test_ad(int argc, const char *argv[])
     std::string function_file = args.function_file;
     double threshold = args.threshold;
     int mode;
-    llvm_vecsmall::SmallVector<csg_unit, 20> csg_tree = {};
+    /// the CSG tree compiled into a program, see `csg_program`
+    csg_program csg_tree;
     
-    if (args.method == "IA"){
-        mode = IA;
+    /// a comma separated list of modalities refines one grid for each of them with shared function evaluations
+    std::vector<std::string> methods;
+    std::stringstream method_stream(args.method);
+    for (std::string method; std::getline(method_stream, method, ',');){
+        methods.push_back(method);
     }
-    if (args.method == "CSG"){
-        mode = CSG;
-        load_csgTree(args.csg_file, csg_tree);
+    std::vector<int> modes;
+    for (const std::string &method : methods){
+        if (method == "IA"){
+            modes.push_back(IA);
+        }
+        if (method == "CSG"){
+            modes.push_back(CSG);
+            if (args.csg_file != "" && !load_csgTree(args.csg_file, csg_tree)){
+                throw std::runtime_error("ERROR: can't load the csg file " + args.csg_file);
+            }
+        }
+        if (method == "MI"){
+            modes.push_back(MI);
+        }
     }
-    if (args.method == "MI"){
-        mode = MI;
+    if (modes.empty() || modes.size() != methods.size()){
+        throw std::runtime_error("ERROR: unknown implicit complex option " + args.method);
     }
+    mode = modes[0];
     
     /// Read implicit function
     std::vector<std::unique_ptr<ImplicitFunction<double>>> functions;
-    load_functions(function_file, functions);
+    std::vector<bool> gradient_free;
+    load_functions(function_file, functions, &gradient_free);
     const size_t funcNum = functions.size();
     
     ///
@@ -81,7 +110,11 @@ int test_ad(int argc, const char *argv[])
         for(size_t funcIter = 0; funcIter < funcNum; funcIter++){
             auto &func = functions[funcIter];
             Eigen::Vector4d eval;
-            eval[0] = func->evaluate_gradient(data[0], data[1], data[2], eval[1], eval[2], eval[3]);
+            if (gradient_free[funcIter]){
+                eval << func->evaluate(data[0], data[1], data[2]), 0, 0, 0;
+            } else {
+                eval[0] = func->evaluate_gradient(data[0], data[1], data[2], eval[1], eval[2], eval[3]);
+            }
             vertex_eval[funcIter] = eval;
         }
         return vertex_eval;
@@ -91,43 +124,103 @@ int test_ad(int argc, const char *argv[])
     /// the lambda function for csg tree iteration/evaluation.
     /// @param[in] funcInt          Given an input of value range std::array<double, 2> for an arbitrary number of functions
     /// @return   A value range of this CSG operation in a form of `std::array<double, 2>` and a list of active function in a form of    `llvm_vecsmall::SmallVector<int, 20>>`
+    /// It's the compiled program itself, which the criteria evaluate directly.
     ///
-    auto csg_func = [&](llvm_vecsmall::SmallVector<std::array<double, 2>, 20> funcInt){
-        if (args.csg_file == ""){
+    std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func = csg_tree;
+    if (args.csg_file == ""){
+        csg_func = [](llvm_vecsmall::SmallVector<std::array<double, 2>, 20> funcInt) -> std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>{
             throw std::runtime_error("ERROR: no csg file provided");
-            std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> null_csg = {{},{}};
-            return null_csg;
-        }else{
-            return iterTree(csg_tree, 1, funcInt);
-        }
-    };
+        };
+    }
+    
+    if (args.auto_grid){
+        std::array<double, 3> bbox_min = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max()};
+        std::array<double, 3> bbox_max = {std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
+        grid.seq_foreach_vertex([&](mtet::VertexId vid, std::span<const Scalar, 3> data){
+            for (int i = 0; i < 3; i++){
+                bbox_min[i] = std::min(bbox_min[i], data[i]);
+                bbox_max[i] = std::max(bbox_max[i], data[i]);
+            }
+        });
+        grid_choice choice = choose_initial_grid(mode, args.curve_network, args.threshold, funcNum, implicit_func, csg_func, bbox_min, bbox_max);
+        std::cout << "auto grid: resolution " << choice.resolution[0] << " x " << choice.resolution[1] << " x " << choice.resolution[2]
+        << ", style " << (choice.style == grid_mesh::TET5 ? "TET5" : "TET6") << ", estimated cost " << choice.cost << std::endl;
+        grid = grid_mesh::generate_tet_mesh(choice.resolution, bbox_min, bbox_max, choice.style);
+        grid.initialize_connectivity();
+    }
     
     //perform main grid refinement algorithm:
-    tet_metric metric_list;
+    refine_options options;
+    options.uniform_depth = args.uniform_depth;
+    options.num_threads = args.num_threads;
+    options.pair_hints = args.pair_hints;
+    options.dominance_pruning = args.dominance_pruning;
+    for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+        if (gradient_free[funcIter]){
+            options.gradient_free |= uint32_t(1) << funcIter;
+        }
+    }
+    options.value_func = [&](std::span<const Scalar, 3> data, size_t funcIter){
+        return functions[funcIter]->evaluate(data[0], data[1], data[2]);
+    };
+    options.masked_func = [&](std::span<const Scalar, 3> data, uint32_t mask){
+        llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> vertex_eval(funcNum);
+        for(size_t funcIter = 0; funcIter < funcNum; funcIter++){
+            Eigen::Vector4d eval = Eigen::Vector4d::Zero();
+            if ((mask >> funcIter) & 1){
+                eval[0] = functions[funcIter]->evaluate_gradient(data[0], data[1], data[2], eval[1], eval[2], eval[3]);
+            }
+            vertex_eval[funcIter] = eval;
+        }
+        return vertex_eval;
+    };
+    std::optional<function_index> culling;
+    if (args.cull){
+        culling.emplace(functions);
+        options.culling = &*culling;
+    }
+    std::vector<mtet::MTetMesh> grids;
+    std::vector<tet_metric> metric_lists;
     //an array of 10 timings: {total time getting the multiple indices, total time,time spent on single function, time spent on double functions, time spent on triple functions time spent on double functions' zero crossing test, time spent on three functions' zero crossing test, total subdivision time, total evaluation time,total splitting time}
-    std::array<double, timer_amount> profileTimer = {0,0,0,0,0,0,0,0,0,0};
-    if (!gridRefine(mode, args.curve_network, args.threshold, args.alpha, max_elements, funcNum, implicit_func, csg_func, grid, metric_list, profileTimer))
+    std::vector<std::array<double, timer_amount>> profileTimers;
+    if (modes.size() == 1){
+        grids = {grid};
+        metric_lists.resize(1);
+        profileTimers.assign(1, {0,0,0,0,0,0,0,0,0,0});
+        if (!gridRefine(mode, args.curve_network, args.threshold, args.alpha, max_elements, funcNum, implicit_func, csg_func, grids[0], metric_lists[0], profileTimers[0], options))
+        {
+            throw std::runtime_error("ERROR: unsuccessful grid refinement");
+        }
+    } else if (!gridRefineMulti(modes, args.curve_network, args.threshold, args.alpha, max_elements, funcNum, implicit_func, csg_func, grid, grids, metric_lists, profileTimers, options))
     {
         throw std::runtime_error("ERROR: unsuccessful grid refinement");
     }
-    // save timing records
-    save_timings("timings.json",time_label, profileTimer);
-    //profiled time(see details in time.h) and profiled number of calls to zero
-    for (int i = 0; i < profileTimer.size(); i++){
-        timeProfileName time_type = static_cast<timeProfileName>(i);
-        std::cout << time_label[i] << ": " << profileTimer[i] << std::endl;
-    }
-    // save tet metrics
-    save_metrics("stats.json", tet_metric_labels, metric_list);
-    
-    if (args.discretize_later){
-        /// save the grid output for discretization tool
-        save_mesh_json("grid.json", grid);
-        /// save the grid output for isosurfacing tool
-        save_function_json("function_value.json", grid, metric_list.vertex_func_grad_map, funcNum);
-        /// write grid and active tets
-        mtet::save_mesh("tet_grid.msh", grid);
-        mtet::save_mesh("active_tets.msh", grid, std::span<mtet::TetId>(metric_list.activeTetId));
+    for (size_t modeIter = 0; modeIter < modes.size(); modeIter++){
+        /// outputs of several modalities are prefixed by the modality
+        const std::string prefix = modes.size() == 1 ? "" : methods[modeIter] + "_";
+        mtet::MTetMesh &grid = grids[modeIter];
+        tet_metric &metric_list = metric_lists[modeIter];
+        std::array<double, timer_amount> &profileTimer = profileTimers[modeIter];
+        // save timing records
+        save_timings(prefix + "timings.json",time_label, profileTimer);
+        //profiled time(see details in time.h) and profiled number of calls to zero
+        for (int i = 0; i < profileTimer.size(); i++){
+            timeProfileName time_type = static_cast<timeProfileName>(i);
+            std::cout << time_label[i] << ": " << profileTimer[i] << std::endl;
+        }
+        // save tet metrics
+        save_metrics(prefix + "stats.json", tet_metric_labels, metric_list);
+        
+        
+        if (args.discretize_later){
+            /// save the grid output for discretization tool
+            save_mesh_json(prefix + "grid.json", grid);
+            /// save the grid output for isosurfacing tool
+            save_function_json(prefix + "function_value.json", grid, metric_list.vertex_func_grad_map, funcNum);
+            /// write grid and active tets
+            mtet::save_mesh(prefix + "tet_grid.msh", grid);
+            mtet::save_mesh(prefix + "active_tets.msh", grid, std::span<mtet::TetId>(metric_list.activeTetId));
+        }
     }
     return 0;
 }
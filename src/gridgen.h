@@ -5,6 +5,7 @@
 #include <span>
 #include <queue>
 #include <optional>
+#include <sstream>
 #include <CLI/CLI.hpp>
 
 #include "io.h"
@@ -92,7 +92,7 @@ bool save_timings(const std::string& filename,
 }
 
 bool save_metrics(const std::string& filename,
-                  const std::array<std::string, 6>& tet_metric_labels,
+                  const std::array<std::string, 8>& tet_metric_labels,
                   const tet_metric metric_list)
 {
     using json = nlohmann::json;
@@ -104,6 +104,39 @@ bool save_metrics(const std::string& filename,
     jOut[tet_metric_labels[3]] = metric_list.active_radius_ratio;
     jOut[tet_metric_labels[4]] = metric_list.two_func_check;
     jOut[tet_metric_labels[5]] = metric_list.three_func_check;
+    jOut[tet_metric_labels[6]] = metric_list.two_func_skipped;
+    jOut[tet_metric_labels[7]] = metric_list.three_func_skipped;
+    /// the branches of the criteria: the tets returning in every stage, and histograms of the tets by active functions and by convex hull tests
+    const crit_stats &branches = metric_list.crit_branches;
+    const std::array<std::string, crit_stats::stage_count> stage_labels = {"sign test", "single function", "2D convex hull", "3D convex hull"};
+    json exits;
+    for (int stage = 0; stage < crit_stats::stage_count; stage++){
+        exits[stage_labels[stage]] = {{"refinable", branches.exits[stage][1]}, {"not refinable", branches.exits[stage][0]}};
+    }
+    json hull_calls = json::array();
+    for (size_t bucket = 0; bucket < crit_stats::hull_buckets; bucket++){
+        std::string range = bucket == 0 ? "0" : std::to_string(1 << (bucket - 1));
+        if (bucket + 1 == crit_stats::hull_buckets){
+            range += "+";
+        } else if (bucket > 1){
+            range += "-" + std::to_string((1 << bucket) - 1);
+        }
+        hull_calls.push_back({{"calls", range}, {"tets", branches.hull_calls[bucket]}});
+    }
+    jOut["criterion branches: "] = {
+        {"tets", branches.tets()},
+        {"exits", exits},
+        {"2D convex hull tests", branches.hull_2d_calls},
+        {"3D convex hull tests", branches.hull_3d_calls},
+        {"tets by active functions", branches.active_functions},
+        {"tets by convex hull tests", hull_calls}
+    };
+    if (metric_list.uniform_depth){
+        jOut["uniform refinement depth: "] = metric_list.uniform_depth;
+    }
+    if (metric_list.midpoint_evaluations){
+        jOut["edge midpoint evaluations of the functions without gradients: "] = metric_list.midpoint_evaluations;
+    }
     fout << jOut << std::endl;
     fout.close();
     return true;
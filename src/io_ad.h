@@ -10,6 +10,7 @@
 #include "3rd/unordered_dense.h"
 #include <Eigen/Core>
 #include "adaptive_grid_gen.h"
+#include "refine_crit.h"
 #include "timer.h"
 
 using namespace mtet;
@@ -23,6 +24,14 @@ struct tet_metric {
     double active_radius_ratio = 1;
     int two_func_check = 0;
     int three_func_check = 0;
+    int two_func_skipped = 0;
+    int three_func_skipped = 0;
+    /// The branches taken by the criteria in the adaptive loop, see `crit_stats`.
+    crit_stats crit_branches;
+    /// The values of the functions without gradients evaluated at edge midpoints, see `midpoint_samples`.
+    size_t midpoint_evaluations = 0;
+    /// The number of levels of the bulk uniform refinement, see `refine_options::uniform_depth`.
+    int uniform_depth = 0;
     IndexMap vertex_func_grad_map;
     std::vector<mtet::TetId> activeTetId;
 };
@@ -52,5 +61,5 @@ bool save_timings(const std::string& filename,
 ///
 /// @return         Whether this saving procedure is successful.
 bool save_metrics(const std::string& filename,
-                  const std::array<std::string, 6>& tet_metric_labels,
+                  const std::array<std::string, 8>& tet_metric_labels,
                   const tet_metric metric_list);
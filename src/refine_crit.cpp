@@ -5,14 +5,139 @@
 //  Created by Yiwen Ju on 6/20/24.
 //
 
+#include <algorithm>
+#include <bit>
+#include <cmath>
 #include "refine_crit.h"
+#include "refine_criterion.h"
+#include "refine_crit_batch.h"
+#include "csg.h"
+#include "3rd/implicit_functions/primitive_kernels.h"
+
+namespace {
+
+// the lane types of the batched criteria compiled with the build flags, see `refine_crit_lanes.h`
+using dlanes = Eigen::Array<double, crit_batch_width, 1>;
+using flanes = Eigen::Array<float, crit_batch_width, 1>;
+inline dlanes broadcast(double a) { return dlanes::Constant(a); }
+inline flanes broadcast(float a) { return flanes::Constant(a); }
+inline dlanes load(const batch_lanes &x) { return Eigen::Map<const dlanes>(x.data()); }
+inline void store(const dlanes &a, batch_lanes &x) { Eigen::Map<dlanes>(x.data()) = a; }
+template <typename A, typename B>
+inline auto lane_min(const Eigen::ArrayBase<A> &a, const Eigen::ArrayBase<B> &b) { return a.min(b); }
+template <typename A, typename B>
+inline auto lane_max(const Eigen::ArrayBase<A> &a, const Eigen::ArrayBase<B> &b) { return a.max(b); }
+template <typename A>
+inline auto lane_abs(const Eigen::ArrayBase<A> &a) { return a.abs(); }
+template <typename A>
+inline auto to_float(const Eigen::ArrayBase<A> &a) { return a.template cast<float>(); }
+template <typename A, typename B>
+inline uint32_t less(const Eigen::ArrayBase<A> &a, const Eigen::ArrayBase<B> &b)
+{
+    const Eigen::Array<bool, crit_batch_width, 1> condition = a < b;
+    uint32_t bits = 0;
+    for (size_t l = 0; l < crit_batch_width; l++){
+        bits |= uint32_t(condition[l]) << l;
+    }
+    return bits;
+}
+
+} // namespace
+
+#include "refine_crit_lanes.h"
 
 ///Stores the 2d and 3d origin for the convex hull check happened in zero-crossing criteria.
-std::array<double, 2> query_2d = {0.0, 0.0}; // X, Y
-std::array<double, 3> query_3d = {0.0, 0.0, 0.0}; // X, Y, Z
+constexpr std::array<double, 2> query_2d = {0.0, 0.0}; // X, Y
+constexpr std::array<double, 3> query_3d = {0.0, 0.0, 0.0}; // X, Y, Z
 
 /// Below are the local functions servicing `critIA` , `critCSG`, and `critMI`
 
+/// The maximum number of functions supported by the criteria.
+/// All per-tet buffers below have this fixed capacity, so the criteria don't allocate on the heap.
+constexpr size_t max_func_num = 20;
+/// Per-function rows (e.g., the bezier values at 20 control points) of all functions in a tet.
+/// `N` is the number of functions known at compile time, or `Eigen::Dynamic` for the generic path.
+template <int N, int Cols>
+using FuncMatrix = Eigen::Matrix<double, N, Cols, N == 1 ? Eigen::RowMajor : Eigen::ColMajor, N == Eigen::Dynamic ? int(max_func_num) : N, Cols>;
+/// A set of functions in a tet as a bitset, one bit per function.
+using FuncSet = uint32_t;
+/// Pairwise flags between functions, e.g., whether a pair of functions has a zero-crossing in a tet.
+/// The `i`th bitset contains `j` if the pair of functions `i` and `j` is flagged.
+using PairSets = std::array<FuncSet, max_func_num>;
+
+/// The functions of `set` with indices greater than `i`.
+inline FuncSet above(FuncSet set, int i) {
+    return set & ~((FuncSet(2) << i) - 1);
+}
+
+/// Removes and returns the function with the smallest index of a non-empty `set`.
+inline int pop_first(FuncSet &set) {
+    int i = std::countr_zero(set);
+    set &= set - 1;
+    return i;
+}
+
+/// The branches taken by one call of a criterion, see `crit_stats`.
+struct branch_trace
+{
+    /// The last stage the call reached.
+    crit_stats::stage stage = crit_stats::sign_test;
+    int active_functions = 0;
+    int hull_2d_calls = 0;
+    int hull_3d_calls = 0;
+};
+
+/// Adds the branches of a call of a criterion to the stats of `hint`, if it's set.
+///
+/// @return         The result `refinable` of the call.
+inline bool record_branches(pair_hint *hint, const branch_trace &trace, const bool refinable)
+{
+    if (hint){
+        hint->stats.record(trace.stage, refinable, trace.active_functions, trace.hull_2d_calls, trace.hull_3d_calls);
+    }
+    return refinable;
+}
+
+void crit_stats::record(stage exit, bool refinable, int active_num, int hull_2d_num, int hull_3d_num)
+{
+    exits[exit][refinable]++;
+    hull_2d_calls += hull_2d_num;
+    hull_3d_calls += hull_3d_num;
+    active_functions[std::min<size_t>(active_num, active_functions.size() - 1)]++;
+    hull_calls[std::min<size_t>(std::bit_width(unsigned(hull_2d_num + hull_3d_num)), hull_buckets - 1)]++;
+}
+
+void crit_stats::merge(const crit_stats &other)
+{
+    for (int s = 0; s < stage_count; s++){
+        exits[s][0] += other.exits[s][0];
+        exits[s][1] += other.exits[s][1];
+    }
+    hull_2d_calls += other.hull_2d_calls;
+    hull_3d_calls += other.hull_3d_calls;
+    for (size_t i = 0; i < active_functions.size(); i++){
+        active_functions[i] += other.active_functions[i];
+    }
+    for (size_t i = 0; i < hull_calls.size(); i++){
+        hull_calls[i] += other.hull_calls[i];
+    }
+}
+
+uint64_t crit_stats::tets() const
+{
+    uint64_t count = 0;
+    for (const std::array<uint64_t, 2> &exit : exits){
+        count += exit[0] + exit[1];
+    }
+    return count;
+}
+
+/// The function of `pair_hint::first` if it's one of the `funcNum` functions, or -1.
+inline int first_function(const pair_hint *hint, const size_t funcNum)
+{
+    return hint && hint->first >= 0 && size_t(hint->first) < funcNum ? hint->first : -1;
+}
+
 /// returns a `bool` value that `true` represents positive and `false` represents negative of the input value `x`.
 bool get_sign(double x) {
     return x > 0;
@@ -133,81 +258,43 @@ bool three_func_check (Eigen::Matrix<double, 3, 3> grad,
     return (dotProducts.maxCoeff() > threshold*threshold * E * E);
 }
 
-bool critIA(
-            const Eigen::Matrix<double, 4, 3> &pts,
-            const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info,
-            const size_t funcNum,
-            const double threshold,
-            const bool curve_network,
-            bool& active,
-            int &sub_call_two,
-            int &sub_call_three)
+/// The zero-crossing and distance checks on pairs and triples of active functions, shared by `critIA` and `critCSG`.
+/// The candidate pairs are the pairs of active functions that aren't skipped by `hint`, and the candidate triples
+/// are the triples whose three pairs have a zero-crossing, enumerated by intersecting the bitsets of the pairs.
+///
+/// @param[in] valList          The bezier values of all functions at 20 control points.
+/// @param[in] diffList         The value differences between linear interpolations and bezier approximations of the active functions.
+/// @param[in] gradList         The un-normalized gradients of the linear interpolations of the active functions.
+/// @param[in] activeSet            The active functions in the tet.
+/// @param[in] sqD          The squared determinant to offset the un-normalized gradients
+/// @param[in] threshold            The user-defined error threshold
+/// @param[out] sub_call_two            A tracker of how many times two functions' distance check is called.
+/// @param[out] sub_call_three            A tracker of how many times three functions' distance check is called.
+/// @param[in,out] hint         Optional pairs to skip and trackers of the skipped checks, see `pair_hint`.
+/// @param[in,out] trace            The branches taken by the call of the criterion.
+///
+/// @return         Whether the tet is refinable.
+template <int N>
+bool multi_func_check(const FuncMatrix<N, 20> &valList,
+                      const FuncMatrix<N, 16> &diffList,
+                      const Eigen::Matrix<double, 20, 3> &gradList,
+                      const FuncSet activeSet,
+                      const double sqD,
+                      const double threshold,
+                      int &sub_call_two,
+                      int &sub_call_three,
+                      pair_hint *hint,
+                      branch_trace &trace)
 {
-    Eigen::Matrix<double, Eigen::Dynamic, 20> valList (funcNum, 20);
-    Eigen::Matrix<double, Eigen::Dynamic, 16> diffList(funcNum, 16);
-    llvm_vecsmall::SmallVector<bool, 20> activeTF(funcNum);
-    Eigen::Matrix<double, 20, 3> gradList;
-    Eigen::Vector3d eigenVec1 = pts.row(1) - pts.row(0), eigenVec2 = pts.row(2) - pts.row(0), eigenVec3 = pts.row(3) - pts.row(0), eigenVec4 = pts.row(2) - pts.row(1), eigenVec5 = pts.row(3) - pts.row(1), eigenVec6 = pts.row(3) - pts.row(2);
-    Eigen::Matrix<double, 3, 6> vec;
-    vec << eigenVec1, eigenVec2, eigenVec3, eigenVec4, eigenVec5, eigenVec6;
-    double D = vec.leftCols(3).determinant();
-    double sqD = D*D;
-    Eigen::Matrix3d crossMatrix;
-    crossMatrix << eigenVec2.cross(eigenVec3), eigenVec3.cross(eigenVec1), eigenVec1.cross(eigenVec2);
-    
-    int activeNum = 0;
-    //single function linearity check:
-    for (int funcIter = 0; funcIter < funcNum; funcIter++){
-        //Timer single_timer(singleFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
-        //storing bezier and linear info for later linearity comparison
-        Eigen::Matrix4d func_info;
-        func_info << tet_info[0][funcIter], tet_info[1][funcIter], tet_info[2][funcIter], tet_info[3][funcIter];
-        Eigen::RowVector4d vals = func_info.col(0);
-        Eigen::Matrix<double, 4, 3> grads_eigen = func_info.rightCols(3);
-        valList.row(funcIter) = bezierConstruct(vals, grads_eigen, vec);
-        //Timer single_timer(singleFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
-        activeTF[funcIter] = get_sign(valList.row(funcIter).maxCoeff()) != get_sign(valList.row(funcIter).minCoeff());
-        //single_timer.Stop();
-        if (activeTF[funcIter]){
-            if (!active){
-                active = true;
-            }
-            activeNum++;
-            Eigen::Vector3d unNormF = Eigen::RowVector3d(vals(1)-vals(0), vals(2)-vals(0), vals(3)-vals(0)) * crossMatrix.transpose();
-            gradList.row(funcIter) = unNormF;
-            diffList.row(funcIter) = bezierDiff(valList.row(funcIter));
-            double error = std::max(diffList.row(funcIter).maxCoeff(), -diffList.row(funcIter).minCoeff());
-            //Timer single2_timer(singleFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
-            double lhs = error * error * sqD;
-            double rhs;
-            if (!curve_network){
-                rhs = threshold * threshold * gradList.row(funcIter).squaredNorm();
-            }else{
-                rhs = std::numeric_limits<double>::infinity() * gradList.row(funcIter).squaredNorm();
-            }
-            if (lhs > rhs) {
-                //single2_timer.Stop();
-                return true;
-            }
-            //single2_timer.Stop();
-        }
-    }
     //Timer single_timer(singleFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
+    const int activeNum = std::popcount(activeSet);
     if(activeNum < 2){
         //single_timer.Stop();
         return false;
     }
-    llvm_vecsmall::SmallVector<int, 20> activeFunc(activeNum);
-    int activeFuncIter = 0;
-    for (int funcIter = 0; funcIter < funcNum; funcIter++){
-        if (activeTF[funcIter]){
-            activeFunc[activeFuncIter] = funcIter;
-            activeFuncIter++;
-        }
-    }
-    llvm_vecsmall::SmallVector<llvm_vecsmall::SmallVector<bool, 20>, 20> zeroXResult(funcNum, llvm_vecsmall::SmallVector<bool, 20>(funcNum));
+    PairSets zeroXResult = {};
     //single_timer.Stop();
-    const int pairNum = activeNum * (activeNum-1)/2, triNum = activeNum * (activeNum-1) * (activeNum - 2)/ 6;
+    const int triNum = activeNum * (activeNum-1) * (activeNum - 2)/ 6;
     
     // 2-function checks
     int activeDouble_count = 0;
@@ -215,19 +302,30 @@ bool critIA(
         //Timer timer(twoFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
         bool zeroX;
         
-        for (int i = 0; i < activeNum - 1; i++){
-            for (int j = i + 1; j < activeNum; j++){
-                std::array<int, 2> pairIndices = {activeFunc[i], activeFunc[j]};
+        for (FuncSet rest = activeSet; rest;){
+            const int i = pop_first(rest);
+            FuncSet candidates = rest;
+            if (hint){
+                FuncSet skipped = candidates & hint->skip[i];
+                hint->skipped_two += std::popcount(skipped);
+                hint->failed[i] |= skipped;
+                candidates &= ~skipped;
+            }
+            while (candidates){
+                const int j = pop_first(candidates);
+                std::array<int, 2> pairIndices = {i, j};
                 std::array<double, 40> nPoints = parse_convex_points2d(valList(pairIndices, Eigen::all));
                 //Timer sub_timer(sub_twoFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
                 zeroX = convex_hull_membership::contains<2, double>(nPoints, query_2d);
                 //sub_timer.Stop();
+                trace.stage = crit_stats::hull_2d;
+                trace.hull_2d_calls++;
                 
                 if (zeroX){
                     activeDouble_count++;
                     sub_call_two ++;
-                    zeroXResult[pairIndices[0]][pairIndices[1]] = true;
-                    zeroXResult[pairIndices[1]][pairIndices[0]] = true;
+                    zeroXResult[i] |= FuncSet(1) << j;
+                    zeroXResult[j] |= FuncSet(1) << i;
                     Eigen::Matrix<double, 2, 3> grad = gradList(pairIndices, Eigen::all);
                     Eigen::Matrix<double, 16, 2> diff_matrix = diffList(pairIndices, Eigen::all).transpose();
                     // two function linearity test:
@@ -235,28 +333,47 @@ bool critIA(
                         //timer.Stop();
                         return true;
                     }
+                } else if (hint){
+                    hint->failed[i] |= FuncSet(1) << j;
                 }
             }
         }
         //timer.Stop();
     }
-    if(activeDouble_count < 3)
+    if (hint){
+        // make the failed pairs symmetric
+        for (int i = 0; i < int(max_func_num); i++){
+            for (FuncSet rest = hint->failed[i]; rest;){
+                hint->failed[pop_first(rest)] |= FuncSet(1) << i;
+            }
+        }
+    }
+    if(activeDouble_count < 3){
+        if (hint){
+            hint->skipped_three += triNum;
+        }
         return false;
+    }
     // 3-function checks
-    {
+    if constexpr (N == Eigen::Dynamic || N > 2) {
         //Timer timer(threeFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
         bool zeroX;
-        for (int i = 0; i < activeNum - 2; i++){
-            for (int j = i + 1; j < activeNum - 1; j++){
-                for (int k = j + 1; k < activeNum; k++){
-                    std::array<int, 3> tripleIndices = {activeFunc[i], activeFunc[j], activeFunc[k]};
-                    if(!(zeroXResult[tripleIndices[0]][tripleIndices[1]]&&zeroXResult[tripleIndices[0]][tripleIndices[2]]&&zeroXResult[tripleIndices[1]][tripleIndices[2]]))
-                        continue;
+        int triCount = 0;
+        for (FuncSet rest = activeSet; rest;){
+            const int i = pop_first(rest);
+            for (FuncSet second = above(zeroXResult[i], i); second;){
+                const int j = pop_first(second);
+                for (FuncSet third = above(zeroXResult[i] & zeroXResult[j], j); third;){
+                    const int k = pop_first(third);
+                    std::array<int, 3> tripleIndices = {i, j, k};
                     std::array<double, 60> nPoints = parse_convex_points3d(valList(tripleIndices, Eigen::all));
                     sub_call_three ++;
+                    triCount++;
                     //Timer sub_timer(sub_threeFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
                     zeroX = convex_hull_membership::contains<3, double>(nPoints, query_3d);
                     //sub_timer.Stop();
+                    trace.stage = crit_stats::hull_3d;
+                    trace.hull_3d_calls++;
                     
                     if (zeroX){
                         Eigen::Matrix<double, 3, 3> grad = gradList(tripleIndices, Eigen::all);
@@ -269,25 +386,132 @@ bool critIA(
                 }
             }
         }
+        if (hint){
+            hint->skipped_three += triNum - triCount;
+        }
         //timer.Stop();
     }
     return false;
 }
 
-bool critCSG(
+template <int N>
+bool critIA_impl(
+            const Eigen::Matrix<double, 4, 3> &pts,
+            const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+            const size_t funcCount,
+            const double threshold,
+            const bool curve_network,
+            bool& active,
+            int &sub_call_two,
+            int &sub_call_three,
+            pair_hint *hint,
+            branch_trace &trace)
+{
+    const size_t funcNum = N == Eigen::Dynamic ? funcCount : N;
+    assert(funcNum <= max_func_num);
+    FuncMatrix<N, 20> valList(funcNum, 20);
+    FuncMatrix<N, 16> diffList(funcNum, 16);
+    FuncSet activeSet = 0;
+    Eigen::Matrix<double, 20, 3> gradList;
+    Eigen::Vector3d eigenVec1 = pts.row(1) - pts.row(0), eigenVec2 = pts.row(2) - pts.row(0), eigenVec3 = pts.row(3) - pts.row(0), eigenVec4 = pts.row(2) - pts.row(1), eigenVec5 = pts.row(3) - pts.row(1), eigenVec6 = pts.row(3) - pts.row(2);
+    Eigen::Matrix<double, 3, 6> vec;
+    vec << eigenVec1, eigenVec2, eigenVec3, eigenVec4, eigenVec5, eigenVec6;
+    double D = vec.leftCols(3).determinant();
+    double sqD = D*D;
+    Eigen::Matrix3d crossMatrix;
+    crossMatrix << eigenVec2.cross(eigenVec3), eigenVec3.cross(eigenVec1), eigenVec1.cross(eigenVec2);
+    
+    //single function linearity check, starting from the function of `pair_hint::first`:
+    const int first = first_function(hint, funcNum);
+    for (int orderIter = first < 0 ? 0 : -1; orderIter < int(funcNum); orderIter++){
+        if (orderIter == first){
+            continue;
+        }
+        const int funcIter = orderIter < 0 ? first : orderIter;
+        //Timer single_timer(singleFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
+        //storing bezier and linear info for later linearity comparison
+        Eigen::Matrix4d func_info;
+        func_info << tet_info[0][funcIter], tet_info[1][funcIter], tet_info[2][funcIter], tet_info[3][funcIter];
+        Eigen::RowVector4d vals = func_info.col(0);
+        Eigen::Matrix<double, 4, 3> grads_eigen = func_info.rightCols(3);
+        valList.row(funcIter) = bezierConstruct(vals, grads_eigen, vec);
+        //Timer single_timer(singleFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
+        bool activeTF = get_sign(valList.row(funcIter).maxCoeff()) != get_sign(valList.row(funcIter).minCoeff());
+        //single_timer.Stop();
+        if (activeTF){
+            if (!active){
+                active = true;
+            }
+            activeSet |= FuncSet(1) << funcIter;
+            trace.stage = crit_stats::single_function;
+            trace.active_functions++;
+            Eigen::Vector3d unNormF = Eigen::RowVector3d(vals(1)-vals(0), vals(2)-vals(0), vals(3)-vals(0)) * crossMatrix.transpose();
+            gradList.row(funcIter) = unNormF;
+            diffList.row(funcIter) = bezierDiff(valList.row(funcIter));
+            double error = std::max(diffList.row(funcIter).maxCoeff(), -diffList.row(funcIter).minCoeff());
+            //Timer single2_timer(singleFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
+            double lhs = error * error * sqD;
+            double rhs;
+            if (!curve_network){
+                rhs = threshold * threshold * gradList.row(funcIter).squaredNorm();
+            }else{
+                rhs = std::numeric_limits<double>::infinity() * gradList.row(funcIter).squaredNorm();
+            }
+            if (lhs > rhs) {
+                //single2_timer.Stop();
+                if (hint){
+                    hint->first = funcIter;
+                }
+                return true;
+            }
+            //single2_timer.Stop();
+        }
+    }
+    if constexpr (N == 1){
+        return false;
+    } else {
+        return multi_func_check<N>(valList, diffList, gradList, activeSet, sqD, threshold, sub_call_two, sub_call_three, hint, trace);
+    }
+}
+
+/// Evaluates the CSG tree of `csg_func` on the intervals `funcInt`, directly if `csg_func` wraps a `csg_program`.
+///
+/// @return         The interval of the tree and the set of active functions.
+std::pair<std::array<double, 2>, FuncSet> evaluate_csg(const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> &csg_func,
+                                                      const llvm_vecsmall::SmallVector<std::array<double, 2>, 20> &funcInt)
+{
+    if (const csg_program *program = csg_func.target<csg_program>()){
+        return program->evaluate(funcInt);
+    }
+    std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> csgResult = csg_func(funcInt);
+    FuncSet activeSet = 0;
+    for (size_t funcIter = 0; funcIter < funcInt.size(); funcIter++){
+        if (!csgResult.second[funcIter]){
+            activeSet |= FuncSet(1) << funcIter;
+        }
+    }
+    return {csgResult.first, activeSet};
+}
+
+template <int N>
+bool critCSG_impl(
              const Eigen::Matrix<double, 4, 3> &pts,
-             const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info,
-             const size_t funcNum,
-             const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func,
+             const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+             const size_t funcCount,
+             const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> &csg_func,
              const double threshold,
              const bool curve_network,
              bool& active,
              int &sub_call_two,
-             int &sub_call_three)
+             int &sub_call_three,
+             pair_hint *hint,
+             branch_trace &trace)
 {
-    Eigen::Matrix<double, Eigen::Dynamic, 20> valList (funcNum, 20);
-    Eigen::Matrix<double, Eigen::Dynamic, 16> diffList(funcNum, 16);
-    llvm_vecsmall::SmallVector<bool, 20> activeTF(funcNum);
+    const size_t funcNum = N == Eigen::Dynamic ? funcCount : N;
+    assert(funcNum <= max_func_num);
+    FuncMatrix<N, 20> valList(funcNum, 20);
+    FuncMatrix<N, 16> diffList(funcNum, 16);
+    FuncSet activeSet = 0;
     llvm_vecsmall::SmallVector<std::array<double , 2>, 20> funcInt(funcNum);
     Eigen::Matrix<double, 20, 3> gradList;
     Eigen::Vector3d eigenVec1 = pts.row(1) - pts.row(0), eigenVec2 = pts.row(2) - pts.row(0), eigenVec3 = pts.row(3) - pts.row(0), eigenVec4 = pts.row(2) - pts.row(1), eigenVec5 = pts.row(3) - pts.row(1), eigenVec6 = pts.row(3) - pts.row(2);
@@ -297,10 +521,13 @@ bool critCSG(
     double sqD = D*D;
     Eigen::Matrix3d crossMatrix;
     crossMatrix << eigenVec2.cross(eigenVec3), eigenVec3.cross(eigenVec1), eigenVec1.cross(eigenVec2);
+    /// the functions of a program are the only ones whose intervals are read
+    const csg_program *tree = csg_func.target<csg_program>();
+    const FuncSet funcSet = tree ? tree->functions() & ((FuncSet(1) << funcNum) - 1) : (FuncSet(1) << funcNum) - 1;
     
-    int activeNum = 0;
     //single function linearity check:
-    for (int funcIter = 0; funcIter < funcNum; funcIter++){
+    for (FuncSet rest = funcSet; rest;){
+        const int funcIter = pop_first(rest);
         //Timer single_timer(singleFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
         Eigen::Matrix4d func_info;
         func_info << tet_info[0][funcIter], tet_info[1][funcIter], tet_info[2][funcIter], tet_info[3][funcIter];
@@ -310,19 +537,26 @@ bool critCSG(
         funcInt[funcIter] = {valList.row(funcIter).minCoeff(), valList.row(funcIter).maxCoeff()};
     }
     
-        std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> csgResult = csg_func(funcInt);
+        std::pair<std::array<double, 2>, FuncSet> csgResult = evaluate_csg(csg_func, funcInt);
         if(csgResult.first[0] * csgResult.first[1] > 0){
             return false;
         }else{
-            for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+            const int first = first_function(hint, funcNum);
+            for (int orderIter = first < 0 ? 0 : -1; orderIter < int(funcNum); orderIter++){
+                if (orderIter == first){
+                    continue;
+                }
+                const int funcIter = orderIter < 0 ? first : orderIter;
                 //Timer single_timer(singleFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
-                activeTF[funcIter] = !csgResult.second[funcIter];
+                bool activeTF = (csgResult.second >> funcIter) & 1;
                 //single_timer.Stop();
-                if (activeTF[funcIter]){
+                if (activeTF){
                     if (!active){
                         active = true;
                     }
-                    activeNum++;
+                    activeSet |= FuncSet(1) << funcIter;
+                    trace.stage = crit_stats::single_function;
+                    trace.active_functions++;
                     double v0 = tet_info[0][funcIter][0], v1 = tet_info[1][funcIter][0], v2 = tet_info[2][funcIter][0], v3 = tet_info[3][funcIter][0];
                     Eigen::Vector3d unNormF = Eigen::RowVector3d(v1-v0, v2-v0, v3-v0) * crossMatrix.transpose();
                     gradList.row(funcIter) = unNormF;
@@ -338,102 +572,122 @@ bool critCSG(
                     }
                     if (lhs > rhs) {
                         //single2_timer.Stop();
+                        if (hint){
+                            hint->first = funcIter;
+                        }
                         return true;
                     }
                     //single2_timer.Stop();
                 }
             }
         }
-    //Timer single_timer(singleFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
-    if(activeNum < 2){
-        //single_timer.Stop();
+    if constexpr (N == 1){
         return false;
+    } else {
+        return multi_func_check<N>(valList, diffList, gradList, activeSet, sqD, threshold, sub_call_two, sub_call_three, hint, trace);
     }
-    llvm_vecsmall::SmallVector<int, 20> activeFunc(activeNum);
-    int activeFuncIter = 0;
-    for (int funcIter = 0; funcIter < funcNum; funcIter++){
-        if (activeTF[funcIter]){
-            activeFunc[activeFuncIter] = funcIter;
-            activeFuncIter++;
+}
+
+/// The comparators of a sorting network on 8 elements (Knuth, TAOCP 5.3.4), in the order they're applied.
+constexpr std::array<std::array<int, 2>, 19> sorting_network_8 = {{
+    {0, 2}, {1, 3}, {4, 6}, {5, 7},
+    {0, 4}, {1, 5}, {2, 6}, {3, 7},
+    {0, 1}, {2, 3}, {4, 5}, {6, 7},
+    {2, 4}, {3, 5},
+    {1, 4}, {3, 6},
+    {1, 2}, {3, 4}, {5, 6}
+}};
+
+/// Sorts the functions of `set` in descending order of their lower bounds `funcInt[f][0]`, by a sorting network for up to 8 functions.
+///
+/// @param[out] order           The sorted functions.
+///
+/// @return         The number of functions in `order`.
+size_t sort_by_lower_bound(FuncSet set,
+                           const llvm_vecsmall::SmallVector<std::array<double , 2>, 20> &funcInt,
+                           std::array<int, max_func_num> &order)
+{
+    const size_t num = std::popcount(set);
+    if (num > 8){
+        for (size_t i = 0; i < num; i++){
+            order[i] = pop_first(set);
         }
+        std::sort(order.begin(), order.begin() + num, [&](int f0, int f1){ return funcInt[f0][0] > funcInt[f1][0]; });
+        return num;
     }
-    llvm_vecsmall::SmallVector<llvm_vecsmall::SmallVector<bool, 20>, 20> zeroXResult(funcNum, llvm_vecsmall::SmallVector<bool, 20>(funcNum));
-    //single_timer.Stop();
-    const int pairNum = activeNum * (activeNum-1)/2, triNum = activeNum * (activeNum-1) * (activeNum - 2)/ 6;
-    
-    // 2-function checks
-    int activeDouble_count = 0;
-    {
-        //Timer timer(twoFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
-        bool zeroX;
-        for (int i = 0; i < activeNum - 1; i++){
-            for (int j = i + 1; j < activeNum; j++){
-                std::array<int, 2> pairIndices = {activeFunc[i], activeFunc[j]};
-                std::array<double, 40> nPoints = parse_convex_points2d(valList(pairIndices, Eigen::all));
-                //Timer sub_timer(sub_twoFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
-                zeroX = convex_hull_membership::contains<2, double>(nPoints, query_2d);
-                //sub_timer.Stop();
-                
-                if (zeroX){
-                    activeDouble_count++;
-                    sub_call_two ++;
-                    zeroXResult[pairIndices[0]][pairIndices[1]] = true;
-                    zeroXResult[pairIndices[1]][pairIndices[0]] = true;
-                    Eigen::Matrix<double, 2, 3> grad = gradList(pairIndices, Eigen::all);
-                    Eigen::Matrix<double, 16, 2> diff_matrix = diffList(pairIndices, Eigen::all).transpose();
-                    // two function linearity test:
-                    if (two_func_check (grad, diff_matrix, sqD, threshold)){
-                        //timer.Stop();
-                        return true;
-                    }
-                }
-            }
-        }
-        //timer.Stop();
+    // the unused entries are padded with the lowest key, so they stay at the end
+    std::array<double, 8> key;
+    std::array<int, 8> func;
+    key.fill(-std::numeric_limits<double>::infinity());
+    func.fill(-1);
+    for (size_t i = 0; i < num; i++){
+        func[i] = pop_first(set);
+        key[i] = funcInt[func[i]][0];
     }
-    if(activeDouble_count < 3)
-        return false;
-    // 3-function checks
-    {
-        //Timer timer(threeFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
-        bool zeroX;
-        for (int i = 0; i < activeNum - 2; i++){
-            for (int j = i + 1; j < activeNum - 1; j++){
-                for (int k = j + 1; k < activeNum; k++){
-                    std::array<int, 3> tripleIndices = {activeFunc[i], activeFunc[j], activeFunc[k]};
-                    if(!(zeroXResult[tripleIndices[0]][tripleIndices[1]]&&zeroXResult[tripleIndices[0]][tripleIndices[2]]&&zeroXResult[tripleIndices[1]][tripleIndices[2]]))
-                        continue;
-                    std::array<double, 60> nPoints = parse_convex_points3d(valList(tripleIndices, Eigen::all));
-                    sub_call_three ++;
-                    //Timer sub_timer(sub_threeFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
-                    zeroX = convex_hull_membership::contains<3, double>(nPoints, query_3d);
-                    //sub_timer.Stop();
-                    
-                    if (zeroX){
-                        Eigen::Matrix<double, 3, 3> grad = gradList(tripleIndices, Eigen::all);
-                        Eigen::Matrix<double, 16, 3> diff_matrix = diffList(tripleIndices, Eigen::all).transpose();
-                        if (three_func_check (grad, diff_matrix, sqD, threshold)){
-                            //timer.Stop();
-                            return true;
-                        }
-                    }
-                }
-            }
+    for (const auto &[a, b] : sorting_network_8){
+        const bool swap = key[a] < key[b];
+        const double key_a = key[a], key_b = key[b];
+        const int func_a = func[a], func_b = func[b];
+        key[a] = swap ? key_b : key_a;
+        key[b] = swap ? key_a : key_b;
+        func[a] = swap ? func_b : func_a;
+        func[b] = swap ? func_a : func_b;
+    }
+    std::copy(func.begin(), func.begin() + num, order.begin());
+    return num;
+}
+
+/// Discards the materials of `candidates` that can't be the maximum anywhere in a tet: a material whose bezier values are below those of
+/// another material at all control points is below it in the whole tet. Such a material has the lower bound of its bezier values below that of
+/// the other material, so the materials are visited in descending order of their lower bounds and compared only with the materials kept before them.
+/// A material dominated by a discarded material is also dominated by the material that discarded it.
+///
+/// @param[in] valList          The bezier values of all materials.
+/// @param[in] funcInt          The ranges of the bezier values of all materials.
+/// @param[in] candidates           The materials that may be the maximum by their ranges.
+///
+/// @return         The materials of `candidates` that aren't dominated by another one.
+template <int N>
+FuncSet dominant_materials(const FuncMatrix<N, 20> &valList,
+                           const llvm_vecsmall::SmallVector<std::array<double , 2>, 20> &funcInt,
+                           const FuncSet candidates)
+{
+    std::array<int, max_func_num> order;
+    const size_t num = sort_by_lower_bound(candidates, funcInt, order);
+    FuncSet kept = 0;
+    for (size_t i = 0; i < num; i++){
+        const int funcIter = order[i];
+        bool dominated = false;
+        for (FuncSet rest = kept; rest && !dominated;){
+            const int other = pop_first(rest);
+            dominated = (valList.row(other) - valList.row(funcIter)).minCoeff() > 0;
+        }
+        if (!dominated){
+            kept |= FuncSet(1) << funcIter;
         }
-        //timer.Stop();
     }
-    return false;
+    return kept;
 }
-bool critMI(
+
+template <int N>
+bool critMI_impl(
             const Eigen::Matrix<double, 4, 3> &pts,
-            const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info,
-            const size_t funcNum,
+            const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+            const size_t funcCount,
             const double threshold,
             const bool curve_network,
             bool& active,
             int &sub_call_two,
-            int &sub_call_three)
+            int &sub_call_three,
+            pair_hint *hint,
+            const bool dominance,
+            branch_trace &trace)
 {
+    const size_t funcNum = N == Eigen::Dynamic ? funcCount : N;
+    if constexpr (N == 1){
+        // a single material has no interface
+        return false;
+    }
     Eigen::Vector3d eigenVec1 = pts.row(1) - pts.row(0), eigenVec2 = pts.row(2) - pts.row(0), eigenVec3 = pts.row(3) - pts.row(0), eigenVec4 = pts.row(2) - pts.row(1), eigenVec5 = pts.row(3) - pts.row(1), eigenVec6 = pts.row(3) - pts.row(2);
     Eigen::Matrix<double, 3, 6> vec;
     vec << eigenVec1, eigenVec2, eigenVec3, eigenVec4, eigenVec5, eigenVec6;
@@ -442,13 +696,14 @@ bool critMI(
     Eigen::Matrix3d crossMatrix_eigen;
     crossMatrix_eigen << eigenVec2.cross(eigenVec3), eigenVec3.cross(eigenVec1), eigenVec1.cross(eigenVec2);
     Eigen::Matrix<double, 20, 3> gradList_eigen;
-    Eigen::Matrix<double, Eigen::Dynamic, 20> valList (funcNum, 20);
-    Eigen::Matrix<double, Eigen::Dynamic, 16> diffList(funcNum, 16);
+    assert(funcNum <= max_func_num);
+    FuncMatrix<N, 20> valList(funcNum, 20);
+    FuncMatrix<N, 16> diffList(funcNum, 16);
     
-    llvm_vecsmall::SmallVector<bool, 20> activeList(funcNum);
+    FuncSet activeList = 0;
     llvm_vecsmall::SmallVector<std::array<double , 2>, 20> funcInt(funcNum);
     double maxLow = -1 * std::numeric_limits<double>::infinity();
-    llvm_vecsmall::SmallVector<llvm_vecsmall::SmallVector<bool, 20>, 20> activePair(funcNum, llvm_vecsmall::SmallVector<bool, 20>(funcNum, false));
+    PairSets activePair = {};
     //single function linearity check:
     for (int funcIter = 0; funcIter < funcNum; funcIter++){
         Eigen::Matrix4d func_info;
@@ -461,25 +716,29 @@ bool critMI(
             maxLow = funcInt[funcIter][0];
         }
     }
-    llvm_vecsmall::SmallVector<int, 20> activeFunc;
+    FuncSet activeFunc = 0;
     for (int funcIter = 0; funcIter < funcNum; funcIter++){
         if(funcInt[funcIter][1] > maxLow){
-            activeFunc.push_back(funcIter);
+            activeFunc |= FuncSet(1) << funcIter;
         }
     }
-    size_t activeNum = activeFunc.size();
+    if (dominance && std::popcount(activeFunc) > 2){
+        activeFunc = dominant_materials(valList, funcInt, activeFunc);
+    }
+    const int activeNum = std::popcount(activeFunc);
+    trace.active_functions = activeNum;
     if(activeNum < 2)
         return false;
 
     //Timer get_func_timer(getActiveMuti, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
-    const size_t pairNum = activeNum * (activeNum-1)/2, triNum = activeNum * (activeNum-1) * (activeNum - 2)/ 6, quadNum = activeNum * (activeNum - 1) * (activeNum - 2) * (activeNum - 3)/ 24;
+    const int triNum = activeNum * (activeNum-1) * (activeNum - 2)/ 6, quadNum = activeNum * (activeNum - 1) * (activeNum - 2) * (activeNum - 3)/ 24;
 //    get_func_timer.Stop();
     
-    for (int i = 0; i < activeNum - 1; i++){
-        for (int j = i + 1; j < activeNum; j++){
+    for (FuncSet first = activeFunc; first;){
+        const int funcIndex1 = pop_first(first);
+        for (FuncSet second = first; second;){
             //Timer single_timer(singleFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
-            int funcIndex1 = activeFunc[i];
-            int funcIndex2 = activeFunc[j];
+            const int funcIndex2 = pop_first(second);
             Eigen::Vector<double, 20> diff_at_point;
             diff_at_point = valList.row(funcIndex2) - valList.row(funcIndex1);
             bool activeTF = get_sign(diff_at_point.maxCoeff()) == get_sign(diff_at_point.minCoeff()) ? false : true;
@@ -488,18 +747,19 @@ bool critMI(
                 if (!active){
                     active = true;
                 }
-                activePair[funcIndex1][funcIndex2] = true;
-                activePair[funcIndex2][funcIndex1] = true;
-                if (!activeList[funcIndex1]){
-                    activeList[funcIndex1] = true;
+                trace.stage = crit_stats::single_function;
+                activePair[funcIndex1] |= FuncSet(1) << funcIndex2;
+                activePair[funcIndex2] |= FuncSet(1) << funcIndex1;
+                if (!((activeList >> funcIndex1) & 1)){
+                    activeList |= FuncSet(1) << funcIndex1;
                     double v0 = valList(funcIndex1, 0), v1 = valList(funcIndex1, 1), v2 = valList(funcIndex1, 2), v3 = valList(funcIndex1, 3);
                     Eigen::Vector3d unNormF_eigen = Eigen::RowVector3d(v1-v0, v2-v0, v3-v0) * crossMatrix_eigen.transpose();
                     gradList_eigen.row(funcIndex1) = unNormF_eigen;
                     
                     diffList.row(funcIndex1) = bezierDiff(valList.row(funcIndex1));
                 }
-                if (!activeList[funcIndex2]){
-                    activeList[funcIndex2] = true;
+                if (!((activeList >> funcIndex2) & 1)){
+                    activeList |= FuncSet(1) << funcIndex2;
                     double v0 = valList(funcIndex2, 0), v1 = valList(funcIndex2, 1), v2 = valList(funcIndex2, 2), v3 = valList(funcIndex2, 3);
                     Eigen::Vector3d unNormF_eigen = Eigen::RowVector3d(v1-v0, v2-v0, v3-v0) * crossMatrix_eigen.transpose();
                     gradList_eigen.row(funcIndex2) = unNormF_eigen;
@@ -530,17 +790,17 @@ bool critMI(
     
     // 2-function checks
     int activeTriple_count = 0;
-    {
+    if constexpr (N == Eigen::Dynamic || N > 2) {
         //Timer timer(twoFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
         bool zeroX;
-        for (int i = 0; i < activeNum - 2; i++){
-            for (int j = i + 1; j < activeNum - 1; j++){
-                for (int k = j + 1; k < activeNum; k++){
-                    int funcIndex1 = activeFunc[i];
-                    int funcIndex2 = activeFunc[j];
-                    int funcIndex3 = activeFunc[k];
-                    if(!(activePair[funcIndex1][funcIndex2]&&activePair[funcIndex1][funcIndex3]&&activePair[funcIndex2][funcIndex3]))
-                        continue;
+        int triCount = 0;
+        for (FuncSet first = activeFunc; first;){
+            const int funcIndex1 = pop_first(first);
+            for (FuncSet second = above(activePair[funcIndex1], funcIndex1); second;){
+                const int funcIndex2 = pop_first(second);
+                for (FuncSet third = above(activePair[funcIndex1] & activePair[funcIndex2], funcIndex2); third;){
+                    const int funcIndex3 = pop_first(third);
+                    triCount++;
                     Eigen::Matrix<double,2, 20> diff_mi(2, 20);
                     diff_mi.row(0) = valList.row(funcIndex1) - valList.row(funcIndex2);
                     diff_mi.row(1) =  valList.row(funcIndex2) - valList.row(funcIndex3);
@@ -548,6 +808,8 @@ bool critMI(
                     //Timer sub_timer(sub_twoFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
                     zeroX = convex_hull_membership::contains<2, double>(nPoints, query_2d);
                     //sub_timer.Stop();
+                    trace.stage = crit_stats::hull_2d;
+                    trace.hull_2d_calls++;
                     if (zeroX){
                         sub_call_two ++;
                         activeTriple_count++;
@@ -565,24 +827,30 @@ bool critMI(
                 }
             }
         }
+        if (hint){
+            hint->skipped_two += triNum - triCount;
+        }
         //timer.Stop();
     }
-    if(activeTriple_count < 4)
+    if(activeTriple_count < 4){
+        if (hint){
+            hint->skipped_three += quadNum;
+        }
         return false;
-    {
+    }
+    if constexpr (N == Eigen::Dynamic || N > 3) {
         //Timer timer(threeFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
         bool zeroX;
-        for (int i = 0; i < activeNum - 3; i++){
-            for (int j = i + 1; j < activeNum - 2; j++){
-                for (int k = j + 1; k < activeNum - 1; k++){
-                    for (int m = k + 1; m < activeNum; m++){
-                        int funcIndex1 = activeFunc[i];
-                        int funcIndex2 = activeFunc[j];
-                        int funcIndex3 = activeFunc[k];
-                        int funcIndex4 = activeFunc[m];
-                        if(!(activePair[funcIndex1][funcIndex2]&&activePair[funcIndex1][funcIndex3]&&activePair[funcIndex1][funcIndex4]&&activePair[funcIndex2][funcIndex3]&&activePair[funcIndex2][funcIndex4]&&activePair[funcIndex3][funcIndex4]))
-                            continue;
-                        
+        int quadCount = 0;
+        for (FuncSet first = activeFunc; first;){
+            const int funcIndex1 = pop_first(first);
+            for (FuncSet second = above(activePair[funcIndex1], funcIndex1); second;){
+                const int funcIndex2 = pop_first(second);
+                for (FuncSet third = above(activePair[funcIndex1] & activePair[funcIndex2], funcIndex2); third;){
+                    const int funcIndex3 = pop_first(third);
+                    for (FuncSet fourth = above(activePair[funcIndex1] & activePair[funcIndex2] & activePair[funcIndex3], funcIndex3); fourth;){
+                        const int funcIndex4 = pop_first(fourth);
+                        quadCount++;
                         Eigen::Matrix<double,3, 20> diff_mi(3, 20);
                         diff_mi.row(0) = valList.row(funcIndex1) - valList.row(funcIndex2);
                         diff_mi.row(1) =  valList.row(funcIndex2) - valList.row(funcIndex3);
@@ -591,6 +859,8 @@ bool critMI(
                         //Timer sub_timer(sub_twoFunc, [&](auto profileResult){profileTimer = combine_timer(profileTimer, profileResult);});
                         zeroX = convex_hull_membership::contains<3, double>(nPoints, query_3d);
                         //sub_timer.Stop();
+                        trace.stage = crit_stats::hull_3d;
+                        trace.hull_3d_calls++;
                         
                         if (zeroX){
                             sub_call_three ++;
@@ -611,9 +881,405 @@ bool critMI(
                 }
             }
         }
+        if (hint){
+            hint->skipped_three += quadNum - quadCount;
+        }
         //timer.Stop();
     }
     return false;
 }
 
 
+
+/// The criteria below dispatch the common function counts to kernels specialized at compile time,
+/// and the others to the generic kernel.
+
+bool critIA(
+            const Eigen::Matrix<double, 4, 3> &pts,
+            const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+            const size_t funcNum,
+            const double threshold,
+            const bool curve_network,
+            bool& active,
+            int &sub_call_two,
+            int &sub_call_three,
+            pair_hint *hint)
+{
+    if (hint){
+        hint->failed = {};
+    }
+    branch_trace trace;
+    switch (funcNum){
+        case 1:
+            return record_branches(hint, trace, critIA_impl<1>(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hint, trace));
+        case 2:
+            return record_branches(hint, trace, critIA_impl<2>(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hint, trace));
+        case 3:
+            return record_branches(hint, trace, critIA_impl<3>(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hint, trace));
+        case 4:
+            return record_branches(hint, trace, critIA_impl<4>(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hint, trace));
+        case 8:
+            return record_branches(hint, trace, critIA_impl<8>(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hint, trace));
+        default:
+            return record_branches(hint, trace, critIA_impl<Eigen::Dynamic>(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hint, trace));
+    }
+}
+
+bool critCSG(
+             const Eigen::Matrix<double, 4, 3> &pts,
+             const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+             const size_t funcNum,
+             const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> &csg_func,
+             const double threshold,
+             const bool curve_network,
+             bool& active,
+             int &sub_call_two,
+             int &sub_call_three,
+             pair_hint *hint)
+{
+    if (hint){
+        hint->failed = {};
+    }
+    branch_trace trace;
+    switch (funcNum){
+        case 1:
+            return record_branches(hint, trace, critCSG_impl<1>(pts, tet_info, funcNum, csg_func, threshold, curve_network, active, sub_call_two, sub_call_three, hint, trace));
+        case 2:
+            return record_branches(hint, trace, critCSG_impl<2>(pts, tet_info, funcNum, csg_func, threshold, curve_network, active, sub_call_two, sub_call_three, hint, trace));
+        case 3:
+            return record_branches(hint, trace, critCSG_impl<3>(pts, tet_info, funcNum, csg_func, threshold, curve_network, active, sub_call_two, sub_call_three, hint, trace));
+        case 4:
+            return record_branches(hint, trace, critCSG_impl<4>(pts, tet_info, funcNum, csg_func, threshold, curve_network, active, sub_call_two, sub_call_three, hint, trace));
+        case 8:
+            return record_branches(hint, trace, critCSG_impl<8>(pts, tet_info, funcNum, csg_func, threshold, curve_network, active, sub_call_two, sub_call_three, hint, trace));
+        default:
+            return record_branches(hint, trace, critCSG_impl<Eigen::Dynamic>(pts, tet_info, funcNum, csg_func, threshold, curve_network, active, sub_call_two, sub_call_three, hint, trace));
+    }
+}
+
+bool critMI(
+            const Eigen::Matrix<double, 4, 3> &pts,
+            const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+            const size_t funcNum,
+            const double threshold,
+            const bool curve_network,
+            bool& active,
+            int &sub_call_two,
+            int &sub_call_three,
+            pair_hint *hint,
+            const bool dominance)
+{
+    if (hint){
+        hint->failed = {};
+    }
+    branch_trace trace;
+    switch (funcNum){
+        case 1:
+            return record_branches(hint, trace, critMI_impl<1>(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hint, dominance, trace));
+        case 2:
+            return record_branches(hint, trace, critMI_impl<2>(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hint, dominance, trace));
+        case 3:
+            return record_branches(hint, trace, critMI_impl<3>(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hint, dominance, trace));
+        case 4:
+            return record_branches(hint, trace, critMI_impl<4>(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hint, dominance, trace));
+        case 8:
+            return record_branches(hint, trace, critMI_impl<8>(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hint, dominance, trace));
+        default:
+            return record_branches(hint, trace, critMI_impl<Eigen::Dynamic>(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hint, dominance, trace));
+    }
+}
+
+/// Below are the batched criteria. The lane kernels are in `refine_crit_lanes.h`, and the checks of single tets follow the unbatched criteria.
+
+void tet_batch::set(size_t l,
+                    const Eigen::Matrix<double, 4, 3> &tet_pts,
+                    const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+                    const size_t funcNum)
+{
+    for (size_t i = 0; i < 4; i++){
+        for (size_t d = 0; d < 3; d++){
+            pts[i][d][l] = tet_pts(i, d);
+        }
+        for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+            for (size_t c = 0; c < 4; c++){
+                info[funcIter][i][c][l] = tet_info[i][funcIter][c];
+            }
+        }
+    }
+}
+
+void tet_batch::get(size_t l,
+                    Eigen::Matrix<double, 4, 3> &tet_pts,
+                    std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+                    const size_t funcNum) const
+{
+    for (size_t i = 0; i < 4; i++){
+        for (size_t d = 0; d < 3; d++){
+            tet_pts(i, d) = pts[i][d][l];
+        }
+        tet_info[i].resize(funcNum);
+        for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+            for (size_t c = 0; c < 4; c++){
+                tet_info[i][funcIter][c] = info[funcIter][i][c][l];
+            }
+        }
+    }
+}
+
+const batch_kernels batch_kernels_scalar = {batch_geometry_construct, batch_bezier_function, batch_filter_construct};
+
+const batch_kernels &batch_dispatch()
+{
+    static const batch_kernels &kernels = cpu_has_avx2() ? batch_kernels_avx2 : batch_kernels_scalar;
+    return kernels;
+}
+
+void batch_bezier_construct(const batch_kernels &kernels,
+                            const tet_batch &batch,
+                            const batch_geometry &geo,
+                            const size_t funcNum,
+                            const double threshold,
+                            const bool curve_network,
+                            batch_bezier &bezier)
+{
+    for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+        kernels.bezier(batch, geo, funcIter, threshold, curve_network, bezier);
+    }
+}
+
+/// Runs the multi-function checks of `critIA` and `critCSG` on the `l`th tet of a batch.
+bool batch_multi_func_check(const batch_bezier &bezier,
+                            const batch_geometry &geo,
+                            const size_t l,
+                            const FuncSet activeSet,
+                            const size_t funcNum,
+                            const double threshold,
+                            int &sub_call_two,
+                            int &sub_call_three,
+                            pair_hint *hint,
+                            branch_trace &trace)
+{
+    FuncMatrix<Eigen::Dynamic, 20> valList(funcNum, 20);
+    FuncMatrix<Eigen::Dynamic, 16> diffList(funcNum, 16);
+    Eigen::Matrix<double, 20, 3> gradList;
+    for (FuncSet rest = activeSet; rest;){
+        const int funcIter = pop_first(rest);
+        for (size_t k = 0; k < 20; k++){
+            valList(funcIter, k) = bezier.val[funcIter][k][l];
+        }
+        for (size_t k = 0; k < 16; k++){
+            diffList(funcIter, k) = bezier.diff[funcIter][k][l];
+        }
+        for (size_t d = 0; d < 3; d++){
+            gradList(funcIter, d) = bezier.grad[funcIter][d][l];
+        }
+    }
+    return multi_func_check<Eigen::Dynamic>(valList, diffList, gradList, activeSet, geo.sqD[l], threshold, sub_call_two, sub_call_three, hint, trace);
+}
+
+uint32_t critIA_batch(const tet_batch &batch,
+                      const size_t funcNum,
+                      const double threshold,
+                      const bool curve_network,
+                      uint32_t &active,
+                      int &sub_call_two,
+                      int &sub_call_three,
+                      pair_hint *hints)
+{
+    assert(funcNum <= max_func_num && batch.size <= crit_batch_width);
+    const batch_kernels &kernels = batch_dispatch();
+    batch_geometry geo;
+    kernels.geometry(batch, geo);
+    batch_filter filter;
+    kernels.filter(batch, geo, funcNum, threshold, curve_network, filter);
+    batch_bezier bezier;
+    /// the functions whose double-precision values are computed, on demand
+    FuncSet computed = 0;
+    auto compute = [&](FuncSet set)
+    {
+        for (set &= ~computed; set;){
+            const int funcIter = pop_first(set);
+            kernels.bezier(batch, geo, funcIter, threshold, curve_network, bezier);
+            computed |= FuncSet(1) << funcIter;
+        }
+    };
+    uint32_t refine = 0;
+    active = 0;
+    for (size_t l = 0; l < batch.size; l++){
+        pair_hint *hint = hints ? &hints[l] : nullptr;
+        if (hint){
+            hint->failed = {};
+        }
+        const uint32_t lane = 1u << l;
+        branch_trace trace;
+        FuncSet activeSet = 0;
+        bool refinable = false;
+        for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+            const FuncSet func = FuncSet(1) << funcIter;
+            if (!(filter.active[funcIter] & lane)){
+                if (filter.inactive[funcIter] & lane){
+                    continue;
+                }
+                compute(func);
+                if (get_sign(bezier.high[funcIter][l]) == get_sign(bezier.low[funcIter][l])){
+                    continue;
+                }
+            }
+            activeSet |= func;
+            trace.stage = crit_stats::single_function;
+            trace.active_functions++;
+            if (!(filter.refine[funcIter] & lane)){
+                if (filter.keep[funcIter] & lane){
+                    continue;
+                }
+                compute(func);
+                if (!bezier.refine[funcIter][l]){
+                    continue;
+                }
+            }
+            refinable = true;
+            break;
+        }
+        if (activeSet){
+            active |= lane;
+        }
+        if (!refinable && std::popcount(activeSet) >= 2){
+            compute(activeSet);
+            refinable = batch_multi_func_check(bezier, geo, l, activeSet, funcNum, threshold, sub_call_two, sub_call_three, hint, trace);
+        }
+        if (record_branches(hint, trace, refinable)){
+            refine |= 1u << l;
+        }
+    }
+    return refine;
+}
+
+uint32_t critCSG_batch(const tet_batch &batch,
+                       const size_t funcNum,
+                       const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> &csg_func,
+                       const double threshold,
+                       const bool curve_network,
+                       uint32_t &active,
+                       int &sub_call_two,
+                       int &sub_call_three,
+                       pair_hint *hints)
+{
+    assert(funcNum <= max_func_num && batch.size <= crit_batch_width);
+    const batch_kernels &kernels = batch_dispatch();
+    batch_geometry geo;
+    kernels.geometry(batch, geo);
+    batch_bezier bezier;
+    batch_bezier_construct(kernels, batch, geo, funcNum, threshold, curve_network, bezier);
+    /// the tree's intervals and active functions of all tets at once, if `csg_func` wraps a `csg_program`
+    const csg_program *program = csg_func.target<csg_program>();
+    batch_lanes csg_low, csg_high;
+    std::array<FuncSet, crit_batch_width> csg_active;
+    if (program){
+        program->evaluate_batch<crit_batch_width>(std::span(bezier.low.data(), funcNum), std::span(bezier.high.data(), funcNum), csg_low, csg_high, csg_active);
+    }
+    uint32_t refine = 0;
+    active = 0;
+    for (size_t l = 0; l < batch.size; l++){
+        pair_hint *hint = hints ? &hints[l] : nullptr;
+        if (hint){
+            hint->failed = {};
+        }
+        branch_trace trace;
+        std::pair<std::array<double, 2>, FuncSet> csgResult;
+        if (program){
+            csgResult = {{csg_low[l], csg_high[l]}, csg_active[l]};
+        } else {
+            llvm_vecsmall::SmallVector<std::array<double , 2>, 20> funcInt(funcNum);
+            for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                funcInt[funcIter] = {bezier.low[funcIter][l], bezier.high[funcIter][l]};
+            }
+            csgResult = evaluate_csg(csg_func, funcInt);
+        }
+        if(csgResult.first[0] * csgResult.first[1] > 0){
+            record_branches(hint, trace, false);
+            continue;
+        }
+        FuncSet activeSet = 0;
+        bool refinable = false;
+        for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+            if ((csgResult.second >> funcIter) & 1){
+                activeSet |= FuncSet(1) << funcIter;
+                trace.stage = crit_stats::single_function;
+                trace.active_functions++;
+                if (bezier.refine[funcIter][l]){
+                    refinable = true;
+                    break;
+                }
+            }
+        }
+        if (activeSet){
+            active |= 1u << l;
+        }
+        if (!refinable && std::popcount(activeSet) >= 2){
+            refinable = batch_multi_func_check(bezier, geo, l, activeSet, funcNum, threshold, sub_call_two, sub_call_three, hint, trace);
+        }
+        if (record_branches(hint, trace, refinable)){
+            refine |= 1u << l;
+        }
+    }
+    return refine;
+}
+
+bool zero_crossing_criterion::operator()(const Eigen::Matrix<double, 4, 3> &pts,
+                                         const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+                                         bool &active,
+                                         [[maybe_unused]] int &sub_call_two,
+                                         [[maybe_unused]] int &sub_call_three,
+                                         [[maybe_unused]] pair_hint *hint) const
+{
+    assert(funcNum <= max_func_num);
+    Eigen::Matrix<double, 3, 6> vec;
+    vec << (pts.row(1) - pts.row(0)).transpose(), (pts.row(2) - pts.row(0)).transpose(), (pts.row(3) - pts.row(0)).transpose(),
+    (pts.row(2) - pts.row(1)).transpose(), (pts.row(3) - pts.row(1)).transpose(), (pts.row(3) - pts.row(2)).transpose();
+    llvm_vecsmall::SmallVector<std::array<double , 2>, 20> funcInt(funcNum);
+    for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+        Eigen::Matrix4d func_info;
+        func_info << tet_info[0][funcIter], tet_info[1][funcIter], tet_info[2][funcIter], tet_info[3][funcIter];
+        Eigen::Vector<double, 20> valList = bezierConstruct(func_info.col(0).transpose(), func_info.rightCols(3), vec);
+        funcInt[funcIter] = {valList.minCoeff(), valList.maxCoeff()};
+    }
+    switch (mode){
+        case IA:
+            for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                if (get_sign(funcInt[funcIter][1]) != get_sign(funcInt[funcIter][0])){
+                    active = true;
+                    break;
+                }
+            }
+            break;
+        case CSG: {
+            std::pair<std::array<double, 2>, FuncSet> csgResult = evaluate_csg(csg_func, funcInt);
+            active = csgResult.first[0] * csgResult.first[1] <= 0 && csgResult.second;
+            break;
+        }
+        case MI: {
+            double maxLow = -std::numeric_limits<double>::infinity();
+            for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                maxLow = std::max(maxLow, funcInt[funcIter][0]);
+            }
+            int activeNum = 0;
+            for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                if (funcInt[funcIter][1] > maxLow){
+                    activeNum++;
+                }
+            }
+            active = activeNum >= 2;
+            break;
+        }
+        default:
+            throw std::runtime_error("no implicit complexes specified");
+    }
+    if (!active){
+        return false;
+    }
+    double longest_edge_length = 0;
+    for (int i = 0; i < 6; i++){
+        longest_edge_length = std::max(longest_edge_length, vec.col(i).squaredNorm());
+    }
+    return longest_edge_length > max_edge_length * max_edge_length;
+}
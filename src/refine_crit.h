@@ -7,6 +7,8 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
+#include <functional>
 #include "SmallVector.h"
 #include "3rd/contains.h"
 #include <Eigen/Core>
@@ -20,7 +22,63 @@ enum geo_obj {
     MI /*2*/
 };
 
+/// Counters of the branches the criteria take, summed over the tets they're called on. The criteria run in stages, and a call returns in one of them:
+/// the zero-crossing tests of single functions (`sign_test`), their distance checks (`single_function`), the zero-crossing tests of pairs of functions by
+/// 2D convex hulls with the two functions' distance checks (`hull_2d`), and the zero-crossing tests of triples by 3D convex hulls with the three functions'
+/// distance checks (`hull_3d`). For MI the functions of a stage are one material more: pairs of materials, triples and quadruples.
+struct crit_stats
+{
+    enum stage {
+        sign_test, /*0*/
+        single_function, /*1*/
+        hull_2d, /*2*/
+        hull_3d, /*3*/
+        stage_count
+    };
+    /// The number of buckets of `hull_calls`.
+    static constexpr size_t hull_buckets = 12;
+    
+    /// `exits[s][r]` is the number of tets whose criterion returned in stage `s`, with `r` whether the tet is refinable.
+    std::array<std::array<uint64_t, 2>, stage_count> exits = {};
+    /// The number of calls of `convex_hull_membership::contains` in 2D and 3D.
+    uint64_t hull_2d_calls = 0;
+    uint64_t hull_3d_calls = 0;
+    /// A histogram of tets by their number of active functions. A criterion that returns in `single_function` only counts the functions before the returning one.
+    std::array<uint64_t, 21> active_functions = {};
+    /// A histogram of tets by their number of `contains` calls: bucket 0 counts the tets without a call, bucket `b` the tets with 2^(b-1) to 2^b - 1 calls,
+    /// and the last bucket all the tets with more.
+    std::array<uint64_t, hull_buckets> hull_calls = {};
+    
+    /// Adds a call of a criterion.
+    void record(stage exit, bool refinable, int active_num, int hull_2d_num, int hull_3d_num);
+    /// Adds the counters of `other`, e.g., of another thread.
+    void merge(const crit_stats &other);
+    /// The number of tets counted.
+    uint64_t tets() const;
+};
+
+/// Pairs of functions in a tet as bitsets, used to carry the two functions' zero-crossing tests from a tet to its children.
+/// The `i`th entry of a table has the `j`th bit set for the pair of functions `i` and `j`.
+struct pair_hint
+{
+    /// [in] The pairs whose two functions' checks are skipped, e.g., the pairs whose zero-crossing test failed in the parent tet.
+    std::array<uint32_t, 20> skip = {};
+    /// [out] The pairs with no zero-crossing in the tet, including the skipped ones.
+    std::array<uint32_t, 20> failed = {};
+    /// [out] A tracker of how many two functions' checks are skipped by `skip`.
+    int skipped_two = 0;
+    /// [out] A tracker of how many three functions' checks are skipped, as one of their pairs has no zero-crossing.
+    int skipped_three = 0;
+    /// [in,out] The function whose single-function checks run first in `critIA` and `critCSG`, or -1. It's set to the function whose distance check
+    /// makes a tet refinable, so a hint reused over the tets of a loop starts from the function that refined the last one, which is likely to refine the next
+    /// nearby tet as well. The order doesn't change the results, as a tet is refinable if any of its functions fails the check.
+    int first = -1;
+    /// [out] The branches taken by the criteria called with this hint.
+    crit_stats stats;
+};
+
 /// Three types of refinement criteria based on the modality.
+/// They support up to 20 functions and use fixed-capacity buffers, so a call doesn't allocate on the heap.
 
 /// This function performs two checks (zero-crossing and distance checks) under the setting of implicit arrangement(IA) and its curve network.
 ///
@@ -32,41 +90,136 @@ enum geo_obj {
 /// @param[out] active          A `bool` represents whether the tet is containing part of the geometry, i.e., this tet passes the zero-crossing test.
 /// @param[out] sub_call_two            A tracker of how many times two functions' distance check is called.
 /// @param[out] sub_call_two            A tracker of how many times three functions' distance check is called.
+/// @param[in,out] hint         Optional pairs to skip and the trackers of skipped checks, see `pair_hint`. The active functions and their pairs are
+/// stored as bitsets, so the candidate triples are the intersections of the bitsets of their pairs.
 ///
 /// @return         A `bool` represents whether the tet is "refinable".
 ///  i.e., passing the zero-crossing test and contains error greater than `threshold`.
 ///
 bool critIA(const Eigen::Matrix<double, 4, 3> &pts,
-            const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info,
+            const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
             const size_t funcNum,
             const double threshold,
             const bool curve_network,
             bool &active,
             int &sub_call_two,
-            int &sub_call_three);
+            int &sub_call_three,
+            pair_hint *hint = nullptr);
 
 ///This function performs two checks (zero-crossing and distance checks) under the setting of constructive solid geometry(CSG) and its curve network.
 ///The parameters follow the same style of `critIA`. Below is the only different input.
 ///
+/// @param[in] csg_func         The CSG tree, see `gridRefine`. If it wraps a `csg_program`, the program is evaluated directly.
+/// Only the functions the tree refers to are checked, when it's a `csg_program`.
 ///
 bool critCSG(const Eigen::Matrix<double, 4, 3> &pts,
-             const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info,
+             const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
              const size_t funcNum,
-             const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func,
+             const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> &csg_func,
              const double threshold,
              const bool curve_network,
              bool& active,
              int &sub_call_two,
-             int &sub_call_three);
+             int &sub_call_three,
+             pair_hint *hint = nullptr);
 
 /// This function performs two checks (zero-crossing and distance checks) under the setting of material interface (MI) and its curve network.
-/// The parameters follow the same as in `critIA`. see above.
+/// The parameters follow the same as in `critIA`. see above. `hint` only tracks the skipped checks:
+/// its two and three functions' checks are the checks on triples and quadruples of materials.
+///
+/// @param[in] dominance            Whether the materials whose bezier values are below those of another material at all control points are discarded
+/// before the pairs, triples and quadruples are built. Such a material is never the maximum in the tet, but its crossings with other materials
+/// below the maximum are otherwise checked, so the tet may be refined less.
 bool critMI(const Eigen::Matrix<double, 4, 3> &pts,
-            const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info,
+            const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
             const size_t funcNum,
             const double threshold,
             const bool curve_network,
             bool& active,
             int &sub_call_two,
-            int &sub_call_three);
+            int &sub_call_three,
+            pair_hint *hint = nullptr,
+            const bool dominance = false);
+
+/// The number of tets evaluated together by the batched criteria.
+constexpr size_t crit_batch_width = 8;
+
+/// Input of the batched criteria in structure-of-arrays layout: every array runs across the tets of a batch,
+/// so that the per-tet arithmetic of the criteria maps onto SIMD lanes.
+struct tet_batch {
+    /// The number of tets in the batch. Lanes from `size` on are ignored.
+    size_t size = 0;
+    /// `pts[i][d][l]` is the `d`th coordinate of the `i`th vertex of the `l`th tet.
+    std::array<std::array<std::array<double, crit_batch_width>, 3>, 4> pts = {};
+    /// `info[f][i][c][l]` is the value (`c` = 0) or the gradient (`c` = 1, 2, 3) of the `f`th function at the `i`th vertex of the `l`th tet.
+    std::array<std::array<std::array<std::array<double, crit_batch_width>, 4>, 4>, 20> info = {};
+
+    /// Stores a tet in lane `l`. The parameters follow `critIA`.
+    void set(size_t l,
+             const Eigen::Matrix<double, 4, 3> &pts,
+             const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+             const size_t funcNum);
+
+    /// Loads the tet of lane `l`. The parameters follow `critIA`.
+    void get(size_t l,
+             Eigen::Matrix<double, 4, 3> &pts,
+             std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+             const size_t funcNum) const;
+};
+
+/// Batched version of `critIA` on the tets of `batch`.
+/// The bezier construction and the single-function checks run across the tets of the batch, in AVX2 registers if the CPU supports it.
+/// They run in single precision first, with bounds of the rounding errors, and the double-precision values are only computed
+/// for the outcomes that the bounds leave uncertain, so the results are the same as from `critIA`.
+/// Tets that need the multi-function checks continue one by one.
+///
+/// @param[in] batch            The tets in structure-of-arrays layout.
+/// @param[out] active          A bitmask whose `l`th bit represents whether the `l`th tet is active.
+/// @param[in,out] hints            Optional `pair_hint` of every tet in the batch.
+///
+/// The other parameters follow `critIA`.
+///
+/// @return         A bitmask whose `l`th bit represents whether the `l`th tet is refinable.
+uint32_t critIA_batch(const tet_batch &batch,
+                      const size_t funcNum,
+                      const double threshold,
+                      const bool curve_network,
+                      uint32_t &active,
+                      int &sub_call_two,
+                      int &sub_call_three,
+                      pair_hint *hints = nullptr);
+
+/// Batched version of `critCSG` on the tets of `batch`. The parameters follow `critIA_batch` and `critCSG`.
+/// `csg_func` is called once per tet, unless it wraps a `csg_program`, which is evaluated on all tets of the batch at once.
+uint32_t critCSG_batch(const tet_batch &batch,
+                       const size_t funcNum,
+                       const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> &csg_func,
+                       const double threshold,
+                       const bool curve_network,
+                       uint32_t &active,
+                       int &sub_call_two,
+                       int &sub_call_three,
+                       pair_hint *hints = nullptr);
+
+/// The kernels of the criteria, declared here for the benchmarks in `tests/bench`. See their definitions for the parameters.
+
+/// The values of one function at the 20 bezier control points of a tet, from its values and gradients at the vertices.
+Eigen::Vector<double, 20> bezierConstruct(const Eigen::RowVector4d vals,
+                                          const Eigen::Matrix<double, 4, 3> grads,
+                                          const Eigen::Matrix<double, 3, 6> vec);
+
+/// The differences between the bezier values and the linear interpolation at the 16 control points off the vertices.
+Eigen::Vector<double, 16> bezierDiff(const Eigen::Vector<double,20> valList);
+
+/// The distance check of two functions' intersection curve.
+bool two_func_check (Eigen::Matrix<double, 2, 3> grad,
+                     const Eigen::Matrix<double, 16, 2> diff_matrix,
+                     const double sqD,
+                     const double threshold);
+
+/// The distance check of three functions' intersection point.
+bool three_func_check (Eigen::Matrix<double, 3, 3> grad,
+                       const Eigen::Matrix<double, 16, 3> diff_matrix,
+                       const double sqD,
+                       const double threshold);
 
@@ -0,0 +1,96 @@
+// The AVX2 kernels of the batched criteria. The code after the pragmas is compiled for AVX2 without changing the build flags, so only the
+// intrinsics and the lane kernels, which have internal linkage, are included after them: an inline function of another header compiled for AVX2
+// here could be shared with the translation units that run on any CPU. FMA isn't enabled, so the products and sums are rounded as in the kernels
+// compiled with the build flags.
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include "refine_crit_batch.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("avx2")
+#endif
+
+#include <immintrin.h>
+
+namespace {
+
+static_assert(crit_batch_width == 8, "the AVX2 lanes hold 8 tets");
+
+/// 8 doubles in two AVX registers.
+struct dlanes
+{
+    __m256d lo, hi;
+};
+
+/// 8 floats in an AVX register.
+struct flanes
+{
+    __m256 v;
+};
+
+inline dlanes broadcast(double a) { return {_mm256_set1_pd(a), _mm256_set1_pd(a)}; }
+inline flanes broadcast(float a) { return {_mm256_set1_ps(a)}; }
+inline dlanes load(const batch_lanes &x) { return {_mm256_loadu_pd(x.data()), _mm256_loadu_pd(x.data() + 4)}; }
+inline void store(dlanes a, batch_lanes &x)
+{
+    _mm256_storeu_pd(x.data(), a.lo);
+    _mm256_storeu_pd(x.data() + 4, a.hi);
+}
+
+inline dlanes operator+(dlanes a, dlanes b) { return {_mm256_add_pd(a.lo, b.lo), _mm256_add_pd(a.hi, b.hi)}; }
+inline dlanes operator-(dlanes a, dlanes b) { return {_mm256_sub_pd(a.lo, b.lo), _mm256_sub_pd(a.hi, b.hi)}; }
+inline dlanes operator*(dlanes a, dlanes b) { return {_mm256_mul_pd(a.lo, b.lo), _mm256_mul_pd(a.hi, b.hi)}; }
+inline dlanes operator/(dlanes a, dlanes b) { return {_mm256_div_pd(a.lo, b.lo), _mm256_div_pd(a.hi, b.hi)}; }
+inline dlanes operator*(double a, dlanes b) { return broadcast(a) * b; }
+inline dlanes operator*(dlanes a, double b) { return a * broadcast(b); }
+inline dlanes operator/(dlanes a, double b) { return a / broadcast(b); }
+
+inline flanes operator+(flanes a, flanes b) { return {_mm256_add_ps(a.v, b.v)}; }
+inline flanes operator-(flanes a, flanes b) { return {_mm256_sub_ps(a.v, b.v)}; }
+inline flanes operator*(flanes a, flanes b) { return {_mm256_mul_ps(a.v, b.v)}; }
+inline flanes operator/(flanes a, flanes b) { return {_mm256_div_ps(a.v, b.v)}; }
+inline flanes operator+(flanes a, float b) { return a + broadcast(b); }
+inline flanes operator-(flanes a, float b) { return a - broadcast(b); }
+inline flanes operator*(float a, flanes b) { return broadcast(a) * b; }
+inline flanes operator*(flanes a, float b) { return a * broadcast(b); }
+inline flanes operator/(flanes a, float b) { return a / broadcast(b); }
+
+// `_mm256_min_pd(a, b)` is `a < b ? a : b`, so the operands are swapped to match `std::min(a, b)`, which is `b < a ? b : a`, also for NaN
+inline dlanes lane_min(dlanes a, dlanes b) { return {_mm256_min_pd(b.lo, a.lo), _mm256_min_pd(b.hi, a.hi)}; }
+inline dlanes lane_max(dlanes a, dlanes b) { return {_mm256_max_pd(b.lo, a.lo), _mm256_max_pd(b.hi, a.hi)}; }
+inline dlanes lane_abs(dlanes a) { return {_mm256_andnot_pd(_mm256_set1_pd(-0.0), a.lo), _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.hi)}; }
+inline flanes lane_min(flanes a, flanes b) { return {_mm256_min_ps(b.v, a.v)}; }
+inline flanes lane_max(flanes a, flanes b) { return {_mm256_max_ps(b.v, a.v)}; }
+inline flanes lane_abs(flanes a) { return {_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v)}; }
+
+inline flanes to_float(dlanes a) { return {_mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(a.lo)), _mm256_cvtpd_ps(a.hi), 1)}; }
+inline uint32_t less(dlanes a, dlanes b)
+{
+    return uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(a.lo, b.lo, _CMP_LT_OQ)))
+        | uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(a.hi, b.hi, _CMP_LT_OQ))) << 4;
+}
+inline uint32_t less(flanes a, flanes b) { return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ))); }
+
+} // namespace
+
+#include "refine_crit_lanes.h"
+
+const batch_kernels batch_kernels_avx2 = {batch_geometry_construct, batch_bezier_function, batch_filter_construct};
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#else
+
+// `cpu_has_avx2` is false off x86-64, so these are never called.
+const batch_kernels batch_kernels_avx2 = {nullptr, nullptr, nullptr};
+
+#endif
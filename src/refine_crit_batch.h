@@ -0,0 +1,58 @@
+#pragma once
+
+#include "refine_crit.h"
+
+/// The lane kernels of the batched criteria, only included by their translation units (`refine_crit.cpp` and `refine_crit_avx2.cpp`).
+/// Every quantity of a tet is stored across the lanes of a `batch_lanes`. The kernels are compiled twice, with the build flags and for AVX2,
+/// and chosen once at runtime from the instruction sets of the CPU. Both compute the same operations in the same order, so the results are
+/// the same bit for bit.
+
+using batch_lanes = std::array<double, crit_batch_width>;
+
+/// The tet geometry shared by all functions of a batch.
+struct batch_geometry {
+    /// The 6 edge vectors p1 - p0, p2 - p0, p3 - p0, p2 - p1, p3 - p1, p3 - p2 as in `bezierConstruct`.
+    std::array<std::array<batch_lanes, 3>, 6> vec;
+    /// The columns of the cross product matrix used for the un-normalized gradients.
+    std::array<std::array<batch_lanes, 3>, 3> cross;
+    /// The squared determinant of the first three edge vectors.
+    batch_lanes sqD;
+};
+
+/// The bezier values, the differences to the linear interpolation, and the un-normalized linear gradients of all functions in a batch.
+struct batch_bezier {
+    std::array<std::array<batch_lanes, 20>, 20> val;
+    std::array<std::array<batch_lanes, 16>, 20> diff;
+    std::array<std::array<batch_lanes, 3>, 20> grad;
+    /// the range of the bezier values
+    std::array<batch_lanes, 20> low, high;
+    /// whether the single-function distance check fails, assuming that the function is active
+    std::array<std::array<bool, crit_batch_width>, 20> refine;
+};
+
+/// The outcomes of the single-function checks certified by the filter, as bitmasks whose `l`th bit stands for the `l`th tet.
+struct batch_filter {
+    /// the function is certainly active or inactive
+    std::array<uint32_t, 20> active, inactive;
+    /// the distance check of the function certainly fails (`refine`) or passes (`keep`)
+    std::array<uint32_t, 20> refine, keep;
+};
+
+/// The kernels of one instruction set.
+struct batch_kernels {
+    /// Computes the tet geometry of a batch.
+    void (*geometry)(const tet_batch &batch, batch_geometry &geo);
+    /// Computes the double-precision bezier values, differences and gradients of the `funcIter`th function on all tets of a batch.
+    void (*bezier)(const tet_batch &batch, const batch_geometry &geo, const size_t funcIter, const double threshold, const bool curve_network, batch_bezier &bezier);
+    /// Certifies the outcomes of the single-function checks of the first `funcNum` functions in single precision.
+    void (*filter)(const tet_batch &batch, const batch_geometry &geo, const size_t funcNum, const double threshold, const bool curve_network, batch_filter &filter);
+};
+
+/// The kernels compiled with the build flags.
+extern const batch_kernels batch_kernels_scalar;
+
+/// The AVX2 kernels. They may only be called if `cpu_has_avx2()`.
+extern const batch_kernels batch_kernels_avx2;
+
+/// The kernels chosen for this CPU.
+const batch_kernels &batch_dispatch();
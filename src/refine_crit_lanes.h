@@ -0,0 +1,236 @@
+#pragma once
+
+// The lane kernels of the batched criteria, only included by the translation units of the kernels (`refine_crit.cpp` and `refine_crit_avx2.cpp`).
+// They expect the lane types `dlanes` and `flanes` of 8 doubles and 8 floats, one lane per tet of a batch, with the arithmetic operators,
+// also with a scalar on either side, and
+//   broadcast(a), load(x) and store(a, x) to convert from a scalar and from and to `batch_lanes`,
+//   lane_min(a, b), lane_max(a, b) and lane_abs(a) following `std::min`, `std::max` and `std::abs` in every lane,
+//   to_float(a) rounding `dlanes` to `flanes`, and less(a, b) returning the bitmask of the lanes where `a < b`.
+// The kernels are in an unnamed namespace, so a translation unit compiled for an instruction set doesn't share their code with another one.
+// The arithmetic follows the order of `bezierConstruct`, `bezierDiff` and the single-function checks in `refine_crit.cpp`,
+// so a tet gets the same result as from the unbatched criteria.
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include "refine_crit_batch.h"
+
+namespace {
+
+/// edge vectors and signs of the 3 control points next to each vertex, see `bezierConstruct`
+constexpr std::array<std::array<int, 3>, 4> vertex_edges = {{{0, 1, 2}, {3, 4, 0}, {5, 1, 3}, {2, 4, 5}}};
+constexpr std::array<std::array<double, 3>, 4> vertex_signs = {{{1, 1, 1}, {1, 1, -1}, {1, -1, -1}, {-1, -1, -1}}};
+/// Constant coefficient to obtain linear interpolated values at each bezier control points
+constexpr std::array<std::array<double, 4>, 16> linear_coeff = {{{2, 1, 0, 0}, {2, 0, 1, 0}, {2, 0, 0, 1}, {0, 2, 1, 0},{0, 2, 0, 1}, {1, 2, 0, 0}, {0, 0, 2, 1}, {1, 0, 2, 0},{0, 1, 2, 0}, {1, 0, 0, 2}, {0, 1, 0, 2}, {0, 0, 1, 2},{0, 1, 1, 1}, {1, 0, 1, 1}, {1, 1, 0, 1}, {1, 1, 1, 0}}};
+
+void batch_geometry_construct(const tet_batch &batch, batch_geometry &geo)
+{
+    constexpr std::array<std::array<int, 2>, 6> edges = {{{1, 0}, {2, 0}, {3, 0}, {2, 1}, {3, 1}, {3, 2}}};
+    std::array<std::array<dlanes, 3>, 6> vec;
+    for (size_t e = 0; e < 6; e++){
+        for (size_t d = 0; d < 3; d++){
+            vec[e][d] = load(batch.pts[edges[e][0]][d]) - load(batch.pts[edges[e][1]][d]);
+            store(vec[e][d], geo.vec[e][d]);
+        }
+    }
+    const auto &e1 = vec[0], &e2 = vec[1], &e3 = vec[2];
+    const dlanes D = e1[0] * (e2[1] * e3[2] - e3[1] * e2[2])
+                   - e2[0] * (e1[1] * e3[2] - e3[1] * e1[2])
+                   + e3[0] * (e1[1] * e2[2] - e2[1] * e1[2]);
+    store(D * D, geo.sqD);
+    const std::array<std::array<size_t, 2>, 3> cross_pairs = {{{1, 2}, {2, 0}, {0, 1}}};
+    for (size_t k = 0; k < 3; k++){
+        const auto &a = vec[cross_pairs[k][0]], &b = vec[cross_pairs[k][1]];
+        store(a[1] * b[2] - a[2] * b[1], geo.cross[k][0]);
+        store(a[2] * b[0] - a[0] * b[2], geo.cross[k][1]);
+        store(a[0] * b[1] - a[1] * b[0], geo.cross[k][2]);
+    }
+}
+
+void batch_bezier_function(const tet_batch &batch,
+                           const batch_geometry &geo,
+                           const size_t funcIter,
+                           const double threshold,
+                           const bool curve_network,
+                           batch_bezier &bezier)
+{
+    const double rhs_scale = curve_network ? std::numeric_limits<double>::infinity() : threshold * threshold;
+    const auto &info = batch.info[funcIter];
+    std::array<dlanes, 20> val;
+    for (size_t i = 0; i < 4; i++){
+        val[i] = load(info[i][0]);
+    }
+    for (size_t i = 0; i < 4; i++){
+        const dlanes grad_x = load(info[i][1]), grad_y = load(info[i][2]), grad_z = load(info[i][3]);
+        for (size_t j = 0; j < 3; j++){
+            const auto &e = geo.vec[vertex_edges[i][j]];
+            const dlanes dot = grad_x * load(e[0]) + grad_y * load(e[1]) + grad_z * load(e[2]);
+            val[4 + 3 * i + j] = dot / 3 * vertex_signs[i][j] + val[i];
+        }
+    }
+    /// the control points at face centers, opposite to each vertex
+    val[16] = (9 * (val[7] + val[8] + val[10] + val[12] + val[14] + val[15]) / 6 - val[1] - val[2] - val[3])/ 6;
+    val[17] = (9 * (val[5] + val[6] + val[10] + val[11] + val[13] + val[15]) / 6 - val[0] - val[2] - val[3])/ 6;
+    val[18] = (9 * (val[4] + val[6] + val[8] + val[9] + val[13] + val[14]) / 6 - val[0] - val[1] - val[3])/ 6;
+    val[19] = (9 * (val[4] + val[5] + val[7] + val[9] + val[11] + val[12]) / 6 - val[0] - val[1] - val[2])/ 6;
+    dlanes low = val[0], high = val[0];
+    for (size_t k = 0; k < 20; k++){
+        store(val[k], bezier.val[funcIter][k]);
+        low = lane_min(low, val[k]);
+        high = lane_max(high, val[k]);
+    }
+    store(low, bezier.low[funcIter]);
+    store(high, bezier.high[funcIter]);
+    dlanes error = broadcast(0.0);
+    for (size_t k = 0; k < 16; k++){
+        const auto &c = linear_coeff[k];
+        const dlanes linear_val = c[0] * val[0] + c[1] * val[1] + c[2] * val[2] + c[3] * val[3];
+        const dlanes diff = val[4 + k] - linear_val / 3;
+        store(diff, bezier.diff[funcIter][k]);
+        error = lane_max(error, lane_abs(diff));
+    }
+    std::array<dlanes, 3> grad;
+    for (size_t d = 0; d < 3; d++){
+        grad[d] = (val[1] - val[0]) * load(geo.cross[0][d]) + (val[2] - val[0]) * load(geo.cross[1][d]) + (val[3] - val[0]) * load(geo.cross[2][d]);
+        store(grad[d], bezier.grad[funcIter][d]);
+    }
+    const dlanes lhs = error * error * load(geo.sqD);
+    const dlanes rhs = rhs_scale * (grad[0] * grad[0] + grad[1] * grad[1] + grad[2] * grad[2]);
+    const uint32_t refine = less(rhs, lhs);
+    for (size_t l = 0; l < crit_batch_width; l++){
+        bezier.refine[funcIter][l] = (refine >> l) & 1;
+    }
+}
+
+/// Below is a single-precision filter in front of the single-function checks of `critIA_batch`.
+/// It repeats `batch_bezier_function` in float, so twice as many tets fit into a SIMD register, and bounds the rounding errors a priori.
+/// An outcome is certain if it stays the same over the whole error range, which also covers the rounding of the double-precision
+/// values. The double-precision values are only computed for the uncertain outcomes and the multi-function checks.
+///
+/// The bounds are absolute and hold after scaling the inputs by powers of two, which is exact: the edge vectors by `s`, so that
+/// their coordinates are below 1, and the values and gradients of a function by `sigma` and `sigma / s`, so that `|f| + |∇f|_1`
+/// is at most 1 at each vertex. With `u = 2^-24`, the scaled bezier values are then at most 2 and within `24u` of the exact ones,
+/// the differences to the linear interpolation within `32u`, and the coordinates of the un-normalized gradient within `68u`.
+/// Both sides of the distance check are scaled by `sigma^2 s^6`.
+
+/// Returns the power of two `2^-k` that scales `m` into [0.5, 1), or 0 if `m` isn't a positive finite number or `|k| > max_exp`.
+/// It reads the exponent from the bits of `m`, so it has no branches.
+inline double inverse_pow2(const double m, const int64_t max_exp)
+{
+    // NaN, infinity, zero, subnormal and negative numbers all end up out of range
+    const int64_t k = int64_t(std::bit_cast<uint64_t>(m) >> 52) - 1022;
+    const double scale = std::bit_cast<double>(uint64_t(1023 - std::clamp(k, -max_exp, max_exp)) << 52);
+    return std::abs(k) <= max_exp ? scale : 0;
+}
+
+void batch_filter_construct(const tet_batch &batch,
+                            const batch_geometry &geo,
+                            const size_t funcNum,
+                            const double threshold,
+                            const bool curve_network,
+                            batch_filter &filter)
+{
+    constexpr float u = 0x1p-24f;
+    /// the error bounds of the scaled values, differences and gradient coordinates, rounded up
+    constexpr float val_bound = 32 * u, diff_bound = 40 * u, grad_bound = 80 * u;
+    /// margins for the roundings of the final products and for underflow
+    constexpr float low_factor = 1 - 16 * u, high_factor = 1 + 16 * u, tiny = 0x1p-100f;
+
+    /// the scaled tet geometry, with `s` and `1 / s` set to 0 where the lane is left to the double-precision path
+    dlanes max_coord = broadcast(0.0);
+    for (size_t e = 0; e < 6; e++){
+        for (size_t d = 0; d < 3; d++){
+            max_coord = lane_max(max_coord, lane_abs(load(geo.vec[e][d])));
+        }
+    }
+    batch_lanes edge_scales, inverse_edge_scales;
+    store(max_coord, edge_scales);
+    for (size_t l = 0; l < crit_batch_width; l++){
+        // a finite `sqD` implies finite edge vectors
+        const double s = inverse_pow2(std::isfinite(geo.sqD[l]) ? edge_scales[l] : 0, 100);
+        const double rhs = threshold * threshold * s * s;
+        const bool valid = s > 0 && (curve_network || (rhs >= 0x1p-60 && rhs <= 0x1p60));
+        edge_scales[l] = valid ? s : 0;
+        inverse_edge_scales[l] = valid ? 1 / s : 0;
+    }
+    const dlanes edge_scale = load(edge_scales), inverse_edge_scale = load(inverse_edge_scales);
+    const dlanes edge_scale2 = edge_scale * edge_scale;
+    std::array<std::array<flanes, 3>, 6> vec;
+    std::array<std::array<flanes, 3>, 3> cross;
+    for (size_t d = 0; d < 3; d++){
+        for (size_t e = 0; e < 6; e++){
+            vec[e][d] = to_float(edge_scale * load(geo.vec[e][d]));
+        }
+        for (size_t k = 0; k < 3; k++){
+            cross[k][d] = to_float(edge_scale2 * load(geo.cross[k][d]));
+        }
+    }
+    const flanes sqD = to_float(edge_scale2 * edge_scale2 * edge_scale2 * load(geo.sqD));
+    const flanes rhs_scale = to_float(threshold * threshold * edge_scale2);
+    
+    for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+        const auto &info = batch.info[funcIter];
+        // the sum over the vertices bounds every vertex, and NaN or infinite inputs make it NaN or infinite
+        dlanes sum = broadcast(0.0);
+        for (size_t i = 0; i < 4; i++){
+            sum = sum + (lane_abs(load(info[i][0])) + (lane_abs(load(info[i][1])) + lane_abs(load(info[i][2])) + lane_abs(load(info[i][3]))) * inverse_edge_scale);
+        }
+        batch_lanes val_scales;
+        store(sum, val_scales);
+        uint32_t valid = 0;
+        for (size_t l = 0; l < crit_batch_width; l++){
+            val_scales[l] = edge_scales[l] > 0 ? inverse_pow2(val_scales[l], 500) : 0;
+            valid |= uint32_t(val_scales[l] > 0) << l;
+        }
+        const dlanes val_scale = load(val_scales);
+        const dlanes grad_scale = val_scale * inverse_edge_scale;
+        std::array<flanes, 20> val;
+        for (size_t i = 0; i < 4; i++){
+            val[i] = to_float(val_scale * load(info[i][0]));
+        }
+        for (size_t i = 0; i < 4; i++){
+            const flanes grad_x = to_float(grad_scale * load(info[i][1]));
+            const flanes grad_y = to_float(grad_scale * load(info[i][2]));
+            const flanes grad_z = to_float(grad_scale * load(info[i][3]));
+            for (size_t j = 0; j < 3; j++){
+                const auto &e = vec[vertex_edges[i][j]];
+                const flanes dot = grad_x * e[0] + grad_y * e[1] + grad_z * e[2];
+                val[4 + 3 * i + j] = dot / 3 * float(vertex_signs[i][j]) + val[i];
+            }
+        }
+        val[16] = (9 * (val[7] + val[8] + val[10] + val[12] + val[14] + val[15]) / 6 - val[1] - val[2] - val[3])/ 6;
+        val[17] = (9 * (val[5] + val[6] + val[10] + val[11] + val[13] + val[15]) / 6 - val[0] - val[2] - val[3])/ 6;
+        val[18] = (9 * (val[4] + val[6] + val[8] + val[9] + val[13] + val[14]) / 6 - val[0] - val[1] - val[3])/ 6;
+        val[19] = (9 * (val[4] + val[5] + val[7] + val[9] + val[11] + val[12]) / 6 - val[0] - val[1] - val[2])/ 6;
+        flanes low = val[0], high = val[0], error = broadcast(0.0f);
+        for (size_t k = 1; k < 20; k++){
+            low = lane_min(low, val[k]);
+            high = lane_max(high, val[k]);
+        }
+        for (size_t k = 0; k < 16; k++){
+            const auto &c = linear_coeff[k];
+            const flanes linear_val = float(c[0]) * val[0] + float(c[1]) * val[1] + float(c[2]) * val[2] + float(c[3]) * val[3];
+            error = lane_max(error, lane_abs(val[4 + k] - linear_val / 3));
+        }
+        flanes grad_low = broadcast(0.0f), grad_high = broadcast(0.0f);
+        for (size_t d = 0; d < 3; d++){
+            const flanes grad = lane_abs((val[1] - val[0]) * cross[0][d] + (val[2] - val[0]) * cross[1][d] + (val[3] - val[0]) * cross[2][d]);
+            const flanes grad_lower = lane_max(grad - grad_bound, broadcast(0.0f)), grad_upper = grad + grad_bound;
+            grad_low = grad_low + grad_lower * grad_lower;
+            grad_high = grad_high + grad_upper * grad_upper;
+        }
+        const flanes error_low = lane_max(error - diff_bound, broadcast(0.0f)), error_high = error + diff_bound;
+        const flanes lhs_low = error_low * error_low * sqD * low_factor - tiny;
+        const flanes lhs_high = error_high * error_high * sqD * high_factor + tiny;
+        const flanes rhs_low = rhs_scale * grad_low * low_factor - tiny;
+        const flanes rhs_high = rhs_scale * grad_high * high_factor + tiny;
+        filter.active[funcIter] = less(broadcast(val_bound), high) & less(low, broadcast(-val_bound)) & valid;
+        filter.inactive[funcIter] = (less(broadcast(val_bound), low) | less(high, broadcast(-val_bound))) & valid;
+        // with `curve_network`, the right-hand side is infinite or NaN, and the check never fails
+        filter.refine[funcIter] = curve_network ? 0 : less(rhs_high, lhs_low) & valid;
+        filter.keep[funcIter] = curve_network ? ~uint32_t(0) : less(lhs_high, rhs_low) & valid;
+    }
+}
+
+} // namespace
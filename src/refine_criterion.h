@@ -0,0 +1,158 @@
+//
+//  refine_criterion.h
+//  adaptive_mesh_refinement
+//
+//  The refinement criteria as types that the adaptive loop of `gridRefine` is templated on.
+//
+
+#pragma once
+
+#include <concepts>
+#include <functional>
+#include "refine_crit.h"
+
+/// A refinement criterion decides for one tet whether it's refinable and whether it's active, i.e., whether it may contain a part of the geometry.
+/// It's called with the parameters of `critIA` after `funcNum`, `threshold` and `curve_network`, which a criterion holds itself:
+/// the coordinates of the tet vertices, the values and gradients of the functions at them, the activeness to set, the trackers of the two and three functions'
+/// checks, and an optional `pair_hint` (nullptr, or the trackers of the skipped checks).
+/// Only the active tets of the grid are split further when their neighbours are split, see `gridRefine`.
+template <typename Criterion>
+concept refinement_criterion = requires(const Criterion &criterion,
+                                        const Eigen::Matrix<double, 4, 3> &pts,
+                                        const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+                                        bool &active,
+                                        int &sub_call_two,
+                                        int &sub_call_three,
+                                        pair_hint *hint)
+{
+    { criterion(pts, tet_info, active, sub_call_two, sub_call_three, hint) } -> std::convertible_to<bool>;
+};
+
+/// A refinement criterion on batches of tets. It's called with a `tet_batch` of up to `crit_batch_width` tets, the bitmask of active tets to set,
+/// the trackers of the two and three functions' checks, and the `pair_hint` of every tet of the batch, and returns the bitmask of refinable tets.
+template <typename Criterion>
+concept batched_refinement_criterion = requires(const Criterion &criterion,
+                                                const tet_batch &batch,
+                                                uint32_t &active,
+                                                int &sub_call_two,
+                                                int &sub_call_three,
+                                                pair_hint *hints)
+{
+    { criterion(batch, active, sub_call_two, sub_call_three, hints) } -> std::convertible_to<uint32_t>;
+};
+
+/// The criteria of implicit arrangements, see `critIA`.
+struct ia_criterion
+{
+    size_t funcNum;
+    double threshold;
+    bool curve_network = false;
+
+    bool operator()(const Eigen::Matrix<double, 4, 3> &pts,
+                    const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+                    bool &active,
+                    int &sub_call_two,
+                    int &sub_call_three,
+                    pair_hint *hint) const
+    {
+        return critIA(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hint);
+    }
+};
+
+/// The criteria of constructive solid geometry, see `critCSG`.
+struct csg_criterion
+{
+    size_t funcNum;
+    /// The CSG tree, see `gridRefine`. It's referenced, so it has to outlive the criterion.
+    const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> &csg_func;
+    double threshold;
+    bool curve_network = false;
+
+    bool operator()(const Eigen::Matrix<double, 4, 3> &pts,
+                    const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+                    bool &active,
+                    int &sub_call_two,
+                    int &sub_call_three,
+                    pair_hint *hint) const
+    {
+        return critCSG(pts, tet_info, funcNum, csg_func, threshold, curve_network, active, sub_call_two, sub_call_three, hint);
+    }
+};
+
+/// The batched criteria of implicit arrangements, see `critIA_batch`.
+struct ia_batch_criterion
+{
+    size_t funcNum;
+    double threshold;
+    bool curve_network = false;
+
+    uint32_t operator()(const tet_batch &batch,
+                        uint32_t &active,
+                        int &sub_call_two,
+                        int &sub_call_three,
+                        pair_hint *hints) const
+    {
+        return critIA_batch(batch, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hints);
+    }
+};
+
+/// The batched criteria of constructive solid geometry, see `critCSG_batch`.
+struct csg_batch_criterion
+{
+    size_t funcNum;
+    /// The CSG tree, see `gridRefine`. It's referenced, so it has to outlive the criterion.
+    const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> &csg_func;
+    double threshold;
+    bool curve_network = false;
+
+    uint32_t operator()(const tet_batch &batch,
+                        uint32_t &active,
+                        int &sub_call_two,
+                        int &sub_call_three,
+                        pair_hint *hints) const
+    {
+        return critCSG_batch(batch, funcNum, csg_func, threshold, curve_network, active, sub_call_two, sub_call_three, hints);
+    }
+};
+
+/// The criteria of material interfaces, see `critMI`.
+struct mi_criterion
+{
+    size_t funcNum;
+    double threshold;
+    bool curve_network = false;
+    /// Whether the dominated materials are discarded, see `critMI`.
+    bool dominance = false;
+
+    bool operator()(const Eigen::Matrix<double, 4, 3> &pts,
+                    const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+                    bool &active,
+                    int &sub_call_two,
+                    int &sub_call_three,
+                    pair_hint *hint) const
+    {
+        return critMI(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three, hint, dominance);
+    }
+};
+
+/// A criterion with only the zero-crossing test of a modality and no distance checks, e.g., for a coarse preview of the geometry.
+/// A tet is active if the bezier values of its functions may cross zero: for IA, the values of some function; for CSG, the interval of the CSG tree;
+/// for MI, the values of two materials above the largest lower bound of all materials. An active tet is refinable until its longest edge is
+/// no longer than `max_edge_length`, so the grid is uniform around the geometry.
+struct zero_crossing_criterion
+{
+    /// The modality, see `geo_obj`.
+    int mode;
+    size_t funcNum;
+    /// The bound of the edge length of the active tets after the refinement.
+    double max_edge_length;
+    /// The CSG tree for CSG, see `gridRefine`. It's only called for CSG.
+    std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func = nullptr;
+
+    bool operator()(const Eigen::Matrix<double, 4, 3> &pts,
+                    const std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> &tet_info,
+                    bool &active,
+                    int &sub_call_two,
+                    int &sub_call_three,
+                    pair_hint *hint) const;
+};
@@ -11,12 +11,14 @@
 
 
 /// Labels for grid stats.
-const std::array<std::string, 6> tet_metric_labels = {"total tet number: ",
+const std::array<std::string, 8> tet_metric_labels = {"total tet number: ",
     "active tet number: ",
     "minimum radius ratio among all tets: ",
     "minimum radius ratio amond active tets: ",
     "two functions' zero-crossing checks: ",
-    "three functions' zero-crossing checks: "
+    "three functions' zero-crossing checks: ",
+    "two functions' zero-crossing checks skipped: ",
+    "three functions' zero-crossing checks skipped: "
 };
 
 /// calculate the radius ratio of the tetrahedra based on the vertices' locations. This value is scaled by 3 such that the perfect tet has the radius ratio of 1.
@@ -0,0 +1,511 @@
+//
+//  bench_criteria.cpp
+//  adaptive_mesh_refinement
+//
+//  Microbenchmarks of the refinement criteria and their kernels on tets recorded from the example scenes into `data/bench`.
+//  Run `grid_gen_bench -r json -o bench.json` to write the results as JSON.
+//
+#define CATCH_CONFIG_EXTERNAL_INTERFACES
+#include "refine_crit.h"
+#include "csg.h"
+#include "grid_mesh.h"
+#include "grid_refine.h"
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/LU>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <tuple>
+#include "3rd/implicit_functions/implicit_functions.h"
+#include <catch2/catch.hpp>
+
+/// Writes the statistics of every benchmark as JSON. Every iteration of the benchmarks below runs a kernel once on the next recorded input,
+/// so the times are per call, i.e., per tet for the criteria.
+class json_reporter : public Catch::StreamingReporterBase<json_reporter>
+{
+public:
+    using StreamingReporterBase::StreamingReporterBase;
+
+    static std::string getDescription() {
+        return "Reports the mean time per call of every benchmark as JSON";
+    }
+
+    void assertionStarting(Catch::AssertionInfo const &) override {}
+
+    bool assertionEnded(Catch::AssertionStats const &) override {
+        return true;
+    }
+
+    void benchmarkEnded(Catch::BenchmarkStats<> const &stats) override {
+        m_results.push_back({
+            {"name", stats.info.name},
+            {"mean_ns", stats.mean.point.count()},
+            {"mean_low_ns", stats.mean.lower_bound.count()},
+            {"mean_high_ns", stats.mean.upper_bound.count()},
+            {"std_dev_ns", stats.standardDeviation.point.count()},
+            {"samples", stats.info.samples},
+            {"iterations", stats.info.iterations}
+        });
+    }
+
+    void testRunEnded(Catch::TestRunStats const &stats) override {
+        stream << nlohmann::json{{"benchmarks", m_results}}.dump(4) << std::endl;
+        StreamingReporterBase::testRunEnded(stats);
+    }
+
+private:
+    nlohmann::json m_results = nlohmann::json::array();
+};
+
+CATCH_REGISTER_REPORTER("json", json_reporter)
+
+/// The number of heap allocations of the process so far. With glibc, `malloc`, `calloc` and `realloc` are interposed, so the buffers of
+/// `llvm_vecsmall::SmallVector` and the operator new of the standard library are counted; elsewhere only the global operator new is replaced.
+std::atomic<size_t> heap_allocations = 0;
+
+#if defined(__GLIBC__)
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+extern "C" void *malloc(size_t size)
+{
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+#else
+void *operator new(size_t size)
+{
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size ? size : 1)){
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+#endif
+
+/// A recorded tet: the coordinates of its vertices and the values and gradients of all functions at them, as the criteria take them.
+struct tet_sample
+{
+    Eigen::Matrix<double, 4, 3> pts;
+    std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info;
+};
+
+/// The tets recorded from a scene, by whether the criteria of the scene find them active.
+struct scene
+{
+    std::string name;
+    int mode;
+    size_t funcNum;
+    double threshold;
+    /// the CSG tree of a CSG scene, and the same tree compiled
+    llvm_vecsmall::SmallVector<csg_unit, 20> tree;
+    csg_program program;
+    std::vector<tet_sample> active, inactive, mixed;
+};
+
+/// The file of the recorded tets, written by the test case "record the tets of the benchmarks".
+const std::string recorded_tets_file = "/bench/criteria_tets.json";
+/// The cap on the tets of a recorded grid, so the scenes are recorded in about a second each.
+constexpr int record_max_elements = 20000;
+/// The cap on the tets of each kind recorded from a scene.
+constexpr size_t record_max_samples = 1024;
+
+/// The names of the modalities in the file of the recorded tets.
+const std::array<std::pair<int, std::string>, 3> mode_names = {{{IA, "IA"}, {CSG, "CSG"}, {MI, "MI"}}};
+
+/// Refines the grid of a scene until `record_max_elements` and records evenly spread tets of its final grid:
+/// active ones, inactive ones, and both mixed in the order of the grid. Only the coordinates of their vertices are recorded,
+/// in rows of 12 numbers, as the functions are evaluated at them when they're loaded. The vertices are evaluated here as well,
+/// as the vertex created by the last split of `gridRefine` isn't.
+nlohmann::json record_scene(const std::string &name, const int mode, const std::string &grid_file, const std::string &function_file, const std::string &tree_file, const double threshold)
+{
+    mtet::MTetMesh grid = grid_file.find(".json") != std::string::npos ? grid_mesh::load_tet_mesh(std::string(TEST_FILE) + grid_file) : mtet::load_mesh(std::string(TEST_FILE) + grid_file);
+    std::vector<std::unique_ptr<ImplicitFunction<double>>> functions;
+    if (!load_functions(std::string(TEST_FILE) + function_file, functions)){
+        throw std::runtime_error("ERROR: failed to load the functions of " + name);
+    }
+    const size_t funcNum = functions.size();
+    auto implicit_func = [&](std::span<const Scalar, 3> data, size_t funcNum){
+        llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> vertex_eval(funcNum);
+        for(size_t funcIter = 0; funcIter < funcNum; funcIter++){
+            Eigen::RowVector4d eval;
+            eval[0] = functions[funcIter]->evaluate_gradient(data[0], data[1], data[2], eval[1], eval[2], eval[3]);
+            vertex_eval[funcIter] = eval;
+        }
+        return vertex_eval;
+    };
+    csg_program program;
+    if (tree_file != "" && !load_csgTree(std::string(TEST_FILE) + tree_file, program)){
+        throw std::runtime_error("ERROR: failed to load the CSG tree of " + name);
+    }
+    std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func = program;
+    tet_metric metric_list;
+    std::array<double, timer_amount> profileTimer = {0,0,0,0,0,0,0,0,0,0};
+    if (!gridRefine(mode, false, threshold, std::numeric_limits<double>::infinity(), record_max_elements, funcNum, implicit_func, csg_func, grid, metric_list, profileTimer)){
+        throw std::runtime_error("ERROR: failed to refine the grid of " + name);
+    }
+
+    std::vector<mtet::TetId> active, inactive, all;
+    grid.seq_foreach_tet([&](mtet::TetId tid, std::span<const mtet::VertexId, 4> vs)
+                         {
+        Eigen::Matrix<double, 4, 3> pts;
+        std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info;
+        for (int i = 0; i < 4; i++){
+            auto coords = grid.get_vertex(vs[i]);
+            pts.row(i) = Eigen::RowVector3d(coords[0], coords[1], coords[2]);
+            tet_info[i] = implicit_func(coords, funcNum);
+        }
+        bool isActive = false;
+        int sub_call_two = 0, sub_call_three = 0;
+        evaluate_crit(mode, pts, tet_info, funcNum, csg_func, threshold, false, isActive, sub_call_two, sub_call_three);
+        (isActive ? active : inactive).push_back(tid);
+        all.push_back(tid); });
+    auto spread = [&](const std::vector<mtet::TetId> &tets)
+    {
+        nlohmann::json rows = nlohmann::json::array();
+        const size_t stride = std::max<size_t>(1, tets.size() / record_max_samples);
+        for (size_t i = 0; i < tets.size() && rows.size() < record_max_samples; i += stride){
+            std::vector<double> row;
+            for (mtet::VertexId vid : grid.get_tet(tets[i])){
+                auto coords = grid.get_vertex(vid);
+                row.insert(row.end(), coords.begin(), coords.end());
+            }
+            rows.push_back(row);
+        }
+        return rows;
+    };
+    const auto mode_name = std::find_if(mode_names.begin(), mode_names.end(), [&](const auto &entry){ return entry.first == mode; });
+    return {
+        {"name", name},
+        {"mode", mode_name->second},
+        {"function_file", function_file},
+        {"tree_file", tree_file},
+        {"threshold", threshold},
+        {"active", spread(active)},
+        {"inactive", spread(inactive)},
+        {"mixed", spread(all)}
+    };
+}
+
+/// Loads a scene of the file of the recorded tets and evaluates its functions at the vertices of its tets.
+scene load_scene(const nlohmann::json &recorded)
+{
+    scene s;
+    s.name = recorded["name"];
+    const auto mode_name = std::find_if(mode_names.begin(), mode_names.end(), [&](const auto &entry){ return entry.second == recorded["mode"]; });
+    if (mode_name == mode_names.end()){
+        throw std::runtime_error("ERROR: unknown modality of " + s.name);
+    }
+    s.mode = mode_name->first;
+    s.threshold = recorded["threshold"];
+    std::vector<std::unique_ptr<ImplicitFunction<double>>> functions;
+    if (!load_functions(std::string(TEST_FILE) + recorded["function_file"].get<std::string>(), functions)){
+        throw std::runtime_error("ERROR: failed to load the functions of " + s.name);
+    }
+    s.funcNum = functions.size();
+    const std::string tree_file = recorded["tree_file"];
+    if (tree_file != ""){
+        if (!load_csgTree(std::string(TEST_FILE) + tree_file, s.tree)){
+            throw std::runtime_error("ERROR: failed to load the CSG tree of " + s.name);
+        }
+        s.program = csg_program(s.tree);
+    }
+    auto load = [&](const nlohmann::json &rows, std::vector<tet_sample> &samples)
+    {
+        for (const nlohmann::json &row : rows){
+            tet_sample sample;
+            for (int i = 0; i < 4; i++){
+                sample.pts.row(i) = Eigen::RowVector3d(row[3 * i], row[3 * i + 1], row[3 * i + 2]);
+                sample.tet_info[i].resize(s.funcNum);
+                for (size_t funcIter = 0; funcIter < s.funcNum; funcIter++){
+                    Eigen::RowVector4d &eval = sample.tet_info[i][funcIter];
+                    eval[0] = functions[funcIter]->evaluate_gradient(sample.pts(i, 0), sample.pts(i, 1), sample.pts(i, 2), eval[1], eval[2], eval[3]);
+                }
+            }
+            samples.push_back(sample);
+        }
+    };
+    load(recorded["active"], s.active);
+    load(recorded["inactive"], s.inactive);
+    load(recorded["mixed"], s.mixed);
+    return s;
+}
+
+/// Records the tets of the scenes of Figures 1, 13, 20 and 22 into the file of the recorded tets. It's hidden, so it only runs
+/// when it's named, e.g., `grid_gen_bench "record the tets of the benchmarks"`, after a change of the scenes or of the criteria.
+TEST_CASE("record the tets of the benchmarks", "[.record]") {
+    nlohmann::json recorded = {{"scenes", {
+        record_scene("Figure1 IA", IA, "/grid/cube6.msh", "/Figure1/10-wikiBall.json", "", 0.0005),
+        record_scene("Figure1 CSG", CSG, "/grid/cube6.msh", "/Figure1/10-wikiBall.json", "/Figure1/10-wikiBall-tree.json", 0.0005),
+        record_scene("Figure13 MI", MI, "/Figure13/grid_1.json", "/Figure13/figure13.json", "", 0.001),
+        record_scene("Figure20 CSG", CSG, "/Figure20/grid_1.json", "/Figure20/csg_examples_1.json", "/Figure20/csg_examples_1_tree.json", 0.01),
+        record_scene("Figure22 IA", IA, "/Figure22/grid_1.json", "/Figure22/config.json", "", 0.008)
+    }}};
+    std::ofstream fout(std::string(TEST_FILE) + recorded_tets_file);
+    REQUIRE(fout);
+    fout << recorded << std::endl;
+}
+
+/// The scenes of the file of the recorded tets, loaded once.
+const std::vector<scene> &scenes()
+{
+    static const std::vector<scene> loaded = []()
+    {
+        std::ifstream fin(std::string(TEST_FILE) + recorded_tets_file);
+        if (!fin){
+            throw std::runtime_error("ERROR: failed to open the recorded tets " + recorded_tets_file);
+        }
+        const nlohmann::json recorded_scenes = nlohmann::json::parse(fin);
+        std::vector<scene> scenes;
+        for (const nlohmann::json &recorded : recorded_scenes["scenes"]){
+            scenes.push_back(load_scene(recorded));
+        }
+        return scenes;
+    }();
+    return loaded;
+}
+
+/// The edge vectors of a tet as in the criteria, the squared determinant of its first three edges, and the cross products that map
+/// the value differences along these edges to the unnormalized gradient of the linear interpolation.
+struct tet_geometry
+{
+    Eigen::Matrix<double, 3, 6> vec;
+    double sqD;
+    Eigen::Matrix3d crossMatrix;
+
+    explicit tet_geometry(const Eigen::Matrix<double, 4, 3> &pts)
+    {
+        Eigen::Vector3d eigenVec1 = pts.row(1) - pts.row(0), eigenVec2 = pts.row(2) - pts.row(0), eigenVec3 = pts.row(3) - pts.row(0), eigenVec4 = pts.row(2) - pts.row(1), eigenVec5 = pts.row(3) - pts.row(1), eigenVec6 = pts.row(3) - pts.row(2);
+        vec << eigenVec1, eigenVec2, eigenVec3, eigenVec4, eigenVec5, eigenVec6;
+        double D = vec.leftCols(3).determinant();
+        sqD = D * D;
+        crossMatrix << eigenVec2.cross(eigenVec3), eigenVec3.cross(eigenVec1), eigenVec1.cross(eigenVec2);
+    }
+};
+
+TEST_CASE("criteria on recorded tets", "[benchmark]") {
+    for (const scene &s : scenes()){
+        const std::string label = s.name + " (" + std::to_string(s.funcNum) + " functions, ";
+        const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func = s.program;
+        for (const auto &[kind, samples] : {std::pair("active", &s.active), std::pair("inactive", &s.inactive), std::pair("mixed", &s.mixed)}){
+            if (samples->empty()){
+                continue;
+            }
+            const std::string crit_name = s.mode == IA ? "critIA " : s.mode == CSG ? "critCSG " : "critMI ";
+            BENCHMARK_ADVANCED(crit_name + label + kind + ")")(Catch::Benchmark::Chronometer meter) {
+                int sub_call_two = 0, sub_call_three = 0;
+                meter.measure([&](int i) {
+                    const tet_sample &sample = (*samples)[i % samples->size()];
+                    bool active = false;
+                    switch (s.mode){
+                        case IA:
+                            return critIA(sample.pts, sample.tet_info, s.funcNum, s.threshold, false, active, sub_call_two, sub_call_three);
+                        case CSG:
+                            return critCSG(sample.pts, sample.tet_info, s.funcNum, csg_func, s.threshold, false, active, sub_call_two, sub_call_three);
+                        default:
+                            return critMI(sample.pts, sample.tet_info, s.funcNum, s.threshold, false, active, sub_call_two, sub_call_three);
+                    }
+                });
+            };
+        }
+    }
+}
+
+TEST_CASE("criteria don't allocate on recorded tets", "[benchmark]") {
+    for (const scene &s : scenes()){
+        const std::function<std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>>(llvm_vecsmall::SmallVector<std::array<double, 2>, 20>)> csg_func = s.program;
+        int sub_call_two = 0, sub_call_three = 0;
+        size_t refinable = 0;
+        const size_t before = heap_allocations;
+        for (const std::vector<tet_sample> *samples : {&s.active, &s.inactive, &s.mixed}){
+            for (const tet_sample &sample : *samples){
+                bool active = false;
+                switch (s.mode){
+                    case IA:
+                        refinable += critIA(sample.pts, sample.tet_info, s.funcNum, s.threshold, false, active, sub_call_two, sub_call_three);
+                        break;
+                    case CSG:
+                        refinable += critCSG(sample.pts, sample.tet_info, s.funcNum, csg_func, s.threshold, false, active, sub_call_two, sub_call_three);
+                        break;
+                    default:
+                        refinable += critMI(sample.pts, sample.tet_info, s.funcNum, s.threshold, false, active, sub_call_two, sub_call_three);
+                        break;
+                }
+            }
+        }
+        /// counted before the assertion, which allocates itself
+        const size_t allocations = heap_allocations - before;
+        INFO(s.name << ": " << refinable << " refinable tets, " << sub_call_two << " pairs and " << sub_call_three << " triples checked");
+        REQUIRE(allocations == 0);
+    }
+}
+
+TEST_CASE("criteria kernels on recorded tets", "[benchmark]") {
+    /// the inputs of the kernels as the criteria compute them on the mixed tets of the scenes, with the functions that cross zero in a tet
+    std::vector<std::tuple<Eigen::RowVector4d, Eigen::Matrix<double, 4, 3>, Eigen::Matrix<double, 3, 6>>> bezier_inputs;
+    std::vector<Eigen::Vector<double, 20>> val_lists;
+    std::vector<std::tuple<Eigen::Matrix<double, 2, 3>, Eigen::Matrix<double, 16, 2>, double, double>> two_inputs;
+    std::vector<std::tuple<Eigen::Matrix<double, 3, 3>, Eigen::Matrix<double, 16, 3>, double, double>> three_inputs;
+    std::vector<std::array<double, 40>> points_2d;
+    std::vector<std::array<double, 60>> points_3d;
+    std::vector<std::pair<const scene *, llvm_vecsmall::SmallVector<std::array<double, 2>, 20>>> csg_inputs;
+    for (const scene &s : scenes()){
+        for (const tet_sample &sample : s.mixed){
+            tet_geometry geo(sample.pts);
+            std::vector<Eigen::Vector<double, 20>> valList(s.funcNum);
+            std::vector<Eigen::Vector<double, 16>> diffList(s.funcNum);
+            std::vector<Eigen::RowVector3d> gradList(s.funcNum);
+            llvm_vecsmall::SmallVector<std::array<double, 2>, 20> funcInt(s.funcNum);
+            std::vector<size_t> crossing;
+            for (size_t funcIter = 0; funcIter < s.funcNum; funcIter++){
+                Eigen::Matrix4d func_info;
+                func_info << sample.tet_info[0][funcIter], sample.tet_info[1][funcIter], sample.tet_info[2][funcIter], sample.tet_info[3][funcIter];
+                bezier_inputs.emplace_back(func_info.col(0).transpose(), func_info.rightCols(3), geo.vec);
+                valList[funcIter] = bezierConstruct(func_info.col(0).transpose(), func_info.rightCols(3), geo.vec);
+                val_lists.push_back(valList[funcIter]);
+                diffList[funcIter] = bezierDiff(valList[funcIter]);
+                double v0 = func_info(0, 0), v1 = func_info(1, 0), v2 = func_info(2, 0), v3 = func_info(3, 0);
+                gradList[funcIter] = Eigen::RowVector3d(v1 - v0, v2 - v0, v3 - v0) * geo.crossMatrix.transpose();
+                funcInt[funcIter] = {valList[funcIter].minCoeff(), valList[funcIter].maxCoeff()};
+                if (funcInt[funcIter][0] <= 0 && funcInt[funcIter][1] >= 0){
+                    crossing.push_back(funcIter);
+                }
+            }
+            if (!s.tree.empty()){
+                csg_inputs.emplace_back(&s, funcInt);
+            }
+            for (size_t i = 0; i < crossing.size(); i++){
+                for (size_t j = i + 1; j < crossing.size(); j++){
+                    const size_t f0 = crossing[i], f1 = crossing[j];
+                    Eigen::Matrix<double, 2, 3> grad;
+                    grad << gradList[f0], gradList[f1];
+                    Eigen::Matrix<double, 16, 2> diff;
+                    diff << diffList[f0], diffList[f1];
+                    two_inputs.emplace_back(grad, diff, geo.sqD, s.threshold);
+                    if (s.mode != MI){
+                        std::array<double, 40> nPoints2;
+                        for (size_t c = 0; c < 20; c++){
+                            nPoints2[2 * c] = valList[f0][c];
+                            nPoints2[2 * c + 1] = valList[f1][c];
+                        }
+                        points_2d.push_back(nPoints2);
+                    }
+                    for (size_t k = j + 1; k < crossing.size(); k++){
+                        const size_t f2 = crossing[k];
+                        Eigen::Matrix<double, 3, 3> grad3;
+                        grad3 << gradList[f0], gradList[f1], gradList[f2];
+                        Eigen::Matrix<double, 16, 3> diff3;
+                        diff3 << diffList[f0], diffList[f1], diffList[f2];
+                        three_inputs.emplace_back(grad3, diff3, geo.sqD, s.threshold);
+                        if (s.mode == MI){
+                            // the material interfaces test the differences of triples and quadruples of materials
+                            std::array<double, 40> nPoints2;
+                            for (size_t c = 0; c < 20; c++){
+                                nPoints2[2 * c] = valList[f0][c] - valList[f1][c];
+                                nPoints2[2 * c + 1] = valList[f1][c] - valList[f2][c];
+                            }
+                            points_2d.push_back(nPoints2);
+                            for (size_t m = k + 1; m < crossing.size(); m++){
+                                const size_t f3 = crossing[m];
+                                std::array<double, 60> nPoints3;
+                                for (size_t c = 0; c < 20; c++){
+                                    nPoints3[3 * c] = valList[f0][c] - valList[f1][c];
+                                    nPoints3[3 * c + 1] = valList[f1][c] - valList[f2][c];
+                                    nPoints3[3 * c + 2] = valList[f2][c] - valList[f3][c];
+                                }
+                                points_3d.push_back(nPoints3);
+                            }
+                        } else {
+                            // the arrangements and the CSG test the values of pairs and triples of functions
+                            std::array<double, 60> nPoints3;
+                            for (size_t c = 0; c < 20; c++){
+                                nPoints3[3 * c] = valList[f0][c];
+                                nPoints3[3 * c + 1] = valList[f1][c];
+                                nPoints3[3 * c + 2] = valList[f2][c];
+                            }
+                            points_3d.push_back(nPoints3);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    REQUIRE(!two_inputs.empty());
+    REQUIRE(!three_inputs.empty());
+    REQUIRE(!points_3d.empty());
+
+    BENCHMARK_ADVANCED("bezierConstruct (" + std::to_string(bezier_inputs.size()) + " functions in tets)")(Catch::Benchmark::Chronometer meter) {
+        meter.measure([&](int i) {
+            const auto &[vals, grads, vec] = bezier_inputs[i % bezier_inputs.size()];
+            return bezierConstruct(vals, grads, vec);
+        });
+    };
+    BENCHMARK_ADVANCED("bezierDiff (" + std::to_string(val_lists.size()) + " functions in tets)")(Catch::Benchmark::Chronometer meter) {
+        meter.measure([&](int i) {
+            return bezierDiff(val_lists[i % val_lists.size()]);
+        });
+    };
+    BENCHMARK_ADVANCED("two_func_check (" + std::to_string(two_inputs.size()) + " pairs)")(Catch::Benchmark::Chronometer meter) {
+        meter.measure([&](int i) {
+            const auto &[grad, diff, sqD, threshold] = two_inputs[i % two_inputs.size()];
+            return two_func_check(grad, diff, sqD, threshold);
+        });
+    };
+    BENCHMARK_ADVANCED("three_func_check (" + std::to_string(three_inputs.size()) + " triples)")(Catch::Benchmark::Chronometer meter) {
+        meter.measure([&](int i) {
+            const auto &[grad, diff, sqD, threshold] = three_inputs[i % three_inputs.size()];
+            return three_func_check(grad, diff, sqD, threshold);
+        });
+    };
+    BENCHMARK_ADVANCED("contains 2D (" + std::to_string(points_2d.size()) + " point sets)")(Catch::Benchmark::Chronometer meter) {
+        const std::array<double, 2> query = {0, 0};
+        meter.measure([&](int i) {
+            return convex_hull_membership::contains<2, double>(points_2d[i % points_2d.size()], query);
+        });
+    };
+    BENCHMARK_ADVANCED("contains 3D (" + std::to_string(points_3d.size()) + " point sets)")(Catch::Benchmark::Chronometer meter) {
+        const std::array<double, 3> query = {0, 0, 0};
+        meter.measure([&](int i) {
+            return convex_hull_membership::contains<3, double>(points_3d[i % points_3d.size()], query);
+        });
+    };
+    BENCHMARK_ADVANCED("iterTree (" + std::to_string(csg_inputs.size()) + " tets)")(Catch::Benchmark::Chronometer meter) {
+        meter.measure([&](int i) {
+            const auto &[s, funcInt] = csg_inputs[i % csg_inputs.size()];
+            return iterTree(s->tree, 1, funcInt);
+        });
+    };
+    BENCHMARK_ADVANCED("csg_program::evaluate (" + std::to_string(csg_inputs.size()) + " tets)")(Catch::Benchmark::Chronometer meter) {
+        meter.measure([&](int i) {
+            const auto &[s, funcInt] = csg_inputs[i % csg_inputs.size()];
+            return s->program.evaluate(funcInt);
+        });
+    };
+}
@@ -2,6 +2,7 @@
 // Created by Yiwen Ju on 8/4/24.
 //
 #include "refine_crit.h"
+#include "refine_crit_batch.h"
 #include "tet_quality.h"
 #include "timer.h"
 #include "csg.h"
@@ -10,6 +11,10 @@
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 #include <Eigen/Sparse>
+#include <cstring>
+#include <random>
+#include <set>
+#include <thread>
 #include "3rd/implicit_functions/implicit_functions.h"
 #include <catch2/catch.hpp>
 
@@ -66,6 +71,376 @@ TEST_CASE("grid generation of implicit arrangement on known examples", "[IA][exa
         REQUIRE(metric_list.two_func_check == 93455);
         REQUIRE(metric_list.three_func_check == 1576);
     }
+    
+    SECTION("1 sphere with uniform pre-refinement") {
+        //parse configurations
+        threshold = 0.001;
+        grid = mtet::load_mesh(std::string(TEST_FILE) + "/grid/cube6.msh");
+        std::string function_file = std::string(TEST_FILE) + "/function_examples/1-sphere.json";
+        tet_metric metric_list;
+        std::array<double, timer_amount> profileTimer = {0,0,0,0,0,0,0,0,0,0};
+        std::vector<std::unique_ptr<ImplicitFunction<double>>> functions;
+        load_functions(function_file, functions);
+        const size_t funcNum = functions.size();
+        auto implicit_func = [&](std::span<const Scalar, 3> data, size_t funcNum){
+            llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> vertex_eval(funcNum);
+            for(size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                auto &func = functions[funcIter];
+                Eigen::Vector4d eval;
+                eval[0] = func->evaluate_gradient(data[0], data[1], data[2], eval[1], eval[2], eval[3]);
+                vertex_eval[funcIter] = eval;
+            }
+            return vertex_eval;
+        };
+        auto csg_func = [&](llvm_vecsmall::SmallVector<std::array<double, 2>, 20> funcInt){
+            std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> null_csg = {{},{}};
+            return null_csg;
+        };
+        
+        //every level of uniform refinement splits a tet into 8 tets
+        mtet::MTetMesh uniform_grid = grid;
+        uniform_refine(std::sqrt(3.0) / 2, uniform_grid);
+        REQUIRE(uniform_grid.get_num_tets() == 6 * 8);
+        
+        //the plain adaptive refinement of the same grid
+        mtet::MTetMesh adaptive_grid = grid;
+        tet_metric adaptive_metric_list;
+        std::array<double, timer_amount> adaptive_timer = {0,0,0,0,0,0,0,0,0,0};
+        REQUIRE(gridRefine(IA, curve_network, threshold, alpha, max_elements, funcNum, implicit_func, csg_func, adaptive_grid, adaptive_metric_list, adaptive_timer));
+        
+        //start testing
+        refine_options options;
+        options.uniform_depth = -1;
+        bool success = gridRefine(IA, curve_network, threshold, alpha, max_elements, funcNum, implicit_func, csg_func, grid, metric_list, profileTimer, options);
+        REQUIRE(success);
+        
+        //check: the depth is bounded by the tets around the sphere, not by those in empty space, which aren't split
+        REQUIRE(metric_list.uniform_depth == 6);
+        //check: the bulk phase splits the tets of the plain adaptive refinement; only the order of the edges of the same length differs, which changes a few tets
+        REQUIRE(metric_list.total_tet <= adaptive_metric_list.total_tet + adaptive_metric_list.total_tet / 1000);
+        REQUIRE(metric_list.total_tet + adaptive_metric_list.total_tet / 1000 >= adaptive_metric_list.total_tet);
+        REQUIRE(metric_list.active_tet == adaptive_metric_list.active_tet);
+        REQUIRE(metric_list.active_tet == 14636);
+    }
+    
+    SECTION("1 sphere with batched criteria") {
+        //parse configurations
+        threshold = 0.001;
+        grid = mtet::load_mesh(std::string(TEST_FILE) + "/grid/cube6.msh");
+        std::string function_file = std::string(TEST_FILE) + "/function_examples/1-sphere.json";
+        std::array<double, timer_amount> profileTimer = {0,0,0,0,0,0,0,0,0,0};
+        std::vector<std::unique_ptr<ImplicitFunction<double>>> functions;
+        load_functions(function_file, functions);
+        const size_t funcNum = functions.size();
+        auto implicit_func = [&](std::span<const Scalar, 3> data, size_t funcNum){
+            llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> vertex_eval(funcNum);
+            for(size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                auto &func = functions[funcIter];
+                Eigen::Vector4d eval;
+                eval[0] = func->evaluate_gradient(data[0], data[1], data[2], eval[1], eval[2], eval[3]);
+                vertex_eval[funcIter] = eval;
+            }
+            return vertex_eval;
+        };
+        auto csg_func = [&](llvm_vecsmall::SmallVector<std::array<double, 2>, 20> funcInt){
+            std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> null_csg = {{},{}};
+            return null_csg;
+        };
+        
+        //start testing
+        mtet::MTetMesh per_tet_grid = grid;
+        tet_metric metric_list, per_tet_metric_list;
+        refine_options options;
+        REQUIRE(gridRefine(IA, curve_network, threshold, alpha, max_elements, funcNum, implicit_func, csg_func, grid, metric_list, profileTimer, options));
+        options.batch_criteria = false;
+        REQUIRE(gridRefine(IA, curve_network, threshold, alpha, max_elements, funcNum, implicit_func, csg_func, per_tet_grid, per_tet_metric_list, profileTimer, options));
+        
+        //check: batching doesn't change the grid
+        REQUIRE(metric_list.total_tet == 30218);
+        REQUIRE(metric_list.active_tet == 14636);
+        REQUIRE(per_tet_metric_list.total_tet == metric_list.total_tet);
+        REQUIRE(per_tet_metric_list.active_tet == metric_list.active_tet);
+    }
+    SECTION("1 sphere with the criteria as types") {
+        //parse configurations
+        threshold = 0.001;
+        grid = mtet::load_mesh(std::string(TEST_FILE) + "/grid/cube6.msh");
+        std::string function_file = std::string(TEST_FILE) + "/function_examples/1-sphere.json";
+        std::array<double, timer_amount> profileTimer = {0,0,0,0,0,0,0,0,0,0};
+        std::vector<std::unique_ptr<ImplicitFunction<double>>> functions;
+        load_functions(function_file, functions);
+        const size_t funcNum = functions.size();
+        auto implicit_func = [&](std::span<const Scalar, 3> data, size_t funcNum){
+            llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> vertex_eval(funcNum);
+            for(size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                auto &func = functions[funcIter];
+                Eigen::Vector4d eval;
+                eval[0] = func->evaluate_gradient(data[0], data[1], data[2], eval[1], eval[2], eval[3]);
+                vertex_eval[funcIter] = eval;
+            }
+            return vertex_eval;
+        };
+        
+        //start testing
+        mtet::MTetMesh preview_grid = grid;
+        tet_metric metric_list, preview_metric_list;
+        REQUIRE(gridRefine(ia_criterion{funcNum, threshold, curve_network}, alpha, max_elements, funcNum, implicit_func, grid, metric_list, profileTimer));
+        const double max_edge_length = 0.1;
+        REQUIRE(gridRefine(zero_crossing_criterion{IA, funcNum, max_edge_length}, alpha, max_elements, funcNum, implicit_func, preview_grid, preview_metric_list, profileTimer));
+        
+        //check: the criterion of IA gives the grid of `gridRefine` on IA
+        REQUIRE(metric_list.total_tet == 30218);
+        REQUIRE(metric_list.active_tet == 14636);
+        //check: the active tets of the preview are refined down to the edge length, and no further
+        REQUIRE(preview_metric_list.active_tet > 0);
+        REQUIRE(preview_metric_list.total_tet < metric_list.total_tet);
+        for (mtet::TetId tid : preview_metric_list.activeTetId){
+            REQUIRE(longest_tet_edge(preview_grid, tid).first <= max_edge_length * max_edge_length);
+        }
+    }
+    
+    SECTION("1 sphere without gradients") {
+        //parse configurations
+        threshold = 0.001;
+        grid = mtet::load_mesh(std::string(TEST_FILE) + "/grid/cube6.msh");
+        std::string function_file = std::string(TEST_FILE) + "/function_examples/1-sphere.json";
+        std::array<double, timer_amount> profileTimer = {0,0,0,0,0,0,0,0,0,0};
+        std::vector<std::unique_ptr<ImplicitFunction<double>>> functions;
+        load_functions(function_file, functions);
+        const size_t funcNum = functions.size();
+        size_t func_calls = 0;
+        auto implicit_func = [&](std::span<const Scalar, 3> data, size_t funcNum){
+            func_calls++;
+            llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> vertex_eval(funcNum);
+            for(size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                vertex_eval[funcIter] = Eigen::RowVector4d(functions[funcIter]->evaluate(data[0], data[1], data[2]), 0, 0, 0);
+            }
+            return vertex_eval;
+        };
+        auto csg_func = [&](llvm_vecsmall::SmallVector<std::array<double, 2>, 20> funcInt){
+            std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> null_csg = {{},{}};
+            return null_csg;
+        };
+        
+        //start testing
+        const size_t initial_vertices = grid.get_num_vertices();
+        mtet::MTetMesh per_tet_grid = grid;
+        tet_metric metric_list, per_tet_metric_list;
+        refine_options options;
+        options.gradient_free = 1;
+        options.value_func = [&](std::span<const Scalar, 3> data, size_t funcIter){
+            return functions[funcIter]->evaluate(data[0], data[1], data[2]);
+        };
+        REQUIRE(gridRefine(IA, curve_network, threshold, alpha, max_elements, funcNum, implicit_func, csg_func, grid, metric_list, profileTimer, options));
+        options.batch_criteria = false;
+        REQUIRE(gridRefine(IA, curve_network, threshold, alpha, max_elements, funcNum, implicit_func, csg_func, per_tet_grid, per_tet_metric_list, profileTimer, options));
+        
+        //check: the midpoint samples approximate the gradients, so the sphere is refined about as far as with them (30218 tets, 14636 active), and every loop gets the same grid
+        REQUIRE(metric_list.total_tet == 29674);
+        REQUIRE(metric_list.active_tet == 14337);
+        REQUIRE(per_tet_metric_list.total_tet == metric_list.total_tet);
+        REQUIRE(per_tet_metric_list.active_tet == metric_list.active_tet);
+        REQUIRE(metric_list.midpoint_evaluations > 0);
+        //check: the new vertices take the values sampled at the midpoints, so `func` only evaluates the initial vertices
+        REQUIRE(func_calls == 2 * initial_vertices);
+    }
+    
+    SECTION("3 spheres with culling by zero sets") {
+        //parse configurations
+        threshold = 0.001;
+        grid = mtet::load_mesh(std::string(TEST_FILE) + "/grid/cube6.msh");
+        std::string function_file = std::string(TEST_FILE) + "/function_examples/3-sphere.json";
+        std::array<double, timer_amount> profileTimer = {0,0,0,0,0,0,0,0,0,0};
+        std::vector<std::unique_ptr<ImplicitFunction<double>>> functions;
+        load_functions(function_file, functions);
+        const size_t funcNum = functions.size();
+        auto implicit_func = [&](std::span<const Scalar, 3> data, size_t funcNum){
+            llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> vertex_eval(funcNum);
+            for(size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                auto &func = functions[funcIter];
+                Eigen::Vector4d eval;
+                eval[0] = func->evaluate_gradient(data[0], data[1], data[2], eval[1], eval[2], eval[3]);
+                vertex_eval[funcIter] = eval;
+            }
+            return vertex_eval;
+        };
+        auto csg_func = [&](llvm_vecsmall::SmallVector<std::array<double, 2>, 20> funcInt){
+            std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> null_csg = {{},{}};
+            return null_csg;
+        };
+        
+        //start testing
+        mtet::MTetMesh plain_grid = grid;
+        tet_metric metric_list, plain_metric_list;
+        function_index culling(functions);
+        refine_options options;
+        REQUIRE(gridRefine(IA, curve_network, threshold, alpha, max_elements, funcNum, implicit_func, csg_func, plain_grid, plain_metric_list, profileTimer, options));
+        options.culling = &culling;
+        REQUIRE(gridRefine(IA, curve_network, threshold, alpha, max_elements, funcNum, implicit_func, csg_func, grid, metric_list, profileTimer, options));
+        
+        //check: the spheres are apart, so culling doesn't change the grid
+        REQUIRE(metric_list.total_tet == 26084);
+        REQUIRE(metric_list.active_tet == 13572);
+        REQUIRE(plain_metric_list.total_tet == metric_list.total_tet);
+        REQUIRE(plain_metric_list.active_tet == metric_list.active_tet);
+        //check: the functions whose zero set may cross a tet are evaluated at its vertices
+        int missing = 0;
+        grid.seq_foreach_tet([&](mtet::TetId tid, std::span<const VertexId, 4> vs) {
+            std::array<double, 3> bbox_min = {1e9, 1e9, 1e9}, bbox_max = {-1e9, -1e9, -1e9};
+            for (int i = 0; i < 4; i++){
+                auto coords = grid.get_vertex(vs[i]);
+                for (int d = 0; d < 3; d++){
+                    bbox_min[d] = std::min(bbox_min[d], coords[d]);
+                    bbox_max[d] = std::max(bbox_max[d], coords[d]);
+                }
+            }
+            uint32_t mask = culling.query(bbox_min, bbox_max);
+            for (int i = 0; i < 4; i++){
+                auto eval = implicit_func(grid.get_vertex(vs[i]), funcNum);
+                for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                    if (((mask >> funcIter) & 1) && metric_list.vertex_func_grad_map.at(value_of(vs[i]))[funcIter] != eval[funcIter]){
+                        missing++;
+                    }
+                }
+            }
+        });
+        REQUIRE(missing == 0);
+    }
+    
+    SECTION("3 cylinders with pair hints from the parent tets") {
+        //parse configurations
+        threshold = 0.001;
+        grid = mtet::load_mesh(std::string(TEST_FILE) + "/grid/cube6.msh");
+        std::string function_file = std::string(TEST_FILE) + "/function_examples/3-cyl3.json";
+        std::array<double, timer_amount> profileTimer = {0,0,0,0,0,0,0,0,0,0};
+        std::vector<std::unique_ptr<ImplicitFunction<double>>> functions;
+        load_functions(function_file, functions);
+        const size_t funcNum = functions.size();
+        auto implicit_func = [&](std::span<const Scalar, 3> data, size_t funcNum){
+            llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> vertex_eval(funcNum);
+            for(size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                auto &func = functions[funcIter];
+                Eigen::Vector4d eval;
+                eval[0] = func->evaluate_gradient(data[0], data[1], data[2], eval[1], eval[2], eval[3]);
+                vertex_eval[funcIter] = eval;
+            }
+            return vertex_eval;
+        };
+        auto csg_func = [&](llvm_vecsmall::SmallVector<std::array<double, 2>, 20> funcInt){
+            std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> null_csg = {{},{}};
+            return null_csg;
+        };
+        
+        //start testing
+        mtet::MTetMesh plain_grid = grid;
+        tet_metric metric_list, plain_metric_list;
+        refine_options options;
+        REQUIRE(gridRefine(IA, curve_network, threshold, alpha, max_elements, funcNum, implicit_func, csg_func, plain_grid, plain_metric_list, profileTimer, options));
+        options.pair_hints = true;
+        REQUIRE(gridRefine(IA, curve_network, threshold, alpha, max_elements, funcNum, implicit_func, csg_func, grid, metric_list, profileTimer, options));
+        
+        //check: triples are only checked if all their pairs cross
+        REQUIRE(plain_metric_list.total_tet == 20496);
+        REQUIRE(plain_metric_list.active_tet == 10916);
+        REQUIRE(plain_metric_list.two_func_check == 768);
+        REQUIRE(plain_metric_list.three_func_check == 69);
+        REQUIRE(plain_metric_list.two_func_skipped == 0);
+        REQUIRE(plain_metric_list.three_func_skipped == 200);
+        //check: the pairs failed in the parents are skipped, and the grid stays the same here
+        REQUIRE(metric_list.two_func_skipped == 858);
+        REQUIRE(metric_list.total_tet == plain_metric_list.total_tet);
+        REQUIRE(metric_list.active_tet == plain_metric_list.active_tet);
+    }
+    
+    SECTION("1 sphere with pipelined criteria") {
+        //parse configurations
+        threshold = 0.001;
+        grid = mtet::load_mesh(std::string(TEST_FILE) + "/grid/cube6.msh");
+        std::string function_file = std::string(TEST_FILE) + "/function_examples/1-sphere.json";
+        tet_metric metric_list;
+        std::array<double, timer_amount> profileTimer = {0,0,0,0,0,0,0,0,0,0};
+        std::vector<std::unique_ptr<ImplicitFunction<double>>> functions;
+        load_functions(function_file, functions);
+        const size_t funcNum = functions.size();
+        auto implicit_func = [&](std::span<const Scalar, 3> data, size_t funcNum){
+            llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> vertex_eval(funcNum);
+            for(size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                auto &func = functions[funcIter];
+                Eigen::Vector4d eval;
+                eval[0] = func->evaluate_gradient(data[0], data[1], data[2], eval[1], eval[2], eval[3]);
+                vertex_eval[funcIter] = eval;
+            }
+            return vertex_eval;
+        };
+        auto csg_func = [&](llvm_vecsmall::SmallVector<std::array<double, 2>, 20> funcInt){
+            std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> null_csg = {{},{}};
+            return null_csg;
+        };
+        
+        //start testing
+        refine_options options;
+        options.num_threads = 4;
+        bool success = gridRefine(IA, curve_network, threshold, alpha, max_elements, funcNum, implicit_func, csg_func, grid, metric_list, profileTimer, options);
+        REQUIRE(success);
+        
+        //check: the split order depends on thread timing, but no tet is left refinable
+        REQUIRE(metric_list.active_tet > 0);
+        int refinable = 0, sub_call_two = 0, sub_call_three = 0;
+        grid.seq_foreach_tet([&](mtet::TetId tid, std::span<const VertexId, 4> vs) {
+            Eigen::Matrix<double, 4, 3> pts;
+            std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info;
+            for (int i = 0; i < 4; i++){
+                auto coords = grid.get_vertex(vs[i]);
+                pts.row(i) = Eigen::RowVector3d({coords[0], coords[1], coords[2]});
+                tet_info[i] = metric_list.vertex_func_grad_map.at(value_of(vs[i]));
+            }
+            bool active = false;
+            if (critIA(pts, tet_info, funcNum, threshold, curve_network, active, sub_call_two, sub_call_three)){
+                refinable++;
+            }
+        });
+        REQUIRE(refinable == 0);
+    }
+    
+    SECTION("1 sphere on an automatic initial grid") {
+        //parse configurations
+        threshold = 0.001;
+        std::string function_file = std::string(TEST_FILE) + "/function_examples/1-sphere.json";
+        tet_metric metric_list;
+        std::array<double, timer_amount> profileTimer = {0,0,0,0,0,0,0,0,0,0};
+        std::vector<std::unique_ptr<ImplicitFunction<double>>> functions;
+        load_functions(function_file, functions);
+        const size_t funcNum = functions.size();
+        auto implicit_func = [&](std::span<const Scalar, 3> data, size_t funcNum){
+            llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> vertex_eval(funcNum);
+            for(size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                auto &func = functions[funcIter];
+                Eigen::Vector4d eval;
+                eval[0] = func->evaluate_gradient(data[0], data[1], data[2], eval[1], eval[2], eval[3]);
+                vertex_eval[funcIter] = eval;
+            }
+            return vertex_eval;
+        };
+        auto csg_func = [&](llvm_vecsmall::SmallVector<std::array<double, 2>, 20> funcInt){
+            std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> null_csg = {{},{}};
+            return null_csg;
+        };
+        
+        //start testing
+        grid_choice choice = choose_initial_grid(IA, curve_network, threshold, funcNum, implicit_func, csg_func, {0, 0, 0}, {1, 1, 1});
+        REQUIRE(choice.resolution == std::array<size_t, 3>{8, 8, 8});
+        REQUIRE(choice.style == grid_mesh::TET6);
+        //check: a flat bounding box has no cells to locate the complex in
+        REQUIRE_THROWS_AS(choose_initial_grid(IA, curve_network, threshold, funcNum, implicit_func, csg_func, {0, 0, 0.5}, {1, 1, 0.5}), std::runtime_error);
+        grid = grid_mesh::generate_tet_mesh(choice.resolution, {0, 0, 0}, {1, 1, 1}, choice.style);
+        grid.initialize_connectivity();
+        bool success = gridRefine(IA, curve_network, threshold, alpha, max_elements, funcNum, implicit_func, csg_func, grid, metric_list, profileTimer);
+        REQUIRE(success);
+        
+        //check
+        REQUIRE(metric_list.total_tet == 32416);
+        REQUIRE(metric_list.active_tet == 14636);
+    }
 }
 
 TEST_CASE("grid generation of CSG on known examples", "[CSG][examples]") {
@@ -120,6 +495,99 @@ TEST_CASE("grid generation of CSG on known examples", "[CSG][examples]") {
     }
 }
 
+TEST_CASE("CSG programs", "[CSG]") {
+    std::mt19937 rng(41);
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    //check: the program gets the intervals and active functions of `iterTree`, one by one and in batches
+    auto check_program = [&](const llvm_vecsmall::SmallVector<csg_unit, 20> &tree, const size_t funcNum){
+        csg_program program(tree);
+        for (int sampleIter = 0; sampleIter < 200; sampleIter++){
+            std::array<std::array<double, 4>, 32> low, high;
+            for (size_t l = 0; l < 4; l++){
+                llvm_vecsmall::SmallVector<std::array<double, 2>, 20> funcInt(funcNum);
+                for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                    double a = uniform(rng), b = uniform(rng) + 0.5;
+                    funcInt[funcIter] = {std::min(a, b), std::max(a, b)};
+                    low[funcIter][l] = funcInt[funcIter][0];
+                    high[funcIter][l] = funcInt[funcIter][1];
+                }
+                std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> expected = iterTree(tree, 1, funcInt);
+                std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> result = program(funcInt);
+                REQUIRE(result.first == expected.first);
+                REQUIRE(std::equal(result.second.begin(), result.second.end(), expected.second.begin(), expected.second.end()));
+            }
+            std::array<double, 4> batch_low, batch_high;
+            std::array<uint32_t, 4> batch_active;
+            program.evaluate_batch<4>(std::span(low.data(), funcNum), std::span(high.data(), funcNum), batch_low, batch_high, batch_active);
+            for (size_t l = 0; l < 4; l++){
+                llvm_vecsmall::SmallVector<std::array<double, 2>, 20> funcInt(funcNum);
+                for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                    funcInt[funcIter] = {low[funcIter][l], high[funcIter][l]};
+                }
+                std::pair<std::array<double, 2>, uint32_t> result = program.evaluate(funcInt);
+                REQUIRE(batch_low[l] == result.first[0]);
+                REQUIRE(batch_high[l] == result.first[1]);
+                REQUIRE(batch_active[l] == result.second);
+            }
+            //check: the program specialized to the intervals of lane 0 gets the same signs and active functions on intervals within them
+            llvm_vecsmall::SmallVector<std::array<double, 2>, 20> funcInt(funcNum), subInt(funcNum);
+            for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                funcInt[funcIter] = {low[funcIter][0], high[funcIter][0]};
+            }
+            csg_program specialized = program.specialize(funcInt);
+            REQUIRE(specialized.code().size() <= program.code().size());
+            REQUIRE((specialized.functions() & ~program.functions()) == 0);
+            for (int subIter = 0; subIter < 5; subIter++){
+                for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                    double a = funcInt[funcIter][0] + (funcInt[funcIter][1] - funcInt[funcIter][0]) * (uniform(rng) + 1) / 2;
+                    double b = funcInt[funcIter][0] + (funcInt[funcIter][1] - funcInt[funcIter][0]) * (uniform(rng) + 1) / 2;
+                    subInt[funcIter] = {std::min(a, b), std::max(a, b)};
+                }
+                std::pair<std::array<double, 2>, uint32_t> expected = program.evaluate(subInt);
+                std::pair<std::array<double, 2>, uint32_t> result = specialized.evaluate(subInt);
+                REQUIRE((result.first[0] > 0) == (expected.first[0] > 0));
+                REQUIRE((result.first[1] < 0) == (expected.first[1] < 0));
+                REQUIRE(result.second == expected.second);
+            }
+        }
+    };
+    
+    SECTION("known trees") {
+        for (std::string tree_file : {"/Figure21/csg_examples_3_tree.json", "/Figure20/csg_examples_1_tree.json", "/Figure14/figure14_tree.json", "/Figure1/10-wikiBall-tree.json"}){
+            llvm_vecsmall::SmallVector<csg_unit, 20> tree;
+            REQUIRE(load_csgTree(std::string(TEST_FILE) + tree_file, tree));
+            int funcNum = 0;
+            for (const csg_unit &unit : tree){
+                funcNum = std::max({funcNum, -unit.elements[0], unit.operation == Negation ? 0 : -unit.elements[1]});
+            }
+            check_program(tree, funcNum);
+        }
+    }
+    
+    SECTION("deep trees") {
+        //a chain of 200 operations on 20 functions, with a negation every few units
+        llvm_vecsmall::SmallVector<csg_unit, 20> tree;
+        const int chain = 200;
+        for (int unitIter = 0; unitIter < chain; unitIter++){
+            const int next = unitIter + 1 < chain ? unitIter + 2 : -20;
+            if (unitIter % 5 == 4){
+                tree.push_back({Negation, {next, 0}});
+            } else {
+                tree.push_back({unitIter % 2 ? Union : Intersection, {-(unitIter % 19) - 1, next}});
+            }
+        }
+        check_program(tree, 20);
+        //the stack holds at most one entry more than the log of the number of leaves
+        csg_program program(tree);
+        int depth = 0, max_depth = 0;
+        for (const csg_program::instruction &ins : program.code()){
+            depth += ins.operation == Function ? 1 : ins.operation == Negation ? 0 : -1;
+            max_depth = std::max(max_depth, depth);
+        }
+        REQUIRE(max_depth == 2);
+    }
+}
+
 TEST_CASE("grid generation of material interface on known examples", "[MI][examples]") {
     std::string function_file;
     double threshold;
@@ -162,3 +630,604 @@ TEST_CASE("grid generation of material interface on known examples", "[MI][examp
     }
 }
 
+TEST_CASE("dominated materials", "[MI]") {
+    //random tets with quadratic materials through them, up to 8 materials sorted by the sorting network and more by `std::sort`
+    std::mt19937 rng(43);
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    int pruned = 0;
+    for (size_t funcNum : {3, 6, 12}){
+        for (int tetIter = 0; tetIter < 2000; tetIter++){
+            const double threshold = std::pow(10.0, -4 + 2 * (uniform(rng) + 1));
+            Eigen::Matrix<double, 4, 3> pts;
+            std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info;
+            for (int i = 0; i < 4; i++){
+                for (int d = 0; d < 3; d++){
+                    pts(i, d) = 0.1 * uniform(rng);
+                }
+                tet_info[i].resize(funcNum);
+            }
+            for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                Eigen::RowVector3d grad(uniform(rng), uniform(rng), uniform(rng));
+                const double curvature = 10 * uniform(rng), offset = 0.1 * uniform(rng);
+                for (int i = 0; i < 4; i++){
+                    Eigen::RowVector3d p = pts.row(i);
+                    tet_info[i][funcIter] << grad.dot(p) + curvature * p.squaredNorm() + offset, grad + 2 * curvature * p;
+                }
+            }
+            
+            //check: the checks on the dominant materials are a part of all checks, so the tet is only active or refinable if it is without pruning
+            int sub_call_two = 0, sub_call_three = 0;
+            bool active = false, dominant_active = false;
+            bool refine = critMI(pts, tet_info, funcNum, threshold, false, active, sub_call_two, sub_call_three);
+            bool dominant_refine = critMI(pts, tet_info, funcNum, threshold, false, dominant_active, sub_call_two, sub_call_three, nullptr, true);
+            REQUIRE((!dominant_active || active));
+            REQUIRE((!dominant_refine || refine));
+            if (active && !dominant_active){
+                pruned++;
+            }
+        }
+    }
+    //check: crossings of materials below the maximum are pruned
+    REQUIRE(pruned > 0);
+}
+
+TEST_CASE("grid generation of several modalities with a shared evaluation cache", "[IA][MI][examples]") {
+    double threshold = 0.001;
+    mtet::MTetMesh grid = grid_mesh::load_tet_mesh(std::string(TEST_FILE) + "/Figure13/grid_1.json");
+    mtet::save_mesh("init.msh", grid);
+    grid = mtet::load_mesh("init.msh");
+    std::string function_file = std::string(TEST_FILE) + "/Figure13/figure13.json";
+    std::vector<std::unique_ptr<ImplicitFunction<double>>> functions;
+    load_functions(function_file, functions);
+    const size_t funcNum = functions.size();
+    size_t evaluations = 0;
+    auto implicit_func = [&](std::span<const Scalar, 3> data, size_t funcNum){
+        evaluations++;
+        llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> vertex_eval(funcNum);
+        for(size_t funcIter = 0; funcIter < funcNum; funcIter++){
+            auto &func = functions[funcIter];
+            Eigen::Vector4d eval;
+            eval[0] = func->evaluate_gradient(data[0], data[1], data[2], eval[1], eval[2], eval[3]);
+            vertex_eval[funcIter] = eval;
+        }
+        return vertex_eval;
+    };
+    auto csg_func = [&](llvm_vecsmall::SmallVector<std::array<double, 2>, 20> funcInt){
+        std::pair<std::array<double, 2>, llvm_vecsmall::SmallVector<int, 20>> null_csg = {{},{}};
+        return null_csg;
+    };
+    
+    //separate runs
+    std::vector<int> modes = {IA, MI};
+    std::vector<tet_metric> separate_metrics(modes.size());
+    size_t separate_evaluations = 0;
+    for (size_t i = 0; i < modes.size(); i++){
+        mtet::MTetMesh separate_grid = grid;
+        std::array<double, timer_amount> profileTimer = {0,0,0,0,0,0,0,0,0,0};
+        evaluations = 0;
+        REQUIRE(gridRefine(modes[i], curve_network, threshold, alpha, max_elements, funcNum, implicit_func, csg_func, separate_grid, separate_metrics[i], profileTimer));
+        separate_evaluations += evaluations;
+    }
+    
+    //shared run
+    std::vector<mtet::MTetMesh> grids;
+    std::vector<tet_metric> metric_lists;
+    std::vector<std::array<double, timer_amount>> profileTimers;
+    evaluations = 0;
+    bool success = gridRefineMulti(modes, curve_network, threshold, alpha, max_elements, funcNum, implicit_func, csg_func, grid, grids, metric_lists, profileTimers);
+    REQUIRE(success);
+    
+    //check: identical grids with fewer evaluations
+    for (size_t i = 0; i < modes.size(); i++){
+        REQUIRE(metric_lists[i].total_tet == separate_metrics[i].total_tet);
+        REQUIRE(metric_lists[i].active_tet == separate_metrics[i].active_tet);
+        REQUIRE(metric_lists[i].two_func_check == separate_metrics[i].two_func_check);
+        REQUIRE(metric_lists[i].three_func_check == separate_metrics[i].three_func_check);
+    }
+    REQUIRE(evaluations < separate_evaluations);
+}
+
+
+TEST_CASE("function index over zero sets", "[culling]") {
+    std::vector<std::unique_ptr<ImplicitFunction<double>>> functions;
+    functions.push_back(std::make_unique<SphereDistanceFunction<double>>(std::array<double, 3>{0, 0, 0}, 1));
+    functions.push_back(std::make_unique<SphereSquaredDistanceFunction<double>>(std::array<double, 3>{4, 0, 0}, 1));
+    functions.push_back(std::make_unique<TorusDistanceFunction<double>>(std::array<double, 3>{0, 4, 0}, std::array<double, 3>{0, 0, 1}, 1, 0.25));
+    functions.push_back(std::make_unique<PlaneDistanceFunction<double>>(std::array<double, 3>{0, 0, 0}, std::array<double, 3>{0, 0, 1}));
+    function_index culling(functions);
+    
+    SECTION("query") {
+        REQUIRE(culling.all() == 0b1111);
+        //check: unbounded zero sets are never culled
+        REQUIRE(culling.query({10, 10, 10}, {11, 11, 11}) == 0b1000);
+        REQUIRE(culling.query({-0.5, -0.5, -0.5}, {0.5, 0.5, 0.5}) == 0b1001);
+        REQUIRE(culling.query({0.9, -0.1, -0.1}, {3.1, 0.1, 0.1}) == 0b1011);
+        //check: the box of the torus is flat along its axis
+        REQUIRE(culling.query({-0.1, 3.9, 0.3}, {0.1, 4.1, 0.4}) == 0b1000);
+        REQUIRE(culling.query({-0.1, 4.9, 0.1}, {0.1, 5.1, 0.2}) == 0b1100);
+        REQUIRE(culling.query({-10, -10, -10}, {10, 10, 10}) == 0b1111);
+    }
+    
+    SECTION("placeholders") {
+        //check: placeholders carry the sign of the function outside of its zero set
+        REQUIRE(culling.placeholder(0)[0] == -1);
+        REQUIRE(culling.placeholder(1)[0] == -1);
+        REQUIRE(culling.placeholder(2)[0] == -1);
+        std::array<double, 3> p = {0, 0, 0.5};
+        auto eval = culling.evaluate(p, 0b0101);
+        REQUIRE(eval.size() == 4);
+        REQUIRE(eval[0][0] == 0.5);
+        REQUIRE(eval[1] == culling.placeholder(1));
+        REQUIRE(eval[3] == culling.placeholder(3));
+    }
+}
+
+TEST_CASE("batched evaluation of implicit functions", "[functions]") {
+    std::vector<std::unique_ptr<ImplicitFunction<double>>> functions;
+    functions.push_back(std::make_unique<PlaneDistanceFunction<double>>(std::array<double, 3>{0.1, 0.2, 0.3}, std::array<double, 3>{1, 2, 2}));
+    functions.push_back(std::make_unique<CylinderDistanceFunction<double>>(std::array<double, 3>{0, 0, 0}, std::array<double, 3>{0, 1, 1}, 0.5));
+    functions.push_back(std::make_unique<CylinderSquaredDistanceFunction<double>>(std::array<double, 3>{0, 0, 0}, std::array<double, 3>{0, 1, 1}, 0.5));
+    functions.push_back(std::make_unique<SphereDistanceFunction<double>>(std::array<double, 3>{0.5, 0.5, 0.5}, 0.3));
+    functions.push_back(std::make_unique<SphereUnsignedDistanceFunction<double>>(std::array<double, 3>{0.5, 0.5, 0.5}, 0.3));
+    functions.push_back(std::make_unique<SphereSquaredDistanceFunction<double>>(std::array<double, 3>{0.5, 0.5, 0.5}, 0.3));
+    functions.push_back(std::make_unique<ConeDistanceFunction<double>>(std::array<double, 3>{0, 0, 0}, std::array<double, 3>{1, 0, 0}, 0.4));
+    functions.push_back(std::make_unique<TorusDistanceFunction<double>>(std::array<double, 3>{0.5, 0.5, 0.5}, std::array<double, 3>{0, 0, 1}, 0.35, 0.1));
+    functions.push_back(std::make_unique<ConstantFunction<double>>(2));
+    functions.push_back(std::make_unique<GeneralFunction<double>>([](double x, double y, double z, double &gx, double &gy, double &gz){
+        gx = 2 * x;
+        gy = 1;
+        gz = 0;
+        return x * x + y;
+    }));
+    std::vector<Eigen::Vector3d> control_points = {{0.2, 0.3, 0.4}, {0.7, 0.6, 0.5}, {0.4, 0.8, 0.1}};
+    Eigen::VectorXd coeff_a(12);
+    coeff_a << 0.5, -1, 0.25, 0.1, -0.2, 0.3, 0.4, 0.2, -0.1, -0.3, 0.6, 0.05;
+    functions.push_back(std::make_unique<Hermite_RBF<double>>(control_points, coeff_a, Eigen::Vector4d(0.1, -0.2, 0.3, 0.4)));
+    
+    //points on a lattice, including the centers, apexes, axes and control points, where the gradients take their special cases,
+    //but off the center circle of the torus, where its gradient is undefined
+    std::vector<double> xs, ys, zs;
+    for (int i = 0; i <= 10; i++){
+        for (int j = 0; j <= 10; j++){
+            for (int k = 0; k <= 10; k++){
+                xs.push_back(i * 0.1);
+                ys.push_back(j * 0.1);
+                zs.push_back(k * 0.1);
+            }
+        }
+    }
+    xs.insert(xs.end(), {0.2, 0.7, 0.4});
+    ys.insert(ys.end(), {0.3, 0.6, 0.8});
+    zs.insert(zs.end(), {0.4, 0.5, 0.1});
+    const size_t n = xs.size();
+    
+    for (auto &function : functions){
+        std::vector<double> values(n), batch_values(n), gx(n), gy(n), gz(n);
+        function->evaluate_batch(xs, ys, zs, batch_values);
+        function->evaluate_gradient_batch(xs, ys, zs, values, gx, gy, gz);
+        for (size_t i = 0; i < n; i++){
+            double sx, sy, sz;
+            const double value = function->evaluate_gradient(xs[i], ys[i], zs[i], sx, sy, sz);
+            //check: the batches agree with the scalar evaluation, up to the rounding of a different order of the sums
+            REQUIRE(batch_values[i] == Approx(function->evaluate(xs[i], ys[i], zs[i])).margin(1e-12));
+            REQUIRE(values[i] == Approx(value).margin(1e-12));
+            REQUIRE(gx[i] == Approx(sx).margin(1e-12));
+            REQUIRE(gy[i] == Approx(sy).margin(1e-12));
+            REQUIRE(gz[i] == Approx(sz).margin(1e-12));
+        }
+    }
+}
+
+TEST_CASE("SIMD kernels of the primitives", "[functions]") {
+    std::vector<std::unique_ptr<ImplicitFunction<double>>> functions;
+    std::vector<primitive_params> params;
+    auto add = [&](auto function){
+        params.push_back(function->kernel_params());
+        functions.push_back(std::move(function));
+    };
+    add(std::make_unique<PlaneDistanceFunction<double>>(std::array<double, 3>{0.1, 0.2, 0.3}, std::array<double, 3>{1, 2, 2}));
+    add(std::make_unique<CylinderDistanceFunction<double>>(std::array<double, 3>{0.5, 0.5, 0.5}, std::array<double, 3>{0, 1, 1}, 0.25));
+    add(std::make_unique<CylinderDistanceFunction<double>>(std::array<double, 3>{0.5, 0.5, 0.5}, std::array<double, 3>{0, 0, 1}, 0));
+    add(std::make_unique<CylinderSquaredDistanceFunction<double>>(std::array<double, 3>{0.5, 0.5, 0.5}, std::array<double, 3>{0, 1, 1}, 0.25));
+    add(std::make_unique<SphereDistanceFunction<double>>(std::array<double, 3>{0.5, 0.5, 0.5}, 0.3));
+    add(std::make_unique<SphereUnsignedDistanceFunction<double>>(std::array<double, 3>{0.5, 0.5, 0.5}, 0.3));
+    add(std::make_unique<SphereSquaredDistanceFunction<double>>(std::array<double, 3>{0.5, 0.5, 0.5}, 0.3));
+    add(std::make_unique<ConeDistanceFunction<double>>(std::array<double, 3>{0.5, 0.5, 0.5}, std::array<double, 3>{1, 1, 0}, 0.4));
+    add(std::make_unique<TorusDistanceFunction<double>>(std::array<double, 3>{0.5, 0.5, 0.5}, std::array<double, 3>{0, 0, 1}, 0.3, 0.1));
+    add(std::make_unique<TorusDistanceFunction<double>>(std::array<double, 3>{0.5, 0.5, 0.5}, std::array<double, 3>{0, 0, 1}, 0.3, 0));
+    
+    //random points, then the centers, apexes and points on the axes, where the scalar code takes its special cases.
+    //their number isn't a multiple of the SIMD width, so the last pack is partial
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<double> dist(-0.5, 1.5);
+    std::vector<double> xs, ys, zs;
+    for (int i = 0; i < 1001; i++){
+        xs.push_back(dist(gen));
+        ys.push_back(dist(gen));
+        zs.push_back(dist(gen));
+    }
+    for (double t : {0.0, 0.25, 0.5}){
+        xs.push_back(0.5);
+        ys.push_back(0.5);
+        zs.push_back(0.5 + t);
+    }
+    const size_t n = xs.size();
+    
+    std::vector<std::pair<std::string, primitive_kernel>> kernels = {{"scalar", evaluate_primitive_scalar}};
+    if (cpu_has_avx2()){
+        kernels.push_back({"avx2", evaluate_primitive_avx2});
+    }
+    for (auto &[name, kernel] : kernels){
+        INFO(name);
+        for (size_t f = 0; f < functions.size(); f++){
+            std::vector<double> values(n), gradient_values(n), gx(n), gy(n), gz(n);
+            kernel(params[f], n, xs.data(), ys.data(), zs.data(), values.data(), nullptr, nullptr, nullptr);
+            kernel(params[f], n, xs.data(), ys.data(), zs.data(), gradient_values.data(), gx.data(), gy.data(), gz.data());
+            for (size_t i = 0; i < n; i++){
+                double sx, sy, sz;
+                const double value = functions[f]->evaluate_gradient(xs[i], ys[i], zs[i], sx, sy, sz);
+                //check: the kernels compute the same operations as the scalar code, so they agree bit for bit
+                REQUIRE(values[i] == functions[f]->evaluate(xs[i], ys[i], zs[i]));
+                REQUIRE(gradient_values[i] == value);
+                REQUIRE(gx[i] == sx);
+                REQUIRE(gy[i] == sy);
+                REQUIRE(gz[i] == sz);
+            }
+        }
+    }
+}
+
+TEST_CASE("convex hull membership", "[contains]") {
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<double> real(-1, 1);
+    std::uniform_int_distribution<int> integer(-2, 2);
+    
+    SECTION("3D points") {
+        for (int sample = 0; sample < 2000; sample++){
+            std::array<double, 60> pts;
+            std::array<double, 3> query = {0, 0, 0};
+            for (size_t i = 0; i < pts.size(); i++){
+                //small integer points have many ties: points on the planes of others, duplicates and a query point on the hull
+                pts[i] = sample % 2 ? real(gen) + 0.5 * (i % 3 == 0) : integer(gen);
+                //flat hulls around and off the query point
+                if (sample % 5 == 0 && i % 3 == 2){
+                    pts[i] = sample % 10 ? 0 : 1;
+                }
+            }
+            REQUIRE(convex_hull_membership::contains<3, double>(pts, query) == convex_hull_membership::details::contains_exhaustive<3, double>(pts, query));
+        }
+    }
+    
+    SECTION("collinear 2D points") {
+        std::array<double, 2> query = {0, 0};
+        //check: points on a ray from the query point, which is on their line
+        std::array<double, 8> ray = {1, 1, 3, 3, 2, 2, 1, 1};
+        REQUIRE(convex_hull_membership::contains<2, double>(ray, query));
+        //check: points on a line away from the query point
+        std::array<double, 8> line = {1, 0, 1, 2, 1, -3, 1, 1};
+        REQUIRE(!convex_hull_membership::contains<2, double>(line, query));
+        //check: points on both rays of a line through the query point
+        std::array<double, 6> both = {1, 2, 2, 4, -0.5, -1};
+        REQUIRE(convex_hull_membership::contains<2, double>(both, query));
+        //check: a single point
+        std::array<double, 4> single = {1, 2, 1, 2};
+        REQUIRE(convex_hull_membership::contains<2, double>(single, query));
+        std::array<double, 4> pair = {1, 2, 2, 1};
+        REQUIRE(!convex_hull_membership::contains<2, double>(pair, query));
+    }
+    
+    SECTION("filtered orientation predicates") {
+        exactinit();
+        //nearly coplanar points, which the filter can't always certify
+        std::array<double, 3> pa = {0.1, 0.2, 0.3}, pb = {1.3, -0.7, 0.25}, pc = {-0.4, 0.9, 1.1};
+        std::array<double, 32> x, y, z;
+        for (size_t l = 0; l < x.size(); l++){
+            double s = real(gen), t = real(gen);
+            double offset = l % 4 == 0 ? 0 : std::ldexp(real(gen), -40 - int(l));
+            x[l] = pa[0] + s * (pb[0] - pa[0]) + t * (pc[0] - pa[0]) + offset;
+            y[l] = pa[1] + s * (pb[1] - pa[1]) + t * (pc[1] - pa[1]);
+            z[l] = pa[2] + s * (pb[2] - pa[2]) + t * (pc[2] - pa[2]);
+        }
+        std::array<int8_t, 32> sign3, sign2;
+        uint32_t uncertain3 = filtered_predicates::orient3d_batch(pa.data(), pb.data(), pc.data(), x.data(), y.data(), z.data(), x.size(), sign3.data());
+        uint32_t uncertain2 = filtered_predicates::orient2d_batch(pa.data(), pb.data(), x.data(), y.data(), x.size(), sign2.data());
+        //check: the filter is unsure on some points, and the certain signs are exact
+        REQUIRE(uncertain3 != 0);
+        REQUIRE(uncertain3 != ~uint32_t(0));
+        for (size_t l = 0; l < x.size(); l++){
+            std::array<double, 3> pd = {x[l], y[l], z[l]};
+            double exact3 = orient3d(pa.data(), pb.data(), pc.data(), pd.data());
+            double exact2 = orient2d(pa.data(), pb.data(), pd.data());
+            int sign_exact3 = (exact3 > 0) - (exact3 < 0);
+            int sign_exact2 = (exact2 > 0) - (exact2 < 0);
+            REQUIRE(filtered_predicates::orient3d(pa.data(), pb.data(), pc.data(), pd.data()) == sign_exact3);
+            REQUIRE(filtered_predicates::orient2d(pa.data(), pb.data(), pd.data()) == sign_exact2);
+            REQUIRE(((uncertain3 >> l) & 1) == (sign3[l] == 0));
+            REQUIRE(((uncertain2 >> l) & 1) == (sign2[l] == 0));
+            if (sign3[l] != 0){
+                REQUIRE(sign3[l] == sign_exact3);
+            }
+            if (sign2[l] != 0){
+                REQUIRE(sign2[l] == sign_exact2);
+            }
+        }
+    }
+    
+    SECTION("2D points") {
+        for (int sample = 0; sample < 2000; sample++){
+            std::array<double, 40> pts;
+            std::array<double, 2> query = {0, 0};
+            for (size_t i = 0; i < pts.size(); i++){
+                pts[i] = sample % 2 ? real(gen) + 0.8 * (i % 2 == 0) : integer(gen);
+                if (sample % 5 == 0 && i % 2 == 1){
+                    pts[i] = pts[i - 1];
+                }
+            }
+            REQUIRE(convex_hull_membership::contains<2, double>(pts, query) == convex_hull_membership::details::contains_exhaustive<2, double>(pts, query));
+        }
+    }
+}
+
+TEST_CASE("refinement criteria from several threads", "[threads]") {
+    //parse configurations
+    mtet::MTetMesh grid = grid_mesh::generate_tet_mesh({24, 24, 24}, {0, 0, 0}, {1, 1, 1}, grid_mesh::TET6);
+    std::string function_file = std::string(TEST_FILE) + "/function_examples/3-cyl3.json";
+    std::vector<std::unique_ptr<ImplicitFunction<double>>> functions;
+    load_functions(function_file, functions);
+    const size_t funcNum = functions.size();
+    auto implicit_func = [&](std::span<const Scalar, 3> data, size_t funcNum){
+        llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20> vertex_eval(funcNum);
+        for(size_t funcIter = 0; funcIter < funcNum; funcIter++){
+            auto &func = functions[funcIter];
+            Eigen::Vector4d eval;
+            eval[0] = func->evaluate_gradient(data[0], data[1], data[2], eval[1], eval[2], eval[3]);
+            vertex_eval[funcIter] = eval;
+        }
+        return vertex_eval;
+    };
+    std::vector<Eigen::Matrix<double, 4, 3>> tet_pts;
+    std::vector<std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4>> tet_infos;
+    grid.seq_foreach_tet([&](mtet::TetId tid, std::span<const VertexId, 4> vs) {
+        Eigen::Matrix<double, 4, 3> pts;
+        std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info;
+        for (int i = 0; i < 4; i++){
+            auto coords = grid.get_vertex(vs[i]);
+            pts.row(i) = Eigen::RowVector3d({coords[0], coords[1], coords[2]});
+            tet_info[i] = implicit_func(std::span<const Scalar, 3>(coords.data(), 3), funcNum);
+        }
+        tet_pts.push_back(pts);
+        tet_infos.push_back(tet_info);
+    });
+    
+    //the results of all the criteria on all the tets at two thresholds, with the counters of one run
+    struct crit_results
+    {
+        std::vector<int> results;
+        int sub_call_two = 0;
+        int sub_call_three = 0;
+    };
+    auto run_criteria = [&]()
+    {
+        crit_results run;
+        tet_batch batch;
+        for (size_t tetIter = 0; tetIter < 2 * tet_pts.size(); tetIter++){
+            const double threshold = tetIter < tet_pts.size() ? 0.01 : 0.001;
+            const size_t tet = tetIter % tet_pts.size();
+            bool active_IA = false, active_MI = false;
+            bool refine_IA = critIA(tet_pts[tet], tet_infos[tet], funcNum, threshold, curve_network, active_IA, run.sub_call_two, run.sub_call_three);
+            bool refine_MI = critMI(tet_pts[tet], tet_infos[tet], funcNum, threshold, curve_network, active_MI, run.sub_call_two, run.sub_call_three);
+            run.results.push_back(refine_IA + 2 * active_IA + 4 * refine_MI + 8 * active_MI);
+            batch.set(batch.size++, tet_pts[tet], tet_infos[tet], funcNum);
+            if (batch.size == crit_batch_width || tet + 1 == tet_pts.size()){
+                uint32_t active = 0;
+                uint32_t refine = critIA_batch(batch, funcNum, threshold, curve_network, active, run.sub_call_two, run.sub_call_three);
+                run.results.push_back(int(refine));
+                run.results.push_back(int(active));
+                batch.size = 0;
+            }
+        }
+        return run;
+    };
+    
+    //check: every thread gets the serial results, with its own counters
+    crit_results serial = run_criteria();
+    REQUIRE(serial.sub_call_two > 0);
+    REQUIRE(serial.sub_call_three > 0);
+    const int num_threads = 4;
+    std::vector<crit_results> parallel(num_threads);
+    std::vector<std::thread> threads;
+    for (int threadIter = 0; threadIter < num_threads; threadIter++){
+        threads.emplace_back([&, threadIter](){ parallel[threadIter] = run_criteria(); });
+    }
+    for (auto &thread : threads){
+        thread.join();
+    }
+    for (const crit_results &run : parallel){
+        REQUIRE(run.results == serial.results);
+        REQUIRE(run.sub_call_two == serial.sub_call_two);
+        REQUIRE(run.sub_call_three == serial.sub_call_three);
+    }
+}
+
+TEST_CASE("batched criteria against the per-tet criteria", "[batch]") {
+    //random tets with quadratic functions through them, at scales where the single-precision filter of `critIA_batch` can't decide
+    std::mt19937 rng(40);
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    const size_t funcNum = 3;
+    const std::array<double, 6> scales = {1, 1e-3, 1e-30, 1e-300, 1e300, 0};
+    for (int batchIter = 0; batchIter < 600; batchIter++){
+        const double scale = scales[batchIter % scales.size()];
+        const double threshold = std::pow(10.0, -6 + 3 * (uniform(rng) + 1));
+        const bool curve = batchIter % 4 == 3;
+        tet_batch batch;
+        std::array<Eigen::Matrix<double, 4, 3>, crit_batch_width> tet_pts;
+        std::array<std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4>, crit_batch_width> tet_infos;
+        for (size_t l = 0; l < crit_batch_width; l++){
+            for (int i = 0; i < 4; i++){
+                for (int d = 0; d < 3; d++){
+                    tet_pts[l](i, d) = 0.01 * uniform(rng);
+                }
+            }
+            for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                Eigen::RowVector3d grad(uniform(rng), uniform(rng), uniform(rng));
+                const double curvature = 10 * uniform(rng), offset = 0.01 * uniform(rng);
+                for (int i = 0; i < 4; i++){
+                    tet_infos[l][i].resize(funcNum);
+                    Eigen::RowVector3d p = tet_pts[l].row(i);
+                    tet_infos[l][i][funcIter] << grad.dot(p) + curvature * p.squaredNorm() + offset, grad + 2 * curvature * p;
+                    tet_infos[l][i][funcIter] *= scale;
+                }
+            }
+            //a zero at a vertex
+            if (l == 0){
+                tet_infos[l][0][0][0] = 0;
+            }
+            batch.set(batch.size++, tet_pts[l], tet_infos[l], funcNum);
+        }
+        
+        //check: every lane gets the per-tet results, counters and branches
+        int batch_two = 0, batch_three = 0, per_tet_two = 0, per_tet_three = 0;
+        uint32_t active = 0;
+        std::array<pair_hint, crit_batch_width> batch_hints;
+        uint32_t refine = critIA_batch(batch, funcNum, threshold, curve, active, batch_two, batch_three, batch_hints.data());
+        for (size_t l = 0; l < crit_batch_width; l++){
+            bool tet_active = false;
+            pair_hint tet_hint;
+            bool tet_refine = critIA(tet_pts[l], tet_infos[l], funcNum, threshold, curve, tet_active, per_tet_two, per_tet_three, &tet_hint);
+            REQUIRE(bool((refine >> l) & 1) == tet_refine);
+            REQUIRE(bool((active >> l) & 1) == tet_active);
+            REQUIRE(tet_hint.stats.tets() == 1);
+            REQUIRE(batch_hints[l].stats.exits == tet_hint.stats.exits);
+            REQUIRE(batch_hints[l].stats.active_functions == tet_hint.stats.active_functions);
+            REQUIRE(batch_hints[l].stats.hull_calls == tet_hint.stats.hull_calls);
+            REQUIRE(tet_hint.stats.exits[crit_stats::sign_test][0] == !tet_active);
+        }
+        REQUIRE(batch_two == per_tet_two);
+        REQUIRE(batch_three == per_tet_three);
+        
+        //check: the AVX2 kernels agree bit for bit with the kernels compiled with the build flags
+        if (cpu_has_avx2()){
+            auto same_bits = [](const auto &a, const auto &b) { return std::memcmp(&a, &b, sizeof(a)) == 0; };
+            batch_geometry geo, geo_avx2;
+            batch_kernels_scalar.geometry(batch, geo);
+            batch_kernels_avx2.geometry(batch, geo_avx2);
+            REQUIRE(same_bits(geo, geo_avx2));
+            batch_filter filter, filter_avx2;
+            batch_kernels_scalar.filter(batch, geo, funcNum, threshold, curve, filter);
+            batch_kernels_avx2.filter(batch, geo, funcNum, threshold, curve, filter_avx2);
+            auto bezier = std::make_unique<batch_bezier>(), bezier_avx2 = std::make_unique<batch_bezier>();
+            for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+                REQUIRE(filter.active[funcIter] == filter_avx2.active[funcIter]);
+                REQUIRE(filter.inactive[funcIter] == filter_avx2.inactive[funcIter]);
+                REQUIRE(filter.refine[funcIter] == filter_avx2.refine[funcIter]);
+                REQUIRE(filter.keep[funcIter] == filter_avx2.keep[funcIter]);
+                batch_kernels_scalar.bezier(batch, geo, funcIter, threshold, curve, *bezier);
+                batch_kernels_avx2.bezier(batch, geo, funcIter, threshold, curve, *bezier_avx2);
+                REQUIRE(same_bits(bezier->val[funcIter], bezier_avx2->val[funcIter]));
+                REQUIRE(same_bits(bezier->diff[funcIter], bezier_avx2->diff[funcIter]));
+                REQUIRE(same_bits(bezier->grad[funcIter], bezier_avx2->grad[funcIter]));
+                REQUIRE(same_bits(bezier->low[funcIter], bezier_avx2->low[funcIter]));
+                REQUIRE(same_bits(bezier->high[funcIter], bezier_avx2->high[funcIter]));
+                REQUIRE(bezier->refine[funcIter] == bezier_avx2->refine[funcIter]);
+            }
+        }
+    }
+}
+
+TEST_CASE("single-function checks starting from the last refining function", "[IA]") {
+    //random tets with quadratic functions through them, checked in sequence with one hint as in the adaptive loop
+    std::mt19937 rng(47);
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    const size_t funcNum = 6;
+    const double threshold = 1e-4;
+    pair_hint hint;
+    int refined = 0;
+    for (int tetIter = 0; tetIter < 2000; tetIter++){
+        Eigen::Matrix<double, 4, 3> pts;
+        std::array<llvm_vecsmall::SmallVector<Eigen::RowVector4d, 20>,4> tet_info;
+        for (int i = 0; i < 4; i++){
+            for (int d = 0; d < 3; d++){
+                pts(i, d) = 0.01 * uniform(rng);
+            }
+            tet_info[i].resize(funcNum);
+        }
+        for (size_t funcIter = 0; funcIter < funcNum; funcIter++){
+            Eigen::RowVector3d grad(uniform(rng), uniform(rng), uniform(rng));
+            const double curvature = 10 * uniform(rng), offset = 0.01 * uniform(rng);
+            for (int i = 0; i < 4; i++){
+                Eigen::RowVector3d p = pts.row(i);
+                tet_info[i][funcIter] << grad.dot(p) + curvature * p.squaredNorm() + offset, grad + 2 * curvature * p;
+            }
+        }
+        
+        //check: the order of the functions doesn't change the results
+        bool active = false, hinted_active = false;
+        int two = 0, three = 0, hinted_two = 0, hinted_three = 0;
+        const int first = hint.first;
+        bool refine = critIA(pts, tet_info, funcNum, threshold, curve_network, active, two, three);
+        bool hinted_refine = critIA(pts, tet_info, funcNum, threshold, curve_network, hinted_active, hinted_two, hinted_three, &hint);
+        REQUIRE(hinted_refine == refine);
+        REQUIRE(hinted_active == active);
+        REQUIRE(hinted_two == two);
+        REQUIRE(hinted_three == three);
+        if (!refine){
+            REQUIRE(hint.first == first);
+        }
+        refined += refine;
+    }
+    REQUIRE(refined > 0);
+    REQUIRE(hint.first >= 0);
+}
+
+TEST_CASE("closed-form Kuhn lattice", "[grid]") {
+    auto tet_coordinates = [](const mtet::MTetMesh &mesh){
+        std::set<std::array<std::array<double, 3>, 4>> tets;
+        mesh.seq_foreach_tet([&](mtet::TetId tid, std::span<const mtet::VertexId, 4> vs){
+            std::array<std::array<double, 3>, 4> tet;
+            for (size_t i = 0; i < 4; i++){
+                auto p = mesh.get_vertex(vs[i]);
+                tet[i] = {p[0], p[1], p[2]};
+            }
+            std::sort(tet.begin(), tet.end());
+            tets.insert(tet);
+        });
+        return tets;
+    };
+    mtet::MTetMesh lattice = grid_mesh::generate_kuhn_lattice({4, 4, 4}, {0, 0, 0}, {1, 1, 1});
+    REQUIRE(lattice.get_num_vertices() == 125);
+    REQUIRE(lattice.get_num_tets() == 384);
+    
+    SECTION("same tets as the bisection of a Kuhn cube") {
+        mtet::MTetMesh cube = grid_mesh::generate_kuhn_lattice({1, 1, 1}, {0, 0, 0}, {1, 1, 1});
+        uniform_refine(std::sqrt(3.) / 4, cube);
+        REQUIRE(cube.get_num_tets() == 384);
+        REQUIRE(tet_coordinates(cube) == tet_coordinates(lattice));
+        REQUIRE(grid_mesh::generate_from_kuhn_mesh({1, 1, 1}, {0, 0, 0}, {5, 5, 5}).get_num_tets() == 384);
+    }
+    SECTION("analytic adjacency") {
+        size_t boundary_faces = 0;
+        lattice.seq_foreach_tet([&](mtet::TetId tid, std::span<const mtet::VertexId, 4> vs){
+            Eigen::Matrix3d edges;
+            for (size_t i = 0; i < 3; i++){
+                for (size_t j = 0; j < 3; j++){
+                    edges(i, j) = lattice.get_vertex(vs[i + 1])[j] - lattice.get_vertex(vs[0])[j];
+                }
+            }
+            REQUIRE(edges.determinant() > 0);
+            for (uint8_t i = 0; i < 4; i++){
+                mtet::TetId mirror = lattice.get_mirror(tid, i);
+                if (value_of(mirror) == 0){
+                    boundary_faces++;
+                    continue;
+                }
+                auto ws = lattice.get_tet(mirror);
+                size_t shared = 0;
+                for (uint8_t j = 0; j < 4; j++){
+                    shared += (j != i && std::find(ws.begin(), ws.end(), vs[j]) != ws.end());
+                }
+                REQUIRE(shared == 3);
+            }
+        });
+        REQUIRE(boundary_faces == 6 * 16 * 2);
+    }
+}